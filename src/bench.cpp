@@ -0,0 +1,881 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <math.h>
+#include <stdlib.h>
+
+#include "gmres.h"
+#include "sgmres.h"
+#include "matgen.h"
+#include "sparse/csr.h"
+#include "sparse/cslr.h"
+#include "sparse/spmvplan.h"
+#include "sparse/streamcsr.h"
+#include "sparse/skyline.h"
+#include "sparse/powers.h"
+#include "sparse/amg.h"
+#include "sparse/chebyshev.h"
+#include "sparse/schwarz.h"
+#include "sparse/parallel.h"
+
+#define VALUE_T double
+
+/**
+ * Largest envelope (elements per triangle) factored by SkylineLU
+ */
+const long long SKYLINE_BENCH_MAX = 1LL << 25;
+
+/**
+ * Number of products made at once by MatrixPowers
+ */
+const int MPK_BENCH_POWERS = 5;
+
+/**
+ * Restart length of GMRES and s-step GMRES
+ */
+const int GMRES_BENCH_RESTART = 30;
+
+using namespace std;
+
+/**
+ * Benchmark of sparse matrix-vector products and solvers.
+ *
+ * Usage:
+ *   bench [--rows N] [--matrix lap2d|lap3d|banded|powerlaw|all]
+ *         [--reps R] [--stream N] [--out results.json]
+ *         [--trace trace.json] [--numa 1] [--disk matrix.bin]
+ *
+ * For every generated matrix the following kernels are timed:
+ * CSR::operator*, CSR::multiply_merge_path, spmv_dots on CSR (SpMV
+ * with two fused dot products), MatrixPowers on CSR
+ * (MPK_BENCH_POWERS products at once), BlockedCSR::multiply
+ * (panels sized to the last level cache), DIA::multiply (for
+ * matrices on few diagonals), HYB::multiply, CSLR::operator* (also
+ * in symmetric mode for matrices with symmetric values),
+ * SpMVPlan tuned on CSR (with
+ * the name of chosen kernel), GMRES on CSR and GMRES on CSLR,
+ * s-step GMRES on CSR, setup of smoothed aggregation AMG and
+ * GMRES and s-step GMRES on CSR preconditioned by it, GMRES on
+ * CSR preconditioned by Chebyshev polynomial, setup of block
+ * Jacobi (one block per thread) and GMRES on CSR preconditioned
+ * by it.
+ * Matrices whose envelope holds at most SKYLINE_BENCH_MAX elements
+ * are also factored by SkylineLU; factorization and solve are
+ * timed (with the relative residual of solution).
+ * Median time, GFLOP/s, effective GB/s (by the minimal traffic
+ * model of each format) and percentage of the bandwidth measured
+ * by STREAM triad are reported to stdout and to JSON file.
+ * Solvers are rated by the model of one iteration (product,
+ * preconditioner, orthogonalization) times their iterations,
+ * and also report the iterations and the residual.
+ * With --trace (and -DSPARSE_TRACE) the timeline of the run is
+ * written in Chrome trace format.
+ *
+ * With --numa 1 the threads are pinned by numa_pin_threads() and
+ * CSR::operator* is additionally timed on a copy of matrix (and
+ * of vector) that was placed by a single thread, i.e. mostly on
+ * one node. The ratio of both times is the gain of local placement.
+ *
+ * With --disk the matrix is also written to the given file in
+ * 8 MiB row panels and StreamCSR::operator* and GMRES are timed
+ * on it. Minimal traffic of StreamCSR counts the bytes read from
+ * disk (or page cache).
+ */
+
+/**
+ * Usage text (see the comment above)
+ */
+const char *USAGE =
+	"Usage:\n"
+	"  bench [--rows N] [--matrix lap2d|lap3d|banded|powerlaw|all]\n"
+	"        [--reps R] [--stream N] [--out results.json]\n"
+	"        [--trace trace.json] [--numa 1] [--disk matrix.bin]\n";
+
+struct Options
+{
+	int rows;
+	string matrix;
+	int reps;
+	int stream_size;
+	string out;
+	string trace;
+	bool numa;
+	string disk;
+};
+
+struct Result
+{
+	string matrix;
+	string kernel;
+	int rows;
+	long long nnz;
+	double median;
+	double flops;
+	double bytes;
+	int iterations;
+	double residual;
+};
+
+typedef chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start, Clock::time_point end)
+{
+	return chrono::duration<double>(end - start).count();
+}
+
+double median(vector<double> times)
+{
+	sort(times.begin(), times.end());
+	size_t n = times.size();
+	return (n % 2) ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+}
+
+/**
+ * @brief Measures memory bandwidth with STREAM triad
+ * @details a = b + s * c, 24 bytes per element, best of reps
+ *
+ * @param size Number of elements in each array
+ * @param reps Number of repetitions
+ * @return Bandwidth in bytes per second
+ */
+double stream_triad(int size, int reps)
+{
+	double *a = new double[size];
+	double *b = new double[size];
+	double *c = new double[size];
+
+	// Same static partition for initialization and triad, so that
+	// every thread touches its own pages first
+	parallel([&](int tid, int nthreads) {
+		int lo, hi;
+		ThreadPool::range(size, tid, nthreads, lo, hi);
+
+		for (int i = lo; i < hi; ++i) {
+			a[i] = 0;
+			b[i] = 1;
+			c[i] = 2;
+		}
+	});
+
+	double best = 1e30;
+
+	for (int r = 0; r < reps; ++r) {
+		Clock::time_point start = Clock::now();
+
+		parallel([&](int tid, int nthreads) {
+			int lo, hi;
+			ThreadPool::range(size, tid, nthreads, lo, hi);
+
+			for (int i = lo; i < hi; ++i) {
+				a[i] = b[i] + 3.0 * c[i];
+			}
+		});
+
+		best = min(best, seconds(start, Clock::now()));
+	}
+
+	volatile double sink = a[size / 2];
+	(void)sink;
+
+	delete[] a;
+	delete[] b;
+	delete[] c;
+
+	return 24.0 * size / best;
+}
+
+/**
+ * @brief Adapter that lets time_spmv() run merge-path SpMV
+ */
+struct MergePathSpMV
+{
+	const CSR<VALUE_T> &A;
+
+	SVEC operator* (const SVEC &x) const
+	{
+		return A.multiply_merge_path(x);
+	}
+};
+
+/**
+ * @brief Adapter that lets time_spmv() run SpMV fused with the
+ * reductions of an Arnoldi step (<y, y> and <y, x>)
+ */
+template <typename SMTRX>
+struct FusedSpMV
+{
+	const SMTRX &A;
+
+	SVEC operator* (const SVEC &x) const
+	{
+		SVEC y(x.size());
+		const SVEC *v = &x;
+		double dots[2];
+
+		spmv_dots(A, x, y, &v, 1, dots);
+		return y;
+	}
+};
+
+/**
+ * @brief Adapter that lets time_spmv() run MPK_BENCH_POWERS
+ * products by the matrix powers kernel
+ */
+struct PowersSpMV
+{
+	const MatrixPowers<VALUE_T> &mpk;
+	vector<SVEC> &y;
+
+	SVEC operator* (const SVEC &x) const
+	{
+		vector<SVEC*> out(y.size());
+
+		for (size_t j = 0; j < y.size(); ++j) {
+			out[j] = &y[j];
+		}
+
+		mpk.run(x, &out[0], (int)out.size());
+		return y.back();
+	}
+};
+
+template <typename SMTRX>
+double time_spmv(const SMTRX &A, const SVEC &x, int reps)
+{
+	vector<double> times;
+
+	for (int r = 0; r < reps; ++r) {
+		Clock::time_point start = Clock::now();
+		SVEC y = A * x;
+		times.push_back(seconds(start, Clock::now()));
+	}
+
+	return median(times);
+}
+
+template <typename SOLVER, typename SMTRX>
+Result time_gmres(const SMTRX &A, const SVEC &b, int reps,
+				  Preconditioner<VALUE_T> *M = 0)
+{
+	SVEC x0(b.size());
+	for (int i = 0; i < x0.size(); ++i) {
+		x0[i] = 0;
+	}
+
+	vector<double> times;
+	Result res;
+
+	for (int r = 0; r < reps; ++r) {
+		SOLVER solver(A, b, GMRES_BENCH_RESTART, 1e-8, 1000);
+		solver.set_preconditioner(M);
+
+		Clock::time_point start = Clock::now();
+		solver.run(x0);
+		times.push_back(seconds(start, Clock::now()));
+
+		res.iterations = solver.iterations();
+		res.residual = solver.residual();
+	}
+
+	res.median = median(times);
+	res.flops = 0;
+	res.bytes = 0;
+	return res;
+}
+
+/**
+ * @brief Sets the flops and traffic of GMRES(GMRES_BENCH_RESTART)
+ * by the iterations it made
+ * @details Every iteration: one product, one application of
+ * preconditioner, classical Gram-Schmidt against j + 1 vectors
+ * and the normalization. Every restart cycle of k iterations:
+ * the residual, the update of solution by k vectors and one
+ * more application of preconditioner. s-step GMRES is rated
+ * the same, its block orthogonalization does the same work
+ * per vector.
+ *
+ * @param res Result of time_gmres()
+ * @param n Number of rows
+ * @param spmv_flops Operations of one product
+ * @param spmv_bytes Traffic of one product
+ * @param prec_flops Operations of one application of preconditioner
+ * @param prec_bytes Traffic of one application of preconditioner
+ */
+void gmres_cost(Result &res, int n, double spmv_flops, double spmv_bytes,
+				double prec_flops = 0, double prec_bytes = 0)
+{
+	double w = sizeof(VALUE_T);
+	res.flops = 0;
+	res.bytes = 0;
+
+	for (int done = 0; done < max(1, res.iterations); done += GMRES_BENCH_RESTART) {
+		int k = min(GMRES_BENCH_RESTART, max(1, res.iterations) - done);
+
+		for (int j = 0; j < k; ++j) {
+			res.flops += spmv_flops + prec_flops + (4.0 * (j + 1) + 3) * n;
+			res.bytes += spmv_bytes + prec_bytes + (2.0 * (j + 1) + 3) * n * w;
+		}
+
+		res.flops += spmv_flops + prec_flops + (2.0 * k + 4) * n;
+		res.bytes += spmv_bytes + prec_bytes + (k + 6.0) * n * w;
+	}
+}
+
+
+/**
+ * @brief Times factorization of CSLR matrix by SkylineLU and
+ * the solve with it
+ *
+ * @param A CSLR matrix
+ * @param b Right-hand side
+ * @param reps Number of repetitions
+ * @param solve Result of the solve (factorization is returned)
+ * @return Result of the factorization
+ */
+Result time_skyline(const CSLR<VALUE_T> &A, const SVEC &b, int reps,
+					Result &solve)
+{
+	vector<double> factor_times;
+	vector<double> solve_times;
+	SVEC x(b);
+	Result res;
+
+	for (int r = 0; r < reps; ++r) {
+		Clock::time_point start = Clock::now();
+		SkylineLU<VALUE_T> lu(A);
+		factor_times.push_back(seconds(start, Clock::now()));
+
+		x = b;
+		start = Clock::now();
+		lu.solve(x);
+		solve_times.push_back(seconds(start, Clock::now()));
+
+		lu.factor_cost(res.flops, res.bytes);
+		lu.solve_cost(solve.flops, solve.bytes);
+	}
+
+	SVEC ax = A * x;
+	const VALUE_T *pb = b.data();
+	double rr = 0;
+	double bb = 0;
+
+	for (int i = 0; i < b.size(); ++i) {
+		rr += (ax[i] - pb[i]) * (ax[i] - pb[i]);
+		bb += pb[i] * pb[i];
+	}
+
+	res.median = median(factor_times);
+	res.iterations = 0;
+	res.residual = sqrt(rr / bb);
+
+	solve.median = median(solve_times);
+	solve.iterations = 0;
+	solve.residual = res.residual;
+	return res;
+}
+
+/**
+ * @brief Copies an object with the pool shrunk to one thread,
+ * so that all its pages are placed on the node of caller
+ *
+ * @param obj Object to copy
+ * @return Copy of object
+ */
+template <typename OBJ>
+OBJ serial_copy(const OBJ &obj)
+{
+	ThreadPool &pool = ThreadPool::instance();
+	int nthreads = pool.num_threads();
+
+	pool.set_num_threads(1);
+	OBJ res(obj);
+	pool.set_num_threads(nthreads);
+
+	return res;
+}
+
+CSLR<VALUE_T> to_cslr(const CSR<VALUE_T> &csr)
+{
+	SPARSE_TRACE_SCOPE("assembly");
+	return CSLR<VALUE_T>(csr);
+}
+
+CSR<VALUE_T> generate(const string &name, int rows)
+{
+	SPARSE_TRACE_SCOPE("generate");
+
+	if (name == "lap2d") {
+		return laplacian_2d<VALUE_T>((int)sqrt((double)rows));
+	}
+	if (name == "lap3d") {
+		return laplacian_3d<VALUE_T>((int)cbrt((double)rows));
+	}
+	if (name == "banded") {
+		return banded<VALUE_T>(rows, 8);
+	}
+	if (name == "powerlaw") {
+		return power_law<VALUE_T>(rows, 2, 2.1);
+	}
+
+	throw invalid_argument("Unknown matrix: " + name);
+}
+
+void run_matrix(const string &name, const Options &opts, vector<Result> &results)
+{
+	SPARSE_TRACE_SCOPE("matrix");
+
+	CSR<VALUE_T> csr = generate(name, opts.rows);
+	CSLR<VALUE_T> cslr = to_cslr(csr);
+
+	int n = csr.rows();
+	long long nnz = csr.size_of_aelem();
+	long long nnzl = cslr.size_of_altr();
+
+	SVEC x(n);
+	for (int i = 0; i < n; ++i) {
+		x[i] = 1;
+	}
+
+	Result r;
+	r.matrix = name;
+	r.rows = n;
+	r.nnz = nnz;
+	r.iterations = 0;
+	r.residual = 0;
+
+	// Minimal traffic: every element of matrix, every index and
+	// every element of x and y are touched exactly once
+	r.kernel = "CSR::operator*";
+	r.median = time_spmv(csr, x, opts.reps);
+	r.flops = 2.0 * nnz;
+	r.bytes = nnz * (sizeof(VALUE_T) + sizeof(int)) +
+			  (n + 1.0) * sizeof(int) + 2.0 * n * sizeof(VALUE_T);
+	results.push_back(r);
+
+	MergePathSpMV merge = {csr};
+	r.kernel = "CSR::multiply_merge_path";
+	r.median = time_spmv(merge, x, opts.reps);
+	results.push_back(r);
+
+	FusedSpMV< CSR<VALUE_T> > fused = {csr};
+	r.kernel = "spmv_dots<CSR>";
+	r.median = time_spmv(fused, x, opts.reps);
+	results.push_back(r);
+
+	{
+		MatrixPowers<VALUE_T> mpk(csr, MPK_BENCH_POWERS);
+		vector<SVEC> y(MPK_BENCH_POWERS, SVEC(n));
+		PowersSpMV powers = {mpk, y};
+
+		// Traffic of one product per power: the matrix is read
+		// once per block only when the kernel is blocked
+		r.kernel = mpk.blocked() ? "MatrixPowers<CSR>" : "MatrixPowers<CSR>[plain]";
+		r.median = time_spmv(powers, x, opts.reps);
+		r.flops = 2.0 * nnz * MPK_BENCH_POWERS;
+		r.bytes = nnz * (sizeof(VALUE_T) + sizeof(int)) +
+				  (n + 1.0) * sizeof(int) +
+				  (MPK_BENCH_POWERS + 1.0) * n * sizeof(VALUE_T);
+		results.push_back(r);
+
+		r.flops = 2.0 * nnz;
+		r.bytes = nnz * (sizeof(VALUE_T) + sizeof(int)) +
+				  (n + 1.0) * sizeof(int) + 2.0 * n * sizeof(VALUE_T);
+	}
+
+	{
+		BlockedCSR<VALUE_T> blocked(csr);
+
+		r.kernel = "BlockedCSR::multiply";
+		r.median = time_spmv(blocked, x, opts.reps);
+		results.push_back(r);
+	}
+
+	if (opts.numa) {
+		CSR<VALUE_T> remote = serial_copy(csr);
+		SVEC xremote = serial_copy(x);
+
+		r.kernel = "CSR::operator*[serial placement]";
+		r.median = time_spmv(remote, xremote, opts.reps);
+		results.push_back(r);
+	}
+
+	if (DIA<VALUE_T>::fill(csr) <= 2) {
+		DIA<VALUE_T> dia(csr);
+
+		r.kernel = "DIA::multiply";
+		r.median = time_spmv(dia, x, opts.reps);
+		r.bytes = (dia.diagonals() + 2.0) * n * sizeof(VALUE_T);
+		results.push_back(r);
+	}
+
+	{
+		HYB<VALUE_T> hyb(csr);
+
+		r.kernel = "HYB::multiply";
+		r.median = time_spmv(hyb, x, opts.reps);
+		r.bytes = hyb.ell().width() * (double)n * (sizeof(VALUE_T) + sizeof(int)) +
+				  hyb.coo_size() * (sizeof(VALUE_T) + 2.0 * sizeof(int)) +
+				  2.0 * n * sizeof(VALUE_T);
+		results.push_back(r);
+	}
+
+	r.kernel = "CSLR::operator*";
+	r.median = time_spmv(cslr, x, opts.reps);
+	r.flops = 2.0 * (n + 2 * nnzl);
+	r.bytes = nnzl * (2 * sizeof(VALUE_T) + sizeof(int)) +
+			  (n + 1.0) * sizeof(int) + 3.0 * n * sizeof(VALUE_T);
+	results.push_back(r);
+
+	if (cslr.is_symmetric()) {
+		CSLR<VALUE_T> sym(cslr);
+		sym.make_symmetric();
+
+		r.kernel = "CSLR::operator*[symmetric]";
+		r.median = time_spmv(sym, x, opts.reps);
+		r.bytes = nnzl * (sizeof(VALUE_T) + sizeof(int)) +
+				  (n + 1.0) * sizeof(int) + 3.0 * n * sizeof(VALUE_T);
+		results.push_back(r);
+	}
+
+	{
+		SpMVPlan<VALUE_T> plan(csr);
+
+		r.kernel = string("SpMVPlan[") + spmv_kernel_name(plan.kernel()) + "]";
+		r.median = time_spmv(plan, x, opts.reps);
+		r.flops = 2.0 * nnz;
+		r.bytes = nnz * (sizeof(VALUE_T) + sizeof(int)) +
+				  (n + 1.0) * sizeof(int) + 2.0 * n * sizeof(VALUE_T);
+		results.push_back(r);
+	}
+
+	SVEC b = csr * x;
+	int solver_reps = min(opts.reps, 3);
+
+	double csr_flops = 2.0 * nnz;
+	double csr_bytes = nnz * (sizeof(VALUE_T) + sizeof(int)) +
+					   (n + 1.0) * sizeof(int) + 2.0 * n * sizeof(VALUE_T);
+
+	Result s = time_gmres< GMRES< CSR<VALUE_T> > >(csr, b, solver_reps);
+	s.matrix = name;
+	s.kernel = "GMRES<CSR>";
+	s.rows = n;
+	s.nnz = nnz;
+	gmres_cost(s, n, csr_flops, csr_bytes);
+	results.push_back(s);
+
+	s = time_gmres< GMRES< CSLR<VALUE_T> > >(cslr, b, solver_reps);
+	s.matrix = name;
+	s.kernel = "GMRES<CSLR>";
+	s.rows = n;
+	s.nnz = nnz;
+	gmres_cost(s, n, 2.0 * (n + 2 * nnzl),
+			   nnzl * (2 * sizeof(VALUE_T) + sizeof(int)) +
+			   (n + 1.0) * sizeof(int) + 3.0 * n * sizeof(VALUE_T));
+	results.push_back(s);
+
+	s = time_gmres< SStepGMRES< CSR<VALUE_T> > >(csr, b, solver_reps);
+	s.matrix = name;
+	s.kernel = "SStepGMRES<CSR>";
+	s.rows = n;
+	s.nnz = nnz;
+	gmres_cost(s, n, csr_flops, csr_bytes);
+	results.push_back(s);
+
+	{
+		vector<double> times;
+
+		for (int rep = 0; rep < solver_reps; ++rep) {
+			Clock::time_point start = Clock::now();
+			AMG<VALUE_T> amg(csr);
+			times.push_back(seconds(start, Clock::now()));
+		}
+
+		AMG<VALUE_T> amg(csr);
+
+		r.kernel = "AMG::setup";
+		r.median = median(times);
+		amg.setup_cost(r.flops, r.bytes);
+		results.push_back(r);
+
+		double prec_flops;
+		double prec_bytes;
+		amg.apply_cost(prec_flops, prec_bytes);
+
+		s = time_gmres< GMRES< CSR<VALUE_T> > >(csr, b, solver_reps, &amg);
+		s.matrix = name;
+		s.kernel = "GMRES<CSR>+AMG";
+		s.rows = n;
+		s.nnz = nnz;
+		gmres_cost(s, n, csr_flops, csr_bytes, prec_flops, prec_bytes);
+		results.push_back(s);
+
+		s = time_gmres< SStepGMRES< CSR<VALUE_T> > >(csr, b, solver_reps, &amg);
+		s.matrix = name;
+		s.kernel = "SStepGMRES<CSR>+AMG";
+		s.rows = n;
+		s.nnz = nnz;
+		gmres_cost(s, n, csr_flops, csr_bytes, prec_flops, prec_bytes);
+		results.push_back(s);
+	}
+
+	{
+		Chebyshev<VALUE_T> cheb(csr);
+
+		double prec_flops;
+		double prec_bytes;
+		cheb.apply_cost(prec_flops, prec_bytes);
+
+		s = time_gmres< GMRES< CSR<VALUE_T> > >(csr, b, solver_reps, &cheb);
+		s.matrix = name;
+		s.kernel = "GMRES<CSR>+Chebyshev";
+		s.rows = n;
+		s.nnz = nnz;
+		gmres_cost(s, n, csr_flops, csr_bytes, prec_flops, prec_bytes);
+		results.push_back(s);
+	}
+
+	{
+		vector<double> times;
+
+		for (int rep = 0; rep < solver_reps; ++rep) {
+			Clock::time_point start = Clock::now();
+			Schwarz<VALUE_T> bj(csr);
+			times.push_back(seconds(start, Clock::now()));
+		}
+
+		Schwarz<VALUE_T> bj(csr);
+
+		r.kernel = "Schwarz::setup";
+		r.median = median(times);
+		bj.setup_cost(r.flops, r.bytes);
+		results.push_back(r);
+
+		double prec_flops;
+		double prec_bytes;
+		bj.apply_cost(prec_flops, prec_bytes);
+
+		s = time_gmres< GMRES< CSR<VALUE_T> > >(csr, b, solver_reps, &bj);
+		s.matrix = name;
+		s.kernel = "GMRES<CSR>+BlockJacobi";
+		s.rows = n;
+		s.nnz = nnz;
+		gmres_cost(s, n, csr_flops, csr_bytes, prec_flops, prec_bytes);
+		results.push_back(s);
+	}
+
+	if (SkylineLU<VALUE_T>::envelope(cslr) <= SKYLINE_BENCH_MAX) {
+		Result solve;
+
+		s = time_skyline(cslr, b, solver_reps, solve);
+		s.matrix = solve.matrix = name;
+		s.kernel = "SkylineLU";
+		solve.kernel = "SkylineLU::solve";
+		s.rows = solve.rows = n;
+		s.nnz = solve.nnz = nnz;
+		results.push_back(s);
+		results.push_back(solve);
+	}
+
+	if (!opts.disk.empty()) {
+		{
+			StreamCSRWriter<VALUE_T> writer(opts.disk, n, 8LL << 20);
+			writer.append_rows(csr);
+			writer.close();
+		}
+
+		StreamCSR<VALUE_T> stream(opts.disk);
+
+		r.kernel = "StreamCSR::operator*";
+		r.median = time_spmv(stream, x, opts.reps);
+		r.flops = csr_flops;
+		r.bytes = csr_bytes;
+		results.push_back(r);
+
+		s = time_gmres< GMRES< StreamCSR<VALUE_T> > >(stream, b, solver_reps);
+		s.matrix = name;
+		s.kernel = "GMRES<StreamCSR>";
+		s.rows = n;
+		s.nnz = nnz;
+		gmres_cost(s, n, csr_flops, csr_bytes);
+		results.push_back(s);
+	}
+}
+
+void write_json(ostream &out, const vector<Result> &results,
+				const Options &opts, double stream)
+{
+	out << "{\n"
+		<< "  \"threads\": " << num_threads() << ",\n"
+		<< "  \"numa_nodes\": " << NumaTopology::instance().nodes() << ",\n"
+		<< "  \"pinned\": " << (opts.numa ? "true" : "false") << ",\n"
+		<< "  \"reps\": " << opts.reps << ",\n"
+		<< "  \"stream_triad_gbs\": " << stream / 1e9 << ",\n"
+		<< "  \"results\": [\n";
+
+	for (size_t k = 0; k < results.size(); ++k) {
+		const Result &r = results[k];
+
+		out << "    {\"matrix\": \"" << r.matrix << "\""
+			<< ", \"kernel\": \"" << r.kernel << "\""
+			<< ", \"rows\": " << r.rows
+			<< ", \"nnz\": " << r.nnz
+			<< ", \"median_s\": " << r.median;
+
+		if (r.flops > 0) {
+			double gbs = r.bytes / r.median / 1e9;
+			out << ", \"gflops\": " << r.flops / r.median / 1e9
+				<< ", \"gbs\": " << gbs
+				<< ", \"stream_pct\": " << 100 * gbs / (stream / 1e9);
+		}
+
+		if (r.iterations > 0 || r.residual > 0) {
+			out << ", \"iterations\": " << r.iterations
+				<< ", \"residual\": " << r.residual;
+		}
+
+		out << "}" << (k + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n}\n";
+}
+
+void print_table(const vector<Result> &results, double stream)
+{
+	cout << "STREAM triad: " << stream / 1e9 << " GB/s, threads: "
+		 << num_threads() << ", NUMA nodes: "
+		 << NumaTopology::instance().nodes() << endl;
+
+	for (size_t k = 0; k < results.size(); ++k) {
+		const Result &r = results[k];
+
+		cout << r.matrix << "\t" << r.kernel << "\tn=" << r.rows
+			 << "\tnnz=" << r.nnz << "\t" << r.median * 1e3 << " ms";
+
+		if (r.flops > 0) {
+			double gbs = r.bytes / r.median / 1e9;
+			cout << "\t" << r.flops / r.median / 1e9 << " GFLOP/s\t"
+				 << gbs << " GB/s\t" << 100 * gbs / (stream / 1e9)
+				 << "% STREAM";
+		}
+
+		if (r.iterations > 0 || r.residual > 0) {
+			cout << "\titer=" << r.iterations
+				 << "\tres=" << r.residual;
+		}
+
+		cout << endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts;
+	opts.rows = 1000000;
+	opts.matrix = "all";
+	opts.reps = 11;
+	opts.stream_size = 1 << 24;
+	opts.out = "bench.json";
+	opts.numa = false;
+
+	if (argc % 2 == 0) {
+		cerr << "Option without value: " << argv[argc - 1] << endl;
+		cerr << USAGE;
+		return 1;
+	}
+
+	for (int k = 1; k + 1 < argc; k += 2) {
+		string key = argv[k];
+		string val = argv[k + 1];
+
+		if (key == "--rows") {
+			opts.rows = atoi(val.c_str());
+		}
+		else if (key == "--matrix") {
+			opts.matrix = val;
+		}
+		else if (key == "--reps") {
+			opts.reps = max(1, atoi(val.c_str()));
+		}
+		else if (key == "--stream") {
+			opts.stream_size = atoi(val.c_str());
+		}
+		else if (key == "--out") {
+			opts.out = val;
+		}
+		else if (key == "--trace") {
+			opts.trace = val;
+		}
+		else if (key == "--numa") {
+			opts.numa = (atoi(val.c_str()) != 0);
+		}
+		else if (key == "--disk") {
+			opts.disk = val;
+		}
+		else {
+			cerr << "Unknown option: " << key << endl;
+			cerr << USAGE;
+			return 1;
+		}
+	}
+
+	try {
+		vector<string> names;
+
+		if (opts.matrix == "all") {
+			names.push_back("lap2d");
+			names.push_back("lap3d");
+			names.push_back("banded");
+			names.push_back("powerlaw");
+		}
+		else {
+			names.push_back(opts.matrix);
+		}
+
+		if (opts.numa && !numa_pin_threads()) {
+			cerr << "WARNING: could not pin threads" << endl;
+		}
+
+#ifdef SPARSE_PROFILE
+		Profiler::instance().enable_counters();
+#endif
+
+		if (!opts.trace.empty()) {
+			Tracer::instance().enable();
+		}
+
+		double stream = stream_triad(opts.stream_size, opts.reps);
+		vector<Result> results;
+
+		for (size_t k = 0; k < names.size(); ++k) {
+			run_matrix(names[k], opts, results);
+		}
+
+		print_table(results, stream);
+
+		if (!opts.trace.empty()) {
+			ofstream trace(opts.trace.c_str());
+			Tracer::instance().dump(trace);
+		}
+
+#ifdef SPARSE_PROFILE
+		cout << endl;
+		Profiler::instance().report(cout);
+#endif
+
+		ofstream file(opts.out.c_str());
+		write_json(file, results, opts, stream);
+		file.close();
+
+		return 0;
+	}
+	catch (exception &e) {
+		cerr << "ERROR: " << e.what() << endl;
+		return 1;
+	}
+}
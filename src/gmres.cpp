@@ -1,42 +1,230 @@
 #include "gmres.h"
 
-#include <iostream>
-using namespace std;
+template <typename SMTRX>
+GMRES<SMTRX>::GMRES(const SMTRX &A, const SVEC &b, int m,
+					double tol, int max_iter, SumMode mode)
+	: _A(A), _b(b), _n(b.size()), _m(m),
+	  _tol(tol), _max_iter(max_iter), _mode(mode), _M(0),
+	  _V(m + 1, SVEC(b.size())), _z(0), _basis(m + 1),
+	  _iterations(0), _residual(0)
+{
+	for (int i = 0; i < _m + 1; ++i) {
+		_basis[i] = &_V[i];
+	}
+
+	_dots = new double[_m + 2];
+
+	_H = new double*[_m + 1];
+	for (int i = 0; i < _m + 1; ++i) {
+		_H[i] = new double[_m];
+	}
 
-GMRES::GMRES()
+	_g = new double[_m + 1];
+	_cs = new double[_m];
+	_sn = new double[_m];
+}
+
+template <typename SMTRX>
+GMRES<SMTRX>::~GMRES()
 {
-	_r0 = _b - _A * _x0;
-	_beta = norm(_r0);
+	for (int i = 0; i < _m + 1; ++i) {
+		delete[] _H[i];
+	}
+	delete[] _H;
 
-	_H = new double*[m + 1];
-	for (int i = 0; i < m + 1; ++i) {
-		_H[i] = new double[m];
+	delete[] _dots;
+	delete[] _g;
+	delete[] _cs;
+	delete[] _sn;
+}
+
+template <typename SMTRX>
+void GMRES<SMTRX>::set_preconditioner(Preconditioner<double> *M)
+{
+	if (M && M->size() != _n) {
+		throw VecSizeMismatch();
 	}
 
-	_g = new double[m + 1];
+	_M = M;
+	_z = SVEC(M ? _n : 0);
 }
 
-void GMRES::run()
+template <typename SMTRX>
+SVEC GMRES<SMTRX>::run(const SVEC &x0)
 {
-	for (int i = 0; i < m + 1; ++i) {
-		for (int j = 0; j < m; ++j) {
-			_H[i][j] = 0;
-		}
+	SVEC x(x0);
+
+	double bnorm = nrm2(_b, _mode);
+	if (bnorm == 0) {
+		bnorm = 1;
 	}
 
-	g[0] = _beta;
+	_iterations = 0;
+
+	while (true) {
+		SPARSE_TRACE_SCOPE("GMRES::restart");
+
+		SVEC r(_n);
+		double beta;
+
+		{
+			SPARSE_PROFILE_SCOPE("GMRES::residual", 0);
+			r = _b - _A * x;
+			beta = nrm2(r, _mode);
+		}
+
+		_residual = beta / bnorm;
+
+		if (_residual <= _tol || _iterations >= _max_iter) {
+			break;
+		}
+
+		for (int i = 0; i < _m + 1; ++i) {
+			for (int j = 0; j < _m; ++j) {
+				_H[i][j] = 0;
+			}
+		}
+
+		_g[0] = beta;
+
+		for (int i = 1; i < _m + 1; ++i) {
+			_g[i] = 0;
+		}
+
+		_V[0] = r / beta;
+
+		// Arnoldi process
+		int k = 0;
+		SVEC w(_n);
+
+		while (k < _m && _iterations < _max_iter) {
+			SPARSE_TRACE_SCOPE("GMRES::arnoldi_step");
+
+			{
+				SPARSE_PROFILE_SCOPE("GMRES::spmv", 0);
+
+				if (_M) {
+					_M->apply(_V[k], _z);
+				}
+
+				spmv_dots(_A, _M ? _z : _V[k], w, &_basis[0], k + 1,
+						  _dots, _mode);
+			}
+
+			bool breakdown;
+
+			{
+				SPARSE_PROFILE_SCOPE("GMRES::orthogonalization",
+									 (k + 4LL) * _n * sizeof(double));
+
+				_H[k + 1][k] = orthogonalize(w, k, _dots[0]);
 
-	for (int i = 1; i < m + 1; ++i) {
-		_g[i] = 0;
+				breakdown = (_H[k + 1][k] == 0);
+
+				if (!breakdown) {
+					_V[k + 1] = w / _H[k + 1][k];
+				}
+			}
+
+			for (int i = 0; i < k; ++i) {
+				double tmp = _cs[i] * _H[i][k] + _sn[i] * _H[i + 1][k];
+				_H[i + 1][k] = -_sn[i] * _H[i][k] + _cs[i] * _H[i + 1][k];
+				_H[i][k] = tmp;
+			}
+
+			double denom = sqrt(_H[k][k] * _H[k][k] +
+								_H[k + 1][k] * _H[k + 1][k]);
+
+			_cs[k] = _H[k][k] / denom;
+			_sn[k] = _H[k + 1][k] / denom;
+			_H[k][k] = denom;
+			_H[k + 1][k] = 0;
+
+			_g[k + 1] = -_sn[k] * _g[k];
+			_g[k] = _cs[k] * _g[k];
+
+			++k;
+			++_iterations;
+
+			if (breakdown || fabs(_g[k]) / bnorm <= _tol) {
+				break;
+			}
+		}
+
+		SPARSE_PROFILE_SCOPE("GMRES::update", (k + 2LL) * _n * sizeof(double));
+
+		// Solve upper triangular system H * y = g
+		// (y is stored in g) and update solution
+		for (int i = k - 1; i >= 0; --i) {
+			for (int j = i + 1; j < k; ++j) {
+				_g[i] -= _H[i][j] * _g[j];
+			}
+			_g[i] /= _H[i][i];
+		}
+
+		if (!_M) {
+			multi_axpy(1.0, _g, &_basis[0], k, x);
+			continue;
+		}
+
+		// x += M^-1 (V y)
+		SVEC u(_n);
+		const SVEC *z = &_z;
+		double one = 1;
+
+		for (int i = 0; i < _n; ++i) {
+			u[i] = 0;
+		}
+
+		multi_axpy(1.0, _g, &_basis[0], k, u);
+		_M->apply(u, _z);
+		multi_axpy(1.0, &one, &z, 1, x);
 	}
+
+	return x;
 }
 
-double GMRES::norm(SVEC vec) const
+template <typename SMTRX>
+int GMRES<SMTRX>::iterations() const
 {
-	double sum = 0;
+	return _iterations;
+}
+
+template <typename SMTRX>
+double GMRES<SMTRX>::residual() const
+{
+	return _residual;
+}
 
-	for (int i = 0; i < vec.size(); ++i) {
-		sum += pow(vec.at(i), 2);
+template <typename SMTRX>
+double GMRES<SMTRX>::orthogonalize(SVEC &w, int k, double ww)
+{
+	double hh = 0;
+
+	for (int i = 0; i <= k; ++i) {
+		_H[i][k] = _dots[i + 1];
+		hh += _dots[i + 1] * _dots[i + 1];
 	}
-	return sqrt(sum);
-}
\ No newline at end of file
+
+	multi_axpy(-1.0, _dots + 1, &_basis[0], k + 1, w);
+
+	double rr = ww - hh;
+
+	if (rr <= 0.5 * ww) {
+		multi_dot(w, &_basis[0], k + 1, _dots, _mode);
+		multi_axpy(-1.0, _dots + 1, &_basis[0], k + 1, w);
+
+		for (int i = 0; i <= k; ++i) {
+			_H[i][k] += _dots[i + 1];
+		}
+
+		multi_dot(w, &_basis[0], 0, _dots, _mode);
+		rr = _dots[0];
+	}
+
+	return sqrt(rr > 0 ? rr : 0);
+}
+
+template class GMRES< CSR<double> >;
+template class GMRES< CSLR<double> >;
+template class GMRES< StreamCSR<double> >;
@@ -4,30 +4,123 @@
 #include <vector>
 #include <math.h>
 
+#include "sparse/vector.h"
 #include "sparse/csr.h"
 #include "sparse/cslr.h"
+#include "sparse/streamcsr.h"
+#include "sparse/fused.h"
+#include "sparse/reduce.h"
+#include "sparse/precond.h"
 
-#define SMTRX CSIR<double>
-#define SVEC std::vector<double>
+#define SVEC Vector<double>
 
+/**
+ * @brief GMRES(m) - restarted Generalized Minimal RESidual method
+ * @details Solves A * x = b. Krylov basis is orthogonalized with
+ * classical Gram-Schmidt: all the projections of A * v_k (and its
+ * norm) are computed in the same pass as the product itself (see
+ * spmv_dots()) and subtracted in one more pass. When the norm drops
+ * by more than 1/sqrt(2) the projection is repeated (DGKS
+ * criterion), which keeps the basis as orthogonal as modified
+ * Gram-Schmidt does. The least squares problem is solved
+ * with Givens rotations. All the reductions are reproducible
+ * (see reduce.h): the iterates do not depend on the number of
+ * threads. With a preconditioner M (see set_preconditioner())
+ * the system A M^-1 y = b is solved (right preconditioning, so
+ * the residual is still that of A * x = b) and x = M^-1 y.
+ * Explicitly instantiated for
+ * CSR<double>, CSLR<double> and StreamCSR<double> (matrix
+ * streamed from disk, only vectors resident) in gmres.cpp
+ * 
+ * @tparam SMTRX Type of sparse matrix
+ */
+template <typename SMTRX>
 class GMRES
 {
+	const SMTRX &_A;
+	SVEC _b;
+
 	int _n;
 	int _m;
-	SMTRX _A;
-	SVEC _b;
-	SVEC _x0;
-	SVEC _r0;
-	double _beta;
+	double _tol;
+	int _max_iter;
+	SumMode _mode;
+	Preconditioner<double> *_M;
+
+	std::vector<SVEC> _V;
+	SVEC _z;
+	std::vector<const SVEC*> _basis;
+	double *_dots;
 	double **_H;
 	double *_g;
+	double *_cs;
+	double *_sn;
+
+	int _iterations;
+	double _residual;
+
+	GMRES(const GMRES &);
+	GMRES& operator= (const GMRES &);
 
 public:
-	GMRES();
-	static void run();
+	/**
+	 * @brief Creates an instance of GMRES solver
+	 * 
+	 * @param A Matrix of the system (must outlive the solver)
+	 * @param b Right-hand side
+	 * @param m Number of iterations between restarts
+	 * @param tol Tolerance of relative residual norm
+	 * @param max_iter Maximal total number of iterations
+	 * @param mode Summation mode of dot products and norms
+	 */
+	GMRES(const SMTRX &A, const SVEC &b, int m = 30,
+		  double tol = 1e-8, int max_iter = 1000,
+		  SumMode mode = SUM_PAIRWISE);
+	~GMRES();
+
+	/**
+	 * @brief Sets the preconditioner, applied from the right
+	 *
+	 * @param M Preconditioner of the size of system (must outlive
+	 * the solver), 0 - none
+	 */
+	void set_preconditioner(Preconditioner<double> *M);
+
+	/**
+	 * @brief Solves the system
+	 * 
+	 * @param x0 Initial guess
+	 * @return Solution
+	 */
+	SVEC run(const SVEC &x0);
+
+	/**
+	 * @brief Gets the number of iterations made by last run()
+	 * @return Number of iterations
+	 */
+	int iterations() const;
+
+	/**
+	 * @brief Gets the relative residual norm reached by last run()
+	 * @return ||b - A * x|| / ||b||
+	 */
+	double residual() const;
 
 private:
-	double norm(SVEC vec) const;
+	/**
+	 * @brief Orthogonalizes w = A * v_k against v_0, ..., v_k
+	 * @details Expects the projections <w, v_i> in _dots[i + 1] (as
+	 * left by spmv_dots()). Fills column k of H and returns the norm
+	 * of orthogonalized w. The norm is found from ||w||^2 - ||h||^2;
+	 * if that drops below half of ||w||^2, the digits lost to
+	 * cancellation are recovered by one more projection.
+	 *
+	 * @param w Vector to orthogonalize
+	 * @param k Index of the last basis vector
+	 * @param ww <w, w> before orthogonalization
+	 * @return Norm of w after orthogonalization
+	 */
+	double orthogonalize(SVEC &w, int k, double ww);
 };
 
-#endif // GMRES_H
\ No newline at end of file
+#endif // GMRES_H
@@ -11,12 +11,13 @@
 
 #define VALUE_T double
 #define SMTRX CSLR<VALUE_T>
-#define SVEC std::vector<VALUE_T>
 
 using namespace std;
 
 SMTRX loadMtrx(const char* path)
 {
+	SPARSE_TRACE_SCOPE("load matrix");
+
 	ifstream file(path);
 
 	vector<int> jptr;
@@ -51,9 +52,11 @@ SMTRX loadMtrx(const char* path)
 	delete isstrm;
 
 	// allocate space
-	SMTRX A(&num_in_rows[0], &jptr[0], num_in_rows.size());
+	SMTRX A(num_in_rows.data(), jptr.data(), num_in_rows.size());
 
 	// insert values
+	SPARSE_TRACE_SCOPE("assembly");
+
 	VALUE_T val;
 	int i;
 	int j;
@@ -69,13 +72,19 @@ SMTRX loadMtrx(const char* path)
 	}
 
 	file.close();
+
+	// Most systems are symmetric: store their values once
+	if (A.is_symmetric()) {
+		A.make_symmetric();
+	}
+
 	return A;
 }
 
 SVEC loadVec(const char* path)
 {
 	ifstream file(path);
-	SVEC res;
+	vector<VALUE_T> res;
 	VALUE_T val;
 
 	while (file >> val) {
@@ -83,41 +92,45 @@ SVEC loadVec(const char* path)
 	}
 
 	file.close();
-	return res;
+	return SVEC(res.data(), res.size());
 }
 
 int main(int argc, char* argv[])
 {
-	try {
-		SMTRX A = loadMtrx("/home/olk/Desktop/A.txt");
-		SVEC x = loadVec("/home/olk/Desktop/x.txt");
+	if (argc < 3) {
+		cerr << "Usage: " << argv[0] << " <matrix file> <rhs file>"
+			 << " [trace file]" << endl;
+		return 1;
+	}
 
-		for (int i = 0; i < A.size_of_altr(); ++i) {
-			cout << A.altr()[i] << " ";
-		}
-		cout << endl;
+	if (argc > 3) {
+		Tracer::instance().enable();
+	}
 
-		for (int i = 0; i < A.size_of_altr(); ++i) {
-			cout << A.autr()[i] << " ";
-		}
-		cout << endl;
+	try {
+		SMTRX A = loadMtrx(argv[1]);
+		SVEC b = loadVec(argv[2]);
 
-		for (int i = 0; i < A.size(); ++i) {
-			cout << A.adiag()[i] << " ";
+		SVEC x0(b.size());
+		for (int i = 0; i < x0.size(); ++i) {
+			x0[i] = 0;
 		}
-		cout << endl;
+
+		GMRES<SMTRX> solver(A, b);
+		SVEC x = solver.run(x0);
 
 		for (int i = 0; i < x.size(); ++i) {
-			cout << x.at(i) << " ";
+			cout << x.get(i) << " ";
 		}
 		cout << endl;
 
-		SVEC b = GMRES::mult(A, x);
+		cerr << "iterations: " << solver.iterations()
+			 << ", residual: " << solver.residual() << endl;
 
-		for (int i = 0; i < b.size(); ++i) {
-			cout << b.at(i) << " ";
+		if (argc > 3) {
+			ofstream trace(argv[3]);
+			Tracer::instance().dump(trace);
 		}
-		cout << endl;
 
 		return 0;
 	}
@@ -125,4 +138,4 @@ int main(int argc, char* argv[])
 		cerr << "ERROR: " << e.what() << endl;
 		return 1;
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,226 @@
+#ifndef MATGEN_H
+#define MATGEN_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#include "sparse/csr.h"
+
+/**
+ * Generators of synthetic test matrices.
+ *
+ * All the generated matrices are square, have symmetric portraits
+ * (so they can be converted to CSLR), nonempty diagonals, sorted
+ * column-indices and are diagonally dominant (so GMRES converges
+ * on them).
+ */
+
+/**
+ * @brief Helper that assembles CSR matrix row by row
+ * @details Elements of each row must be appended in increasing
+ * order of column-indices
+ */
+template <typename T>
+class CSRBuilder
+{
+	std::vector<T> _aelem;
+	std::vector<int> _iptr;
+	std::vector<int> _jptr;
+
+public:
+	CSRBuilder()
+	{
+		_iptr.push_back(0);
+	}
+
+	/**
+	 * @brief Appends an element to current row
+	 *
+	 * @param j Column-index
+	 * @param val Value
+	 */
+	void append(int j, T val)
+	{
+		_jptr.push_back(j);
+		_aelem.push_back(val);
+	}
+
+	/**
+	 * @brief Finishes current row and starts the next one
+	 */
+	void end_row()
+	{
+		_iptr.push_back(_jptr.size());
+	}
+
+	/**
+	 * @brief Creates CSR matrix from appended rows
+	 *
+	 * @param cols Number of columns
+	 * @return Assembled matrix
+	 */
+	CSR<T> build(int cols)
+	{
+		int rows = _iptr.size() - 1;
+		return CSR<T>(_aelem.empty() ? 0 : &_aelem[0], &_iptr[0],
+					  _jptr.empty() ? 0 : &_jptr[0],
+					  rows, cols, _aelem.size());
+	}
+};
+
+/**
+ * @brief Generates 5-point Laplacian on n x n grid
+ *
+ * @param n Number of grid points in each direction
+ * @return Matrix of size n^2
+ */
+template <typename T>
+CSR<T> laplacian_2d(int n)
+{
+	CSRBuilder<T> builder;
+
+	for (int y = 0; y < n; ++y) {
+		for (int x = 0; x < n; ++x) {
+			int i = y * n + x;
+
+			if (y > 0) builder.append(i - n, -1);
+			if (x > 0) builder.append(i - 1, -1);
+			builder.append(i, 4);
+			if (x < n - 1) builder.append(i + 1, -1);
+			if (y < n - 1) builder.append(i + n, -1);
+
+			builder.end_row();
+		}
+	}
+
+	return builder.build(n * n);
+}
+
+/**
+ * @brief Generates 7-point Laplacian on n x n x n grid
+ *
+ * @param n Number of grid points in each direction
+ * @return Matrix of size n^3
+ */
+template <typename T>
+CSR<T> laplacian_3d(int n)
+{
+	CSRBuilder<T> builder;
+	int nn = n * n;
+
+	for (int z = 0; z < n; ++z) {
+		for (int y = 0; y < n; ++y) {
+			for (int x = 0; x < n; ++x) {
+				int i = z * nn + y * n + x;
+
+				if (z > 0) builder.append(i - nn, -1);
+				if (y > 0) builder.append(i - n, -1);
+				if (x > 0) builder.append(i - 1, -1);
+				builder.append(i, 6);
+				if (x < n - 1) builder.append(i + 1, -1);
+				if (y < n - 1) builder.append(i + n, -1);
+				if (z < n - 1) builder.append(i + nn, -1);
+
+				builder.end_row();
+			}
+		}
+	}
+
+	return builder.build(n * nn);
+}
+
+/**
+ * @brief Generates banded matrix
+ *
+ * @param n Size of matrix
+ * @param width Number of nonempty diagonals on each side
+ * of the main one
+ * @return Matrix of size n
+ */
+template <typename T>
+CSR<T> banded(int n, int width)
+{
+	CSRBuilder<T> builder;
+
+	for (int i = 0; i < n; ++i) {
+		int from = std::max(0, i - width);
+		int to = std::min(n - 1, i + width);
+
+		for (int j = from; j <= to; ++j) {
+			builder.append(j, (i == j) ? 2 * width + 1 : -1);
+		}
+
+		builder.end_row();
+	}
+
+	return builder.build(n);
+}
+
+/**
+ * @brief Generates random matrix with power-law distribution
+ * of row lengths
+ * @details Row lengths follow Pareto distribution with given
+ * exponent, column-indices and signs of values are uniform.
+ * The portrait is then symmetrized (A + A^T) and the diagonal
+ * is made strictly dominant.
+ *
+ * @param n Size of matrix
+ * @param min_degree Minimal number of elements in row
+ * @param alpha Exponent of distribution (> 1, smaller is more skewed)
+ * @param seed Seed of random generator
+ * @return Matrix of size n
+ */
+template <typename T>
+CSR<T> power_law(int n, int min_degree, double alpha, unsigned seed = 1)
+{
+	srand(seed);
+
+	CSRBuilder<T> builder;
+	std::vector<int> cols;
+
+	for (int i = 0; i < n; ++i) {
+		double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+		double degree = min_degree * pow(u, -1.0 / (alpha - 1));
+		int len = (int)std::min(degree, (double)n / 2);
+
+		cols.clear();
+		for (int k = 0; k < len; ++k) {
+			int j = (int)(((double)rand() / ((double)RAND_MAX + 1)) * n);
+			if (j != i) {
+				cols.push_back(j);
+			}
+		}
+
+		std::sort(cols.begin(), cols.end());
+		cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+
+		for (size_t k = 0; k < cols.size(); ++k) {
+			T val = (T)(rand() % 100 + 1) / 100;
+			builder.append(cols[k], (rand() % 2) ? val : -val);
+		}
+
+		builder.end_row();
+	}
+
+	CSR<T> offdiag = builder.build(n);
+	CSR<T> sym = add(offdiag, offdiag.transpose(), (T)1, (T)1);
+
+	CSRBuilder<T> diag;
+
+	for (int i = 0; i < n; ++i) {
+		T sum = 0;
+
+		for (int k = sym.iptr()[i]; k < sym.iptr()[i + 1]; ++k) {
+			sum += fabs(sym.aelem()[k]);
+		}
+
+		diag.append(i, 2 * sum + 1);
+		diag.end_row();
+	}
+
+	return add(sym, diag.build(n), (T)1, (T)1);
+}
+
+#endif // MATGEN_H
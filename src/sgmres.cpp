@@ -0,0 +1,603 @@
+#include "sgmres.h"
+
+template <typename SMTRX>
+SStepGMRES<SMTRX>::SStepGMRES(const SMTRX &A, const SVEC &b, int m,
+							  double tol, int max_iter, int s,
+							  SStepBasis basis, SumMode mode)
+	: _A(A), _b(b), _n(b.size()), _m(m),
+	  _tol(tol), _max_iter(max_iter), _s(std::max(1, std::min(s, m))),
+	  _type(basis), _mode(mode), _M(0), _bounds(false), _lo(0), _hi(0),
+	  _V(m + 1, SVEC(b.size())), _basis(m + 1), _out(m + 1), _z(0),
+	  _iterations(0), _reductions(0), _residual(0)
+{
+	for (int i = 0; i < _m + 1; ++i) {
+		_basis[i] = &_V[i];
+		_out[i] = &_V[i];
+	}
+
+	_mpk = powers_kernel(A, _s);
+
+	_alpha = new double[_s];
+	_beta = new double[_s];
+	_gamma = new double[_s];
+
+	_dots = new double[(_m + 1) * _s + _s * (_s + 1) / 2];
+	_C = new double[(_m + 1) * _s];
+	_C2 = new double[(_m + 1) * _s];
+	_R = new double[_s * _s];
+	_R2 = new double[_s * _s];
+
+	_H = new double*[_m + 1];
+	_HR = new double*[_m + 1];
+	for (int i = 0; i < _m + 1; ++i) {
+		_H[i] = new double[_m];
+		_HR[i] = new double[_m];
+	}
+
+	_g = new double[_m + 1];
+	_cs = new double[_m];
+	_sn = new double[_m];
+}
+
+template <typename SMTRX>
+SStepGMRES<SMTRX>::~SStepGMRES()
+{
+	for (int i = 0; i < _m + 1; ++i) {
+		delete[] _H[i];
+		delete[] _HR[i];
+	}
+	delete[] _H;
+	delete[] _HR;
+
+	delete _mpk;
+
+	delete[] _alpha;
+	delete[] _beta;
+	delete[] _gamma;
+	delete[] _dots;
+	delete[] _C;
+	delete[] _C2;
+	delete[] _R;
+	delete[] _R2;
+	delete[] _g;
+	delete[] _cs;
+	delete[] _sn;
+}
+
+template <typename SMTRX>
+void SStepGMRES<SMTRX>::set_spectrum(double lo, double hi)
+{
+	_lo = std::min(lo, hi);
+	_hi = std::max(lo, hi);
+	_bounds = true;
+}
+
+template <typename SMTRX>
+void SStepGMRES<SMTRX>::set_preconditioner(Preconditioner<double> *M)
+{
+	if (M && M->size() != _n) {
+		throw VecSizeMismatch();
+	}
+
+	_M = M;
+	_z = SVEC(M ? _n : 0);
+}
+
+template <typename SMTRX>
+SVEC SStepGMRES<SMTRX>::run(const SVEC &x0)
+{
+	SVEC x(x0);
+
+	_iterations = 0;
+	_reductions = 1;
+
+	double bnorm = nrm2(_b, _mode);
+	if (bnorm == 0) {
+		bnorm = 1;
+	}
+
+	while (true) {
+		SPARSE_TRACE_SCOPE("SStepGMRES::restart");
+
+		SVEC r(_n);
+		double beta;
+
+		{
+			SPARSE_PROFILE_SCOPE("SStepGMRES::residual", 0);
+			r = _b - _A * x;
+			beta = nrm2(r, _mode);
+			++_reductions;
+		}
+
+		_residual = beta / bnorm;
+
+		if (_residual <= _tol || _iterations >= _max_iter) {
+			break;
+		}
+
+		for (int i = 0; i < _m + 1; ++i) {
+			for (int j = 0; j < _m; ++j) {
+				_H[i][j] = 0;
+				_HR[i][j] = 0;
+			}
+		}
+
+		_g[0] = beta;
+
+		for (int i = 1; i < _m + 1; ++i) {
+			_g[i] = 0;
+		}
+
+		_V[0] = r / beta;
+
+		// Without the interval of spectrum the first cycle
+		// is plain GMRES (in monomial basis of one vector)
+		bool estimating = !_bounds && _type != SSTEP_MONOMIAL;
+		int s = estimating ? 1 : _s;
+
+		coefficients();
+
+		int k = 0;
+		bool done = false;
+
+		while (!done && k < _m && _iterations < _max_iter) {
+			SPARSE_TRACE_SCOPE("SStepGMRES::block");
+
+			int sb = std::min(s, std::min(_m - k, _max_iter - _iterations));
+			int kept;
+
+			{
+				SPARSE_PROFILE_SCOPE("SStepGMRES::powers", 0);
+				powers(k, sb);
+			}
+
+			{
+				SPARSE_PROFILE_SCOPE("SStepGMRES::orthogonalization",
+									 (k + 2LL * sb + 2) * sb * _n * sizeof(double));
+				kept = orthogonalize(k, sb);
+			}
+
+			// On breakdown A * v_k lies in the basis: its column
+			// is still known (with zero under the diagonal)
+			int ncols = (kept > 0) ? kept : 1;
+			int i = 0;
+
+			while (i < ncols && !done) {
+				int j = k + i;
+
+				hessenberg(k, i);
+
+				for (int p = 0; p <= j + 1; ++p) {
+					_HR[p][j] = _H[p][j];
+				}
+
+				for (int p = 0; p < j; ++p) {
+					double tmp = _cs[p] * _HR[p][j] + _sn[p] * _HR[p + 1][j];
+					_HR[p + 1][j] = -_sn[p] * _HR[p][j] + _cs[p] * _HR[p + 1][j];
+					_HR[p][j] = tmp;
+				}
+
+				double denom = sqrt(_HR[j][j] * _HR[j][j] +
+									_HR[j + 1][j] * _HR[j + 1][j]);
+
+				_cs[j] = _HR[j][j] / denom;
+				_sn[j] = _HR[j + 1][j] / denom;
+				_HR[j][j] = denom;
+				_HR[j + 1][j] = 0;
+
+				_g[j + 1] = -_sn[j] * _g[j];
+				_g[j] = _cs[j] * _g[j];
+
+				++i;
+				++_iterations;
+
+				done = (fabs(_g[j + 1]) / bnorm <= _tol);
+			}
+
+			k += i;
+			done = done || (kept == 0);
+		}
+
+		if (estimating) {
+			estimate(k);
+		}
+
+		SPARSE_PROFILE_SCOPE("SStepGMRES::update", (k + 2LL) * _n * sizeof(double));
+
+		// Solve upper triangular system H * y = g
+		// (y is stored in g) and update solution
+		for (int i = k - 1; i >= 0; --i) {
+			for (int j = i + 1; j < k; ++j) {
+				_g[i] -= _HR[i][j] * _g[j];
+			}
+			_g[i] /= _HR[i][i];
+		}
+
+		if (!_M) {
+			multi_axpy(1.0, _g, &_basis[0], k, x);
+			continue;
+		}
+
+		// x += M^-1 (V y)
+		SVEC u(_n);
+		const SVEC *z = &_z;
+		double one = 1;
+
+		for (int i = 0; i < _n; ++i) {
+			u[i] = 0;
+		}
+
+		multi_axpy(1.0, _g, &_basis[0], k, u);
+		_M->apply(u, _z);
+		multi_axpy(1.0, &one, &z, 1, x);
+	}
+
+	return x;
+}
+
+template <typename SMTRX>
+int SStepGMRES<SMTRX>::iterations() const
+{
+	return _iterations;
+}
+
+template <typename SMTRX>
+double SStepGMRES<SMTRX>::residual() const
+{
+	return _residual;
+}
+
+template <typename SMTRX>
+int SStepGMRES<SMTRX>::reductions() const
+{
+	return _reductions;
+}
+
+template <typename SMTRX>
+void SStepGMRES<SMTRX>::coefficients()
+{
+	double c = (_lo + _hi) / 2;
+	double d = (_hi - _lo) / 2;
+
+	if (d <= 0) {
+		d = (c != 0) ? fabs(c) : 1;
+	}
+
+	for (int i = 0; i < _s; ++i) {
+		_alpha[i] = 0;
+		_beta[i] = 0;
+		_gamma[i] = 1;
+	}
+
+	if (!_bounds) {
+		return;
+	}
+
+	if (_type == SSTEP_MONOMIAL) {
+		double rho = std::max(fabs(_lo), fabs(_hi));
+
+		for (int i = 0; i < _s; ++i) {
+			_gamma[i] = (rho > 0) ? rho : 1;
+		}
+	} else if (_type == SSTEP_CHEBYSHEV) {
+		// T_i+1(z) = 2 z T_i(z) - T_i-1(z) with z = (A - c) / d
+		for (int i = 0; i < _s; ++i) {
+			_alpha[i] = c;
+			_beta[i] = (i > 0) ? d / 2 : 0;
+			_gamma[i] = (i > 0) ? d / 2 : d;
+		}
+	} else {
+		// Chebyshev points of the interval in Leja order: every
+		// next shift is the farthest from the ones before
+		std::vector<double> pts(_s);
+		std::vector<bool> used(_s, false);
+
+		for (int i = 0; i < _s; ++i) {
+			pts[i] = c + d * cos(M_PI * (2 * i + 1) / (2 * _s));
+		}
+
+		for (int i = 0; i < _s; ++i) {
+			int best = -1;
+			double best_dist = -1;
+
+			for (int j = 0; j < _s; ++j) {
+				if (used[j]) {
+					continue;
+				}
+
+				double dist = fabs(pts[j]);
+
+				if (i > 0) {
+					dist = 1;
+
+					for (int l = 0; l < i; ++l) {
+						dist *= fabs(pts[j] - _alpha[l]) / d;
+					}
+				}
+
+				if (dist > best_dist) {
+					best = j;
+					best_dist = dist;
+				}
+			}
+
+			used[best] = true;
+			_alpha[i] = pts[best];
+			_gamma[i] = d;
+		}
+	}
+}
+
+template <typename SMTRX>
+void SStepGMRES<SMTRX>::powers(int k, int s)
+{
+	if (_mpk && !_M) {
+		_mpk->run(_V[k], &_out[k + 1], s, _alpha, _beta, _gamma);
+		return;
+	}
+
+	for (int i = 0; i < s; ++i) {
+		SVEC &y = _V[k + i + 1];
+		const SVEC *v[2] = {&_V[k + i], (i > 0) ? &_V[k + i - 1] : 0};
+		double coef[2] = {_alpha[i], _beta[i]};
+
+		if (_M) {
+			_M->apply(_V[k + i], _z);
+		}
+
+		_A.multiply(_M ? _z : _V[k + i], y);
+
+		multi_axpy(-1.0, coef, v, (i > 0) ? 2 : 1, y, 1 / _gamma[i]);
+	}
+}
+
+template <typename SMTRX>
+int SStepGMRES<SMTRX>::cholqr(int k, int s, double *C, double *R,
+							  double &ratio)
+{
+	int nq = k + 1;
+	int ld = _m + 1;
+	const double *gram = _dots + nq * s;
+
+	block_dot(&_basis[0], nq, &_basis[k + 1], s, _dots, _mode);
+	++_reductions;
+
+	for (int j = 0; j < s; ++j) {
+		for (int i = 0; i < nq; ++i) {
+			C[j * ld + i] = _dots[i * s + j];
+		}
+
+		multi_axpy(-1.0, C + j * ld, &_basis[0], nq, _V[k + 1 + j]);
+	}
+
+	// Cholesky factor of Gram matrix of projected block,
+	// G - C^T * C, column by column
+	int kept = s;
+	ratio = 1;
+
+	for (int j = 0; j < s && kept == s; ++j) {
+		for (int i = 0; i <= j; ++i) {
+			double a = gram[i * s - i * (i - 1) / 2 + (j - i)];
+
+			for (int l = 0; l < nq; ++l) {
+				a -= C[i * ld + l] * C[j * ld + l];
+			}
+
+			for (int l = 0; l < i; ++l) {
+				a -= R[i * _s + l] * R[j * _s + l];
+			}
+
+			if (i < j) {
+				R[j * _s + i] = a / R[i * _s + i];
+				continue;
+			}
+
+			double ww = gram[j * s - j * (j - 1) / 2];
+
+			if (!(a > SSTEP_DROP_TOL * ww)) {
+				kept = j;
+				break;
+			}
+
+			R[j * _s + j] = sqrt(a);
+			ratio = std::min(ratio, a / ww);
+		}
+	}
+
+	for (int j = 0; j < kept; ++j) {
+		multi_axpy(-1.0, R + j * _s, &_basis[k + 1], j, _V[k + 1 + j],
+				   1 / R[j * _s + j]);
+	}
+
+	return kept;
+}
+
+template <typename SMTRX>
+int SStepGMRES<SMTRX>::orthogonalize(int k, int s)
+{
+	int ld = _m + 1;
+	double ratio;
+
+	int kept = cholqr(k, s, _C, _R, ratio);
+
+	if (kept == 0) {
+		_R[0] = 0;
+		return 0;
+	}
+
+	if (ratio >= SSTEP_REORTH_TOL) {
+		return kept;
+	}
+
+	// Digits were lost to cancellation: orthogonalize the new
+	// vectors once more and merge both steps,
+	// C = C + C2 * R, R = R2 * R
+	int kept2 = cholqr(k, kept, _C2, _R2, ratio);
+	int ncols = (kept2 > 0) ? kept2 : 1;
+
+	if (kept2 == 0) {
+		_R2[0] = 0;
+	}
+
+	for (int j = 0; j < ncols; ++j) {
+		for (int i = 0; i <= j; ++i) {
+			double rij = _R[j * _s + i];
+
+			for (int l = 0; l <= k; ++l) {
+				_C[j * ld + l] += _C2[i * ld + l] * rij;
+			}
+		}
+
+		for (int i = 0; i <= j; ++i) {
+			double sum = 0;
+
+			for (int p = i; p <= j; ++p) {
+				sum += _R2[p * _s + i] * _R[j * _s + p];
+			}
+
+			_R[j * _s + i] = sum;
+		}
+	}
+
+	return kept2;
+}
+
+template <typename SMTRX>
+void SStepGMRES<SMTRX>::hessenberg(int k, int i)
+{
+	int ld = _m + 1;
+	int col = k + i;
+
+	// Coordinates of v_j (v_0 = q_k) in orthonormal basis:
+	// C for q_0, ..., q_k and R for the new vectors
+	struct Coord
+	{
+		const double *C;
+		const double *R;
+		int ld;
+		int s;
+		int k;
+
+		double operator() (int j, int p) const
+		{
+			if (j == 0) {
+				return (p == k) ? 1 : 0;
+			}
+
+			if (p <= k) {
+				return C[(j - 1) * ld + p];
+			}
+
+			return (p <= k + j) ? R[(j - 1) * s + (p - k - 1)] : 0;
+		}
+	} coord = {_C, _R, ld, _s, k};
+
+	// A * v_i = beta_i v_i-1 + alpha_i v_i + gamma_i v_i+1
+	for (int p = 0; p <= col + 1; ++p) {
+		double a = _alpha[i] * coord(i, p) + _gamma[i] * coord(i + 1, p);
+
+		if (i > 0) {
+			a += _beta[i] * coord(i - 1, p);
+		}
+
+		_H[p][col] = a;
+	}
+
+	if (i == 0) {
+		return;
+	}
+
+	// v_i = sum(coord(i, q) q_q), so A * q_col is A * v_i less
+	// the known columns, divided by the diagonal of coordinates
+	for (int q = 0; q < col; ++q) {
+		double f = coord(i, q);
+
+		if (f != 0) {
+			for (int p = 0; p <= q + 1; ++p) {
+				_H[p][col] -= f * _H[p][q];
+			}
+		}
+	}
+
+	double d = coord(i, col);
+
+	for (int p = 0; p <= col + 1; ++p) {
+		_H[p][col] /= d;
+	}
+}
+
+template <typename SMTRX>
+void SStepGMRES<SMTRX>::estimate(int k)
+{
+	if (k == 0) {
+		return;
+	}
+
+	std::vector<double> S(k * k);
+	double norm = 0;
+
+	for (int i = 0; i < k; ++i) {
+		for (int j = 0; j < k; ++j) {
+			S[i * k + j] = (_H[i][j] + _H[j][i]) / 2;
+			norm += S[i * k + j] * S[i * k + j];
+		}
+	}
+
+	// Cyclic Jacobi rotations until the off-diagonal part vanishes
+	for (int sweep = 0; sweep < 50; ++sweep) {
+		double off = 0;
+
+		for (int p = 0; p < k; ++p) {
+			for (int q = p + 1; q < k; ++q) {
+				off += S[p * k + q] * S[p * k + q];
+			}
+		}
+
+		if (off <= 1e-24 * norm) {
+			break;
+		}
+
+		for (int p = 0; p < k; ++p) {
+			for (int q = p + 1; q < k; ++q) {
+				double apq = S[p * k + q];
+
+				if (apq == 0) {
+					continue;
+				}
+
+				double theta = (S[q * k + q] - S[p * k + p]) / (2 * apq);
+				double t = (theta >= 0 ? 1 : -1) /
+						   (fabs(theta) + sqrt(theta * theta + 1));
+				double c = 1 / sqrt(t * t + 1);
+				double sn = t * c;
+
+				for (int r = 0; r < k; ++r) {
+					double srp = S[r * k + p];
+					double srq = S[r * k + q];
+					S[r * k + p] = c * srp - sn * srq;
+					S[r * k + q] = sn * srp + c * srq;
+				}
+
+				for (int r = 0; r < k; ++r) {
+					double spr = S[p * k + r];
+					double sqr = S[q * k + r];
+					S[p * k + r] = c * spr - sn * sqr;
+					S[q * k + r] = sn * spr + c * sqr;
+				}
+			}
+		}
+	}
+
+	_lo = _hi = S[0];
+
+	for (int i = 1; i < k; ++i) {
+		_lo = std::min(_lo, S[i * k + i]);
+		_hi = std::max(_hi, S[i * k + i]);
+	}
+
+	_bounds = true;
+}
+
+template class SStepGMRES< CSR<double> >;
+template class SStepGMRES< CSLR<double> >;
+template class SStepGMRES< StreamCSR<double> >;
@@ -0,0 +1,263 @@
+#ifndef SGMRES_H
+#define SGMRES_H
+
+#include <vector>
+#include <math.h>
+
+#include "sparse/vector.h"
+#include "sparse/csr.h"
+#include "sparse/cslr.h"
+#include "sparse/streamcsr.h"
+#include "sparse/fused.h"
+#include "sparse/powers.h"
+#include "sparse/reduce.h"
+#include "sparse/precond.h"
+
+#define SVEC Vector<double>
+
+/**
+ * @brief Polynomial bases of s-step GMRES
+ * - SSTEP_MONOMIAL - v, A v, A^2 v, ... (scaled by spectral radius
+ *   when it is known)
+ * - SSTEP_NEWTON - products of (A - theta_i) / d with shifts theta_i
+ *   at Chebyshev points of the spectrum in Leja order
+ * - SSTEP_CHEBYSHEV - scaled and shifted Chebyshev polynomials of
+ *   the spectrum
+ */
+enum SStepBasis
+{
+	SSTEP_MONOMIAL,
+	SSTEP_NEWTON,
+	SSTEP_CHEBYSHEV
+};
+
+/**
+ * @brief Pivot of CholQR (relative to the squared norm of vector)
+ * below which the vector is taken as dependent: the block is cut
+ * before it
+ */
+const double SSTEP_DROP_TOL = 1e-12;
+
+/**
+ * @brief Pivot of CholQR (relative to the squared norm of vector)
+ * below which the block is orthogonalized once more (the DGKS
+ * criterion of GMRES: half of the norm squared was cancelled)
+ */
+const double SSTEP_REORTH_TOL = 0.5;
+
+/**
+ * @brief s-step (communication-avoiding) GMRES(m)
+ * @details Solves A * x = b as GMRES does, but builds the Krylov
+ * basis s vectors at a time: s products with a polynomial basis
+ * (see SStepBasis) are made without any reduction in between (by
+ * the matrix powers kernel for CSR, see MatrixPowers), and
+ * the block is orthogonalized against the basis and within itself
+ * by block classical Gram-Schmidt with CholQR, whose projections
+ * and Gram matrix come from one reduction (see block_dot()). The
+ * Hessenberg matrix is recovered from the change of basis, so the
+ * number of global reductions drops from one per iteration to one
+ * per s iterations (a second one when projection cancels half of
+ * the squared norm of a vector, see SSTEP_REORTH_TOL). Vectors
+ * the block basis can not resolve are dropped and the next block
+ * starts from the last good one (see SSTEP_DROP_TOL).
+ *
+ * Newton and Chebyshev bases need the real interval of the
+ * spectrum: unless set by set_spectrum(), the first cycle is made
+ * with s = 1 and the interval is taken from the symmetric part of
+ * its Hessenberg matrix (i.e. the field of values of Ritz
+ * matrix). With a preconditioner M (see set_preconditioner()) the
+ * basis is that of A M^-1 (products are plain then, and the
+ * interval is that of the spectrum of A M^-1), and x = M^-1 y as
+ * in GMRES. Explicitly instantiated for CSR<double>, CSLR<double>
+ * and StreamCSR<double> in sgmres.cpp
+ *
+ * @tparam SMTRX Type of sparse matrix
+ */
+template <typename SMTRX>
+class SStepGMRES
+{
+	const SMTRX &_A;
+	SVEC _b;
+
+	int _n;
+	int _m;
+	double _tol;
+	int _max_iter;
+	int _s;
+	SStepBasis _type;
+	SumMode _mode;
+	Preconditioner<double> *_M;
+
+	bool _bounds;
+	double _lo;
+	double _hi;
+
+	std::vector<SVEC> _V;
+	std::vector<const SVEC*> _basis;
+	std::vector<SVEC*> _out;
+	SVEC _z;
+	MatrixPowers<double> *_mpk;
+	double *_alpha;
+	double *_beta;
+	double *_gamma;
+	double *_dots;
+	double *_C;
+	double *_C2;
+	double *_R;
+	double *_R2;
+	double **_H;
+	double **_HR;
+	double *_g;
+	double *_cs;
+	double *_sn;
+
+	int _iterations;
+	int _reductions;
+	double _residual;
+
+	SStepGMRES(const SStepGMRES &);
+	SStepGMRES& operator= (const SStepGMRES &);
+
+	/**
+	 * @brief Creates the matrix powers kernel for CSR matrix
+	 */
+	static MatrixPowers<double>* powers_kernel(const CSR<double> &A, int s)
+	{
+		return new MatrixPowers<double>(A, s);
+	}
+
+	/**
+	 * @brief Other matrices make s plain products
+	 */
+	template <typename M>
+	static MatrixPowers<double>* powers_kernel(const M &, int)
+	{
+		return 0;
+	}
+
+public:
+	/**
+	 * @brief Creates an instance of s-step GMRES solver
+	 *
+	 * @param A Matrix of the system (must outlive the solver)
+	 * @param b Right-hand side
+	 * @param m Number of iterations between restarts
+	 * @param tol Tolerance of relative residual norm
+	 * @param max_iter Maximal total number of iterations
+	 * @param s Number of basis vectors per block
+	 * @param basis Polynomial basis
+	 * @param mode Summation mode of dot products and norms
+	 */
+	SStepGMRES(const SMTRX &A, const SVEC &b, int m = 30,
+			   double tol = 1e-8, int max_iter = 1000, int s = 5,
+			   SStepBasis basis = SSTEP_NEWTON,
+			   SumMode mode = SUM_PAIRWISE);
+	~SStepGMRES();
+
+	/**
+	 * @brief Sets the interval holding the real parts of
+	 * eigenvalues of matrix (for Newton and Chebyshev bases)
+	 *
+	 * @param lo Lower bound
+	 * @param hi Upper bound
+	 */
+	void set_spectrum(double lo, double hi);
+
+	/**
+	 * @brief Sets the preconditioner, applied from the right
+	 *
+	 * @param M Preconditioner of the size of system (must outlive
+	 * the solver), 0 - none
+	 */
+	void set_preconditioner(Preconditioner<double> *M);
+
+	/**
+	 * @brief Solves the system
+	 *
+	 * @param x0 Initial guess
+	 * @return Solution
+	 */
+	SVEC run(const SVEC &x0);
+
+	/**
+	 * @brief Gets the number of iterations made by last run()
+	 * @return Number of iterations
+	 */
+	int iterations() const;
+
+	/**
+	 * @brief Gets the relative residual norm reached by last run()
+	 * @return ||b - A * x|| / ||b||
+	 */
+	double residual() const;
+
+	/**
+	 * @brief Gets the number of global reductions (points of
+	 * synchronization) made by last run()
+	 * @return Number of reductions
+	 */
+	int reductions() const;
+
+private:
+	/**
+	 * @brief Computes the coefficients of basis recurrence
+	 * A v_i = gamma_i v_i+1 + alpha_i v_i + beta_i v_i-1 from the
+	 * interval of spectrum
+	 */
+	void coefficients();
+
+	/**
+	 * @brief Computes v_k+1, ..., v_k+s from v_k by the recurrence
+	 *
+	 * @param k Index of the last orthonormal vector
+	 * @param s Number of vectors
+	 */
+	void powers(int k, int s);
+
+	/**
+	 * @brief Orthogonalizes v_k+1, ..., v_k+s against v_0, ..., v_k
+	 * and within the block
+	 * @details Leaves the projections in _C and the triangular
+	 * factor in _R, so that the old v_k+j+1 equals
+	 * sum(C[j][i] v_i) + sum(R[j][i] v_k+1+i).
+	 *
+	 * @param k Index of the last orthonormal vector
+	 * @param s Number of vectors
+	 * @return Number of vectors kept (0 on breakdown)
+	 */
+	int orthogonalize(int k, int s);
+
+	/**
+	 * @brief Makes CholQR step: w = (w - Q C) R^-1 with C and the
+	 * Gram matrix from one block_dot()
+	 *
+	 * @param k Index of the last orthonormal vector
+	 * @param s Number of vectors
+	 * @param C Projections (column j at C + j * (m + 1))
+	 * @param R Triangular factor (column j at R + j * s)
+	 * @param ratio Smallest squared pivot relative to the squared
+	 * norm of its vector
+	 * @return Number of vectors kept (the rest are dependent)
+	 */
+	int cholqr(int k, int s, double *C, double *R, double &ratio);
+
+	/**
+	 * @brief Builds column k + i of Hessenberg matrix from the
+	 * change of basis of the block started at k
+	 *
+	 * @param k Index of the first column of block
+	 * @param i Column in block
+	 */
+	void hessenberg(int k, int i);
+
+	/**
+	 * @brief Estimates the interval of spectrum by the extreme
+	 * eigenvalues of symmetric part of leading k x k Hessenberg
+	 * matrix (Jacobi method)
+	 *
+	 * @param k Size of Hessenberg matrix
+	 */
+	void estimate(int k);
+};
+
+#endif // SGMRES_H
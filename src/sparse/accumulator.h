@@ -0,0 +1,240 @@
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include <algorithm>
+
+/**
+ * @brief Sparse accumulator of a single row.
+ * @details Collects (column, value) contributions of one row of
+ * a sparse product and sums up the ones with equal column-indices.
+ * Depending on the expected number of contributions it works
+ * either with a dense array of the size of the row (for dense
+ * rows) or with an open-addressing hash table (for sparse rows).
+ *
+ * The accumulator is meant to be owned by a single thread and
+ * reused for all the rows that thread processes, so that no
+ * memory is allocated per row.
+ *
+ * @tparam T Type of accumulated values
+ */
+template <typename T>
+class RowAccumulator
+{
+	int _width;
+
+	// Dense mode
+	int *_mark;
+	T *_dense;
+	int _stamp;
+
+	// Hash mode
+	int *_keys;
+	T *_hvals;
+	int _capacity;
+	int _hmask;
+
+	int *_found;
+	int _num_found;
+	int _found_capacity;
+
+	bool _use_dense;
+
+	/**
+	 * @brief Finds the slot of column-index in hash table
+	 * @details Inserts the key if it is not there yet
+	 *
+	 * @param col Column-index
+	 * @return Position in _keys and _hvals
+	 */
+	int slot(int col)
+	{
+		int h = (int)(((unsigned)col * 2654435761u) & (unsigned)_hmask);
+
+		while (_keys[h] != col) {
+			if (_keys[h] == -1) {
+				_keys[h] = col;
+				_hvals[h] = 0;
+				push(col);
+				break;
+			}
+			h = (h + 1) & _hmask;
+		}
+
+		return h;
+	}
+
+	/**
+	 * @brief Remembers the column-index that appeared
+	 * in current row for the first time
+	 *
+	 * @param col Column-index
+	 */
+	void push(int col)
+	{
+		if (_num_found == _found_capacity) {
+			_found_capacity = (_found_capacity == 0) ? 64 : 2 * _found_capacity;
+			int *buff = new int[_found_capacity];
+
+			for (int k = 0; k < _num_found; ++k) {
+				buff[k] = _found[k];
+			}
+
+			delete[] _found;
+			_found = buff;
+		}
+
+		_found[_num_found++] = col;
+	}
+
+public:
+	/**
+	 * @brief Rows denser than width / DENSE_RATIO are
+	 * accumulated in a dense array
+	 */
+	static const int DENSE_RATIO = 8;
+
+	/**
+	 * @brief Creates an instance of RowAccumulator
+	 * @details No memory is allocated until the first row
+	 * is started
+	 *
+	 * @param width Number of columns of accumulated rows
+	 */
+	RowAccumulator(int width)
+		: _width(width), _mark(0), _dense(0), _stamp(0),
+		  _keys(0), _hvals(0), _capacity(0), _hmask(0),
+		  _found(0), _num_found(0), _found_capacity(0),
+		  _use_dense(false)
+	{
+	}
+
+	/**
+	 * @brief Deletes an instance of RowAccumulator
+	 */
+	~RowAccumulator()
+	{
+		delete[] _mark;
+		delete[] _dense;
+		delete[] _keys;
+		delete[] _hvals;
+		delete[] _found;
+	}
+
+	/**
+	 * @brief Starts accumulation of a new row
+	 * @details Chooses between dense and hash modes.
+	 *
+	 * @param upper_bound Upper bound of the number of
+	 * contributions (e.g. number of multiplications)
+	 */
+	void start(int upper_bound)
+	{
+		_num_found = 0;
+		_use_dense = (long long)upper_bound * DENSE_RATIO > _width;
+
+		if (_use_dense) {
+			if (_mark == 0) {
+				_mark = new int[_width];
+				_dense = new T[_width];
+
+				for (int j = 0; j < _width; ++j) {
+					_mark[j] = -1;
+				}
+			}
+			++_stamp;
+			return;
+		}
+
+		int needed = 16;
+		while (needed < 2 * upper_bound) {
+			needed *= 2;
+		}
+
+		if (needed > _capacity) {
+			delete[] _keys;
+			delete[] _hvals;
+
+			_capacity = needed;
+			_keys = new int[_capacity];
+			_hvals = new T[_capacity];
+		}
+
+		_hmask = needed - 1;
+
+		for (int h = 0; h < needed; ++h) {
+			_keys[h] = -1;
+		}
+	}
+
+	/**
+	 * @brief Registers the column-index without a value
+	 * @details Used by symbolic phases that only need
+	 * the structure of the row
+	 *
+	 * @param col Column-index
+	 */
+	void insert(int col)
+	{
+		if (_use_dense) {
+			if (_mark[col] != _stamp) {
+				_mark[col] = _stamp;
+				push(col);
+			}
+		}
+		else {
+			slot(col);
+		}
+	}
+
+	/**
+	 * @brief Adds the value to the given column of the row
+	 *
+	 * @param col Column-index
+	 * @param val Value to be added
+	 */
+	void add(int col, const T &val)
+	{
+		if (_use_dense) {
+			if (_mark[col] != _stamp) {
+				_mark[col] = _stamp;
+				_dense[col] = val;
+				push(col);
+			}
+			else {
+				_dense[col] += val;
+			}
+		}
+		else {
+			_hvals[slot(col)] += val;
+		}
+	}
+
+	/**
+	 * @brief Gets the number of distinct column-indices
+	 * in current row
+	 * @return Number of nonempty elements
+	 */
+	int count() const
+	{
+		return _num_found;
+	}
+
+	/**
+	 * @brief Writes the accumulated row sorted by column-indices
+	 *
+	 * @param jptr Output array of column-indices (of size count())
+	 * @param aelem Output array of values (of size count())
+	 */
+	void gather(int *jptr, T *aelem)
+	{
+		std::sort(_found, _found + _num_found);
+
+		for (int k = 0; k < _num_found; ++k) {
+			int col = _found[k];
+			jptr[k] = col;
+			aelem[k] = _use_dense ? _dense[col] : _hvals[slot(col)];
+		}
+	}
+};
+
+#endif // ACCUMULATOR_H
@@ -0,0 +1,882 @@
+#ifndef AMG_H
+#define AMG_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+
+#include "vector.h"
+#include "csr.h"
+#include "cslr.h"
+#include "skyline.h"
+#include "precond.h"
+#include "reduce.h"
+#include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Steps of power iteration estimating the spectral radius
+ * of D^-1 A on every level
+ */
+const int AMG_POWER_STEPS = 10;
+
+/**
+ * @brief Default size of the coarsest level (factored by SkylineLU)
+ */
+const int AMG_COARSE_SIZE = 500;
+
+/**
+ * @brief Default maximal number of levels
+ */
+const int AMG_MAX_LEVELS = 20;
+
+/**
+ * @brief Largest envelope (elements per triangle) of the coarsest
+ * matrix factored by SkylineLU; a coarsest level that aggregation
+ * could not reduce far enough is smoothed by AMG_COARSE_SWEEPS
+ * Jacobi sweeps instead
+ */
+const long long AMG_COARSE_ENVELOPE = 1LL << 22;
+
+/**
+ * @brief Jacobi sweeps on the coarsest level that is not factored
+ */
+const int AMG_COARSE_SWEEPS = 10;
+
+/**
+ * @brief AMG - smoothed aggregation algebraic multigrid
+ * @details The hierarchy is built from CSR operations only:
+ * - strength of connection: a_ij is strong if
+ *   a_ij^2 >= theta^2 |a_ii a_jj| (theta is halved on every
+ *   coarser level, as proposed by Vanek, Mandel and Brezina);
+ *   the filtered matrix S keeps the strong elements only, the
+ *   weak ones are added to its diagonal;
+ * - aggregation: roots of aggregates form a maximal independent
+ *   set of distance 2 of the strong connections, found by
+ *   parallel rounds with hashed priorities (as proposed by Bell,
+ *   Dalton and Olson); the other nodes join the roots at distance
+ *   1 and 2;
+ * - tentative prolongator P0 interpolates the constant vector
+ *   (columns are normalized, so that P0^T P0 = I);
+ * - smoothed prolongator P = (I - omega D_S^-1 S) P0 with
+ *   omega = 4 / (3 rho(D_S^-1 S)) by SpGEMM and CSR::add();
+ * - Galerkin coarse matrix A_c = P^T (A P) by transpose() and
+ *   two SpGEMMs.
+ * The coarsest level (at most coarse_size rows, or where the
+ * aggregation stops reducing the size) is factored by SkylineLU
+ * (see AMG_COARSE_ENVELOPE).
+ *
+ * apply() makes one V-cycle from zero initial guess with damped
+ * Jacobi smoothing (omega = 4 / (3 rho(D^-1 A)), sweeps before
+ * and after the coarse correction), so it is a fixed symmetric
+ * operator for symmetric A. The cycle consists of parallel SpMVs
+ * and vector updates only, and all its vectors are allocated by
+ * the constructor.
+ *
+ * Rows of matrix must have sorted column-indices and nonzero
+ * diagonal. The coarse matrix must be nonsingular (e.g. A is
+ * positive definite, or at least not all its rows sum to zero).
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class AMG : public Preconditioner<T>
+{
+	/**
+	 * @brief Level of hierarchy
+	 * @details Level 0 refers to the given matrix, the others own
+	 * their matrices. P, R and the vectors of coarse problem are
+	 * empty on the coarsest level; b and x are empty on level 0
+	 * (the arguments of apply() are used).
+	 */
+	struct Level
+	{
+		const CSR<T> *A;
+		CSR<T> *P;
+		CSR<T> *R;
+		T *dinv;
+		T omega;
+		Vector<T> *r;
+		Vector<T> *b;
+		Vector<T> *x;
+	};
+
+	std::vector<Level> _levels;
+	SkylineLU<T> *_coarse;
+	int _sweeps;
+	long long _madds;
+
+	AMG(const AMG &);
+	AMG& operator= (const AMG &);
+
+	/**
+	 * @brief Deletes everything the hierarchy owns
+	 */
+	void release()
+	{
+		for (size_t l = 0; l < _levels.size(); ++l) {
+			Level &L = _levels[l];
+
+			if (l > 0) {
+				delete L.A;
+			}
+
+			delete L.P;
+			delete L.R;
+			delete[] L.dinv;
+			delete L.r;
+			delete L.b;
+			delete L.x;
+		}
+
+		_levels.clear();
+
+		delete _coarse;
+		_coarse = 0;
+	}
+
+	/**
+	 * @brief Finds the diagonal of matrix
+	 *
+	 * @param A Matrix
+	 * @param diag Diagonal (rows elements)
+	 */
+	static void diagonal(const CSR<T> &A, T *diag)
+	{
+		const int *iptr = A.iptr();
+		const int *jptr = A.jptr();
+		const T *aelem = A.aelem();
+		std::atomic<int> zero(-1);
+
+		parallel_for(0, A.rows(), [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				diag[i] = 0;
+
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					if (jptr[k] == i) {
+						diag[i] += aelem[k];
+					}
+				}
+
+				if (diag[i] == 0) {
+					zero = i;
+				}
+			}
+		}, 1024);
+
+		if (zero >= 0) {
+			throw ZeroPivot(zero);
+		}
+	}
+
+	/**
+	 * @brief Estimates the spectral radius of D^-1 A by
+	 * AMG_POWER_STEPS steps of power iteration
+	 * @details The start vector is pseudo-random, but fixed
+	 *
+	 * @param A Matrix
+	 * @param dinv Inverse of diagonal
+	 * @return Estimate (from below)
+	 */
+	static T spectral_radius(const CSR<T> &A, const T *dinv)
+	{
+		int n = A.rows();
+		Vector<T> x(n);
+		Vector<T> y(n);
+		T *px = x.data();
+		T *py = y.data();
+		T rho = 0;
+
+		parallel_for(0, n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				unsigned h = (unsigned)i * 2654435761u;
+				px[i] = 0.5 + (T)((h >> 8) & 0xffff) / 65536;
+			}
+		}, 4096);
+
+		T xnorm = nrm2(x);
+
+		for (int step = 0; step < AMG_POWER_STEPS && xnorm > 0; ++step) {
+			A.multiply(x, y);
+
+			parallel_for(0, n, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i) {
+					py[i] *= dinv[i];
+				}
+			}, 4096);
+
+			T ynorm = nrm2(y);
+			rho = ynorm / xnorm;
+
+			parallel_for(0, n, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i) {
+					px[i] = (ynorm > 0) ? py[i] / ynorm : 0;
+				}
+			}, 4096);
+
+			xnorm = (ynorm > 0) ? 1 : 0;
+		}
+
+		return rho;
+	}
+
+	/**
+	 * @brief Filters the matrix by strength of connection
+	 * @details Keeps the diagonal and the strong off-diagonal
+	 * elements; the weak ones are added to the diagonal (unless it
+	 * vanishes then), so that the row sums are kept
+	 *
+	 * @param A Matrix
+	 * @param diag Diagonal
+	 * @param theta Threshold
+	 * @return Filtered matrix
+	 */
+	static CSR<T> filter(const CSR<T> &A, const T *diag, T theta)
+	{
+		int n = A.rows();
+		const int *iptr = A.iptr();
+		const int *jptr = A.jptr();
+		const T *aelem = A.aelem();
+		T theta2 = theta * theta;
+
+		std::vector<int> fiptr(n + 1, 0);
+		std::vector<int> fjptr;
+		std::vector<T> faelem;
+
+		// Both passes use the same test
+		auto strong = [&](int i, int k) {
+			int j = jptr[k];
+			return j == i ||
+				   aelem[k] * aelem[k] >= theta2 * fabs(diag[i] * diag[j]);
+		};
+
+		parallel_for(0, n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				int count = 0;
+
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					count += strong(i, k);
+				}
+
+				fiptr[i + 1] = count;
+			}
+		}, 1024);
+
+		for (int i = 0; i < n; ++i) {
+			fiptr[i + 1] += fiptr[i];
+		}
+
+		fjptr.resize(fiptr[n]);
+		faelem.resize(fiptr[n]);
+
+		parallel_for(0, n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				int p = fiptr[i];
+				int d = -1;
+				T weak = 0;
+
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					if (!strong(i, k)) {
+						weak += aelem[k];
+						continue;
+					}
+
+					d = (jptr[k] == i) ? p : d;
+					fjptr[p] = jptr[k];
+					faelem[p++] = aelem[k];
+				}
+
+				if (d >= 0 && faelem[d] + weak != 0) {
+					faelem[d] += weak;
+				}
+			}
+		}, 1024);
+
+		return CSR<T>(faelem.data(), fiptr.data(), fjptr.data(), n, n, fiptr[n]);
+	}
+
+	/**
+	 * @brief Key of node in the rounds of aggregate():
+	 * state (2 - root, 1 - undecided, 0 - not a root), hashed
+	 * priority and index, so that keys of nodes are distinct
+	 */
+	static unsigned long long key(int state, int i)
+	{
+		// Finalizer of MurmurHash3: structured orders of rows
+		// do not give structured priorities
+		unsigned h = (unsigned)i;
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		h >>= 1;
+
+		return ((unsigned long long)state << 62) |
+			   ((unsigned long long)h << 31) | (unsigned)i;
+	}
+
+	/**
+	 * @brief Aggregates the nodes of graph of strong connections
+	 * @details The roots of aggregates form a maximal independent
+	 * set of distance 2 of the graph, found in synchronous rounds:
+	 * an undecided node becomes a root when its key is the largest
+	 * in its neighbourhood of distance 2, and drops out when a root
+	 * is that close (two max-passes over S per round). Every node
+	 * then joins the root adjacent to it (with the largest key),
+	 * and the rest join an aggregate of an adjacent node. Every
+	 * pass reads the results of the previous one only, so the
+	 * aggregates do not depend on the number of threads.
+	 *
+	 * @param S Filtered matrix (see filter())
+	 * @param agg Aggregates of rows
+	 * @return Number of aggregates
+	 */
+	static int aggregate(const CSR<T> &S, int *agg)
+	{
+		int n = S.rows();
+		const int *sptr = S.iptr();
+		const int *sidx = S.jptr();
+		const unsigned long long index = (1ULL << 31) - 1;
+
+		std::vector<unsigned char> state(n, 1);
+		std::vector<unsigned long long> near(n);
+		std::vector<int> first(n);
+		std::atomic<int> undecided(n);
+
+		while (undecided > 0) {
+			parallel_for(0, n, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i) {
+					unsigned long long m = key(state[i], i);
+
+					for (int k = sptr[i]; k < sptr[i + 1]; ++k) {
+						m = std::max(m, key(state[sidx[k]], sidx[k]));
+					}
+
+					near[i] = m;
+				}
+			}, 1024);
+
+			undecided = 0;
+
+			parallel_for(0, n, [&](int lo, int hi) {
+				int count = 0;
+
+				for (int i = lo; i < hi; ++i) {
+					if (state[i] != 1) {
+						continue;
+					}
+
+					unsigned long long m = near[i];
+
+					for (int k = sptr[i]; k < sptr[i + 1]; ++k) {
+						m = std::max(m, near[sidx[k]]);
+					}
+
+					if ((m >> 62) == 2) {
+						state[i] = 0;
+					} else if ((int)(m & index) == i) {
+						state[i] = 2;
+					} else {
+						++count;
+					}
+				}
+
+				undecided += count;
+			}, 1024);
+		}
+
+		// Roots are numbered in order of rows
+		int nagg = 0;
+
+		for (int i = 0; i < n; ++i) {
+			first[i] = (state[i] == 2) ? nagg++ : -1;
+		}
+
+		// Distance 1: the adjacent root with the largest key
+		parallel_for(0, n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				int root = (state[i] == 2) ? i : -1;
+
+				for (int k = sptr[i]; k < sptr[i + 1] && root != i; ++k) {
+					int j = sidx[k];
+
+					if (state[j] == 2 && (root < 0 || key(2, j) > key(2, root))) {
+						root = j;
+					}
+				}
+
+				agg[i] = (root >= 0) ? first[root] : -1;
+			}
+		}, 1024);
+
+		// Distance 2: the aggregate of the first adjacent node
+		// that joined at distance 1
+		parallel_for(0, n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				first[i] = agg[i];
+
+				for (int k = sptr[i]; k < sptr[i + 1] && first[i] < 0; ++k) {
+					first[i] = agg[sidx[k]];
+				}
+			}
+		}, 1024);
+
+		// Nodes out of reach (the portrait of S may be
+		// unsymmetric) make aggregates of their own
+		for (int i = 0; i < n; ++i) {
+			agg[i] = (first[i] >= 0) ? first[i] : nagg++;
+		}
+
+		return nagg;
+	}
+
+	/**
+	 * @brief Builds the smoothed prolongator
+	 * P = (I - omega D^-1 S) P0
+	 * @details Smoothing by the filtered matrix keeps the
+	 * prolongator as sparse as the strong connections: the weak
+	 * ones (e.g. of the rows with much larger diagonal) would
+	 * spread every column over their whole neighbourhood
+	 *
+	 * @param S Filtered matrix (see filter())
+	 * @param agg Aggregates of rows
+	 * @param nagg Number of aggregates
+	 * @param madds Multiply-adds of the product are added to it
+	 * @return Prolongator (rows x nagg)
+	 */
+	static CSR<T> prolongator(const CSR<T> &S, int *agg, int nagg,
+							  long long &madds)
+	{
+		int n = S.rows();
+		std::vector<int> size(nagg, 0);
+		std::vector<int> iptr(n + 1);
+		std::vector<T> aelem(n);
+		std::vector<T> dinv(n);
+
+		diagonal(S, dinv.data());
+
+		for (int i = 0; i < n; ++i) {
+			dinv[i] = 1 / dinv[i];
+		}
+
+		T rho = spectral_radius(S, dinv.data());
+		T omega = (rho > 0) ? 4 / (3 * rho) : 0;
+
+		for (int i = 0; i < n; ++i) {
+			++size[agg[i]];
+		}
+
+		parallel_for(0, n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				iptr[i] = i;
+				aelem[i] = 1 / sqrt((T)size[agg[i]]);
+			}
+		}, 4096);
+
+		iptr[n] = n;
+
+		CSR<T> tentative(aelem.data(), iptr.data(), agg, n, nagg, n);
+		SpGEMMInfo info;
+		CSR<T> smooth = S.multiply(tentative, &info);
+		madds += info.flops;
+
+		const int *siptr = smooth.iptr();
+		T *saelem = smooth.aelem();
+
+		parallel_for(0, n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				for (int k = siptr[i]; k < siptr[i + 1]; ++k) {
+					saelem[k] *= -omega * dinv[i];
+				}
+			}
+		}, 1024);
+
+		return CSR<T>::add(tentative, smooth);
+	}
+
+	/**
+	 * @brief Builds the hierarchy
+	 *
+	 * @param A Matrix
+	 * @param theta Threshold of strength of the finest level
+	 * @param coarse_size Largest size of the coarsest level
+	 * @param max_levels Maximal number of levels
+	 */
+	void setup(const CSR<T> &A, T theta, int coarse_size, int max_levels)
+	{
+		const CSR<T> *cur = &A;
+
+		while (true) {
+			SPARSE_TRACE_SCOPE("AMG::level");
+
+			int n = cur->rows();
+			Level L = {cur, 0, 0, 0, 0, 0, 0, 0};
+
+			_levels.push_back(L);
+			Level &lev = _levels.back();
+
+			if (_levels.size() > 1) {
+				lev.b = new Vector<T>(n);
+				lev.x = new Vector<T>(n);
+			}
+
+			std::vector<T> diag(n);
+			diagonal(*cur, diag.data());
+
+			lev.dinv = new T[n];
+
+			for (int i = 0; i < n; ++i) {
+				lev.dinv[i] = 1 / diag[i];
+			}
+
+			if (n <= coarse_size || (int)_levels.size() >= max_levels) {
+				break;
+			}
+
+			T rho = spectral_radius(*cur, lev.dinv);
+			lev.omega = (rho > 0) ? 4 / (3 * rho) : 1;
+			lev.r = new Vector<T>(n);
+
+			std::vector<int> agg(n);
+
+			CSR<T> S = filter(*cur, diag.data(), theta);
+			int nagg = aggregate(S, agg.data());
+
+			if (nagg == 0 || nagg >= n) {
+				delete lev.r;
+				lev.r = 0;
+				break;
+			}
+
+			lev.P = new CSR<T>(prolongator(S, agg.data(), nagg, _madds));
+			lev.R = new CSR<T>(lev.P->transpose());
+
+			SpGEMMInfo info;
+			CSR<T> ap = cur->multiply(*lev.P, &info);
+			_madds += info.flops;
+
+			cur = new CSR<T>(lev.R->multiply(ap, &info));
+			_madds += info.flops;
+
+			theta /= 2;
+		}
+
+		// The coarsest matrix gets a symmetric portrait (explicit
+		// zeros are added) to be stored as CSLR
+		SPARSE_TRACE_SCOPE("AMG::coarse");
+
+		CSR<T> sym = CSR<T>::add(*cur, cur->transpose(), 1, 0);
+		CSLR<T> coarse(sym);
+
+		if (SkylineLU<T>::envelope(coarse) <= AMG_COARSE_ENVELOPE) {
+			_coarse = new SkylineLU<T>(coarse);
+			return;
+		}
+
+		Level &last = _levels.back();
+		T rho = spectral_radius(*cur, last.dinv);
+
+		last.omega = (rho > 0) ? 4 / (3 * rho) : 1;
+		last.r = new Vector<T>(cur->rows());
+	}
+
+	/**
+	 * @brief Makes a sweep of damped Jacobi:
+	 * x += omega D^-1 (b - A x)
+	 *
+	 * @param L Level
+	 * @param b Right-hand side
+	 * @param x Solution
+	 * @param zero True if x is zero (the product is skipped)
+	 */
+	static void jacobi(const Level &L, const Vector<T> &b, Vector<T> &x,
+					   bool zero)
+	{
+		const T *pb = b.data();
+		const T *pr = L.r->data();
+		T *px = x.data();
+
+		if (!zero) {
+			L.A->multiply(x, *L.r);
+		}
+
+		numa_for<T>(x.size(), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				T res = zero ? pb[i] : pb[i] - pr[i];
+				px[i] = (zero ? 0 : px[i]) + L.omega * L.dinv[i] * res;
+			}
+		});
+	}
+
+	/**
+	 * @brief Makes a V-cycle from zero initial guess
+	 *
+	 * @param l Level
+	 * @param b Right-hand side
+	 * @param x Solution
+	 */
+	void cycle(int l, const Vector<T> &b, Vector<T> &x)
+	{
+		const Level &L = _levels[l];
+
+		if (l + 1 == (int)_levels.size()) {
+			if (!_coarse) {
+				for (int s = 0; s < AMG_COARSE_SWEEPS; ++s) {
+					jacobi(L, b, x, s == 0);
+				}
+				return;
+			}
+
+			numa_copy(x.data(), b.data(), x.size());
+			_coarse->solve(x);
+			return;
+		}
+
+		const Level &C = _levels[l + 1];
+
+		for (int s = 0; s < _sweeps; ++s) {
+			jacobi(L, b, x, s == 0);
+		}
+
+		// r = b - A x, restricted to the coarse level
+		const T *pb = b.data();
+		T *pr = L.r->data();
+
+		L.A->multiply(x, *L.r);
+
+		numa_for<T>(x.size(), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				pr[i] = pb[i] - pr[i];
+			}
+		});
+
+		L.R->multiply(*L.r, *C.b);
+
+		cycle(l + 1, *C.b, *C.x);
+
+		// x += P x_c
+		const T *pe = L.r->data();
+		T *px = x.data();
+
+		L.P->multiply(*C.x, *L.r);
+
+		numa_for<T>(x.size(), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				px[i] += pe[i];
+			}
+		});
+
+		for (int s = 0; s < _sweeps; ++s) {
+			jacobi(L, b, x, false);
+		}
+	}
+
+	/**
+	 * @brief Adds the cost of SpMV by CSR matrix (2 operations
+	 * and one value and index per element, the vectors once)
+	 */
+	static void spmv_cost(const CSR<T> &A, double &flops, double &bytes)
+	{
+		flops += 2.0 * A.size_of_aelem();
+		bytes += (double)A.size_of_aelem() * (sizeof(T) + sizeof(int)) +
+				 (A.rows() + 1.0) * sizeof(int) +
+				 ((double)A.rows() + A.cols()) * sizeof(T);
+	}
+
+public:
+	/**
+	 * @brief Builds the hierarchy of smoothed aggregation AMG
+	 *
+	 * @param A Square matrix (must outlive the preconditioner)
+	 * @param theta Threshold of strength of connection
+	 * @param sweeps Jacobi sweeps before and after the coarse
+	 * correction
+	 * @param coarse_size Largest size of the coarsest level
+	 * @param max_levels Maximal number of levels
+	 */
+	AMG(const CSR<T> &A, T theta = 0.08, int sweeps = 2,
+		int coarse_size = AMG_COARSE_SIZE, int max_levels = AMG_MAX_LEVELS)
+		: _coarse(0), _sweeps(std::max(1, sweeps)), _madds(0)
+	{
+		if (A.rows() != A.cols()) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("AMG::setup", 0);
+		SPARSE_TRACE_SCOPE("AMG::setup");
+
+		try {
+			setup(A, theta, std::max(1, coarse_size), std::max(1, max_levels));
+		}
+		catch (...) {
+			release();
+			throw;
+		}
+	}
+
+	/**
+	 * @brief Deletes an instance of AMG
+	 */
+	~AMG()
+	{
+		release();
+	}
+
+	/**
+	 * @brief Gets the size of matrix
+	 * @return Number of rows
+	 */
+	int size() const
+	{
+		return _levels[0].A->rows();
+	}
+
+	/**
+	 * @brief Gets the number of levels
+	 * @return Number of levels (1 - the matrix is factored)
+	 */
+	int levels() const
+	{
+		return _levels.size();
+	}
+
+	/**
+	 * @brief Gets the matrix of level
+	 *
+	 * @param l Level (0 - the given matrix)
+	 * @return Reference to matrix
+	 */
+	const CSR<T>& matrix(int l) const
+	{
+		return *_levels[l].A;
+	}
+
+	/**
+	 * @brief Gets the operator complexity: the number of nonempty
+	 * elements of all levels relative to that of the given matrix
+	 * @return Operator complexity
+	 */
+	double complexity() const
+	{
+		double nnz = 0;
+
+		for (size_t l = 0; l < _levels.size(); ++l) {
+			nnz += _levels[l].A->size_of_aelem();
+		}
+
+		return nnz / std::max(1, _levels[0].A->size_of_aelem());
+	}
+
+	/**
+	 * @brief Estimates the cost of setup
+	 * @details Operations are those of SpGEMMs (prolongator
+	 * smoothing and Galerkin products) and of the coarsest
+	 * factorization; the minimal traffic is every matrix of the
+	 * hierarchy written once
+	 *
+	 * @param flops Number of floating-point operations
+	 * @param bytes Minimal traffic in bytes
+	 */
+	void setup_cost(double &flops, double &bytes) const
+	{
+		flops = 2.0 * _madds;
+		bytes = 0;
+
+		for (size_t l = 0; l < _levels.size(); ++l) {
+			const Level &L = _levels[l];
+			const CSR<T> *mtrx[3] = {(l > 0) ? L.A : 0, L.P, L.R};
+
+			for (int k = 0; k < 3; ++k) {
+				if (mtrx[k]) {
+					bytes += (double)mtrx[k]->size_of_aelem() * (sizeof(T) + sizeof(int)) +
+							 (mtrx[k]->rows() + 1.0) * sizeof(int);
+				}
+			}
+		}
+
+		if (_coarse) {
+			double f;
+			double b;
+
+			_coarse->factor_cost(f, b);
+			flops += f;
+			bytes += b;
+		}
+	}
+
+	/**
+	 * @brief Estimates the cost of apply()
+	 * @details On every level: 2 * sweeps - 1 products in
+	 * smoothing, one for the residual, restriction and
+	 * prolongation, and the vector updates; the coarsest level
+	 * is solved by SkylineLU or smoothed
+	 *
+	 * @param flops Number of floating-point operations
+	 * @param bytes Minimal traffic in bytes
+	 */
+	void apply_cost(double &flops, double &bytes) const
+	{
+		flops = 0;
+		bytes = 0;
+
+		for (size_t l = 0; l < _levels.size(); ++l) {
+			const Level &L = _levels[l];
+			double n = L.A->rows();
+
+			if (l + 1 == _levels.size()) {
+				if (_coarse) {
+					double f;
+					double b;
+
+					_coarse->solve_cost(f, b);
+					flops += f;
+					bytes += b;
+				} else {
+					for (int s = 1; s < AMG_COARSE_SWEEPS; ++s) {
+						spmv_cost(*L.A, flops, bytes);
+					}
+
+					flops += 4 * AMG_COARSE_SWEEPS * n;
+					bytes += 4.0 * AMG_COARSE_SWEEPS * n * sizeof(T);
+				}
+				break;
+			}
+
+			for (int s = 0; s < 2 * _sweeps; ++s) {
+				spmv_cost(*L.A, flops, bytes);
+			}
+
+			spmv_cost(*L.R, flops, bytes);
+			spmv_cost(*L.P, flops, bytes);
+
+			// Jacobi sweeps, residual and correction
+			flops += (8.0 * _sweeps + 2) * n;
+			bytes += (8.0 * _sweeps + 6) * n * sizeof(T);
+		}
+	}
+
+	/**
+	 * @brief Applies one V-cycle: z ~ A^-1 r
+	 * @details Allocates nothing
+	 *
+	 * @param r Right-hand side
+	 * @param z Result (distinct from r)
+	 */
+	void apply(const Vector<T> &r, Vector<T> &z)
+	{
+		if (r.size() != size() || z.size() != size()) {
+			throw VecSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("AMG::apply", 0);
+		SPARSE_TRACE_SCOPE("AMG::apply");
+
+		cycle(0, r, z);
+	}
+};
+
+#endif // AMG_H
@@ -0,0 +1,390 @@
+#ifndef BLOCKEDCSR_H
+#define BLOCKEDCSR_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "vector.h"
+#include "csr.h"
+#include "exception.h"
+#include "parallel.h"
+#include "numa.h"
+#include "cacheinfo.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Column-blocked CSR matrix.
+ * @details The matrix is split into vertical panels of
+ * panel_cols() columns, so that the part of x used by a panel
+ * stays in cache while the panel is multiplied. Every panel is
+ * kept as a doubly compressed CSR: only its nonempty rows are
+ * stored, so the overhead of panels is bounded by the number of
+ * elements rather than by rows * panels.
+ *
+ * Arrays:
+ * - pseg - first segment of every panel (npanels + 1 elements)
+ * - srow - row of every segment (nonempty row of panel)
+ * - sptr - first element of every segment (segments + 1 elements)
+ * - jptr, aelem - elements of segments, panel after panel
+ *
+ * All the threads multiply the same panel at the same time (each
+ * its own rows), so the x panel is shared in the last level cache.
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class BlockedCSR
+{
+	int _rows;
+	int _cols;
+	int _panel_cols;
+	int _npanels;
+	int _nsegs;
+	int _size_of_aelem;
+	T _eval;
+
+	int *_iptr;
+	int *_pseg;
+	int *_srow;
+	int *_sptr;
+	int *_jptr;
+	T *_aelem;
+
+	BlockedCSR(const BlockedCSR &);
+	BlockedCSR& operator= (const BlockedCSR &);
+
+public:
+	/**
+	 * @brief Chooses the width of panels from cache sizes
+	 * @details The x part of a panel takes half of the last level
+	 * cache. If the whole x fits there, the matrix gets a single
+	 * panel (blocking would only add overhead).
+	 *
+	 * @param cols Number of columns in matrix
+	 * @return Number of columns in panel
+	 */
+	static int auto_panel_cols(int cols)
+	{
+		long width = CacheInfo::instance().llc() / (2 * (long)sizeof(T));
+
+		if (width < 1024) {
+			width = 1024;
+		}
+
+		return (width >= cols) ? (cols > 0 ? cols : 1) : (int)width;
+	}
+
+	/**
+	 * @brief Creates an instance of BlockedCSR from CSR matrix
+	 *
+	 * @param mtrx CSR matrix
+	 * @param panel_cols Number of columns in panel (0 - chosen
+	 * from cache sizes, see auto_panel_cols())
+	 */
+	BlockedCSR(const CSR<T> &mtrx, int panel_cols = 0)
+	{
+		SPARSE_PROFILE_SCOPE("BlockedCSR::BlockedCSR", 0);
+
+		_rows = mtrx.rows();
+		_cols = mtrx.cols();
+		_size_of_aelem = mtrx.size_of_aelem();
+		_eval = mtrx.eval();
+		_panel_cols = (panel_cols > 0) ? panel_cols : auto_panel_cols(_cols);
+		_npanels = (_cols + _panel_cols - 1) / _panel_cols;
+
+		if (_npanels == 0) {
+			_npanels = 1;
+		}
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+
+		_iptr = numa_alloc<int>(_rows + 1);
+		numa_copy(_iptr, iptr, _rows + 1);
+
+		// First pass: number of segments and elements of every panel
+		std::vector<int> count(_npanels, 0);
+		std::vector<int> touched;
+		std::vector<int> segs(_npanels + 1, 0);
+		std::vector<int> elems(_npanels + 1, 0);
+
+		for (int i = 0; i < _rows; ++i) {
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				int p = jptr[k] / _panel_cols;
+
+				if (count[p]++ == 0) {
+					touched.push_back(p);
+				}
+			}
+
+			for (size_t t = 0; t < touched.size(); ++t) {
+				int p = touched[t];
+				++segs[p + 1];
+				elems[p + 1] += count[p];
+				count[p] = 0;
+			}
+
+			touched.clear();
+		}
+
+		for (int p = 0; p < _npanels; ++p) {
+			segs[p + 1] += segs[p];
+			elems[p + 1] += elems[p];
+		}
+
+		_nsegs = segs[_npanels];
+
+		_pseg = new int[_npanels + 1];
+		_srow = numa_alloc<int>(_nsegs);
+		_sptr = numa_alloc<int>(_nsegs + 1);
+		_jptr = numa_alloc<int>(_size_of_aelem);
+		_aelem = numa_alloc<T>(_size_of_aelem);
+
+		for (int p = 0; p <= _npanels; ++p) {
+			_pseg[p] = segs[p];
+		}
+
+		// Second pass: rows are visited in order, so the segments
+		// of every panel are sorted by rows
+		std::vector<int> cursor(_npanels, 0);
+
+		for (int i = 0; i < _rows; ++i) {
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				int p = jptr[k] / _panel_cols;
+
+				if (count[p]++ == 0) {
+					touched.push_back(p);
+				}
+			}
+
+			for (size_t t = 0; t < touched.size(); ++t) {
+				int p = touched[t];
+				int s = segs[p]++;
+
+				_srow[s] = i;
+				_sptr[s] = elems[p];
+				cursor[p] = elems[p];
+				elems[p] += count[p];
+				count[p] = 0;
+			}
+
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				int c = cursor[jptr[k] / _panel_cols]++;
+				_jptr[c] = jptr[k];
+				_aelem[c] = aelem[k];
+			}
+
+			touched.clear();
+		}
+
+		_sptr[_nsegs] = _size_of_aelem;
+	}
+
+	/**
+	 * @brief Deletes an instance of BlockedCSR
+	 */
+	~BlockedCSR()
+	{
+		delete[] _iptr;
+		delete[] _pseg;
+		delete[] _srow;
+		delete[] _sptr;
+		delete[] _jptr;
+		delete[] _aelem;
+	}
+
+	/**
+	 * @brief Gets the number of rows in matrix
+	 * @return Number of rows
+	 */
+	int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @brief Gets the number of columns in matrix
+	 * @return Number of columns
+	 */
+	int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @brief Gets the number of columns in panel
+	 * @return Width of panel
+	 */
+	int panel_cols() const
+	{
+		return _panel_cols;
+	}
+
+	/**
+	 * @brief Gets the number of panels
+	 * @return Number of panels
+	 */
+	int panels() const
+	{
+		return _npanels;
+	}
+
+	/**
+	 * @brief Gets the number of nonempty (row, panel) pairs
+	 * @return Number of segments
+	 */
+	int segments() const
+	{
+		return _nsegs;
+	}
+
+	/**
+	 * @brief Gets the number of nonempty elements
+	 * @return Number of nonempty elements
+	 */
+	int size_of_aelem() const
+	{
+		return _size_of_aelem;
+	}
+
+	/**
+	 * @brief Overwrites the values of matrix with the values of
+	 * CSR matrix it was made from (same portrait, sorted rows)
+	 * @details The elements of row i in panel p form one segment,
+	 * found by binary search in the segments of p. Panels and
+	 * segments are kept; nothing is allocated. Throws
+	 * RefreshPatternMismatch if a row has no segment in a panel
+	 * or the columns of a segment differ (the values are undefined
+	 * then).
+	 *
+	 * @param mtrx CSR matrix
+	 */
+	void set_values(const CSR<T> &mtrx)
+	{
+		if (mtrx.rows() != _rows || mtrx.cols() != _cols ||
+			mtrx.size_of_aelem() != _size_of_aelem) {
+			throw RefreshPatternMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("BlockedCSR::set_values",
+			(long long)_size_of_aelem * (2 * sizeof(T) + 2 * sizeof(int)));
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+		std::atomic<bool> mismatch(false);
+
+		parallel_for(0, _rows, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				int k = iptr[i];
+
+				while (k < iptr[i + 1]) {
+					int p = jptr[k] / _panel_cols;
+					int s = std::lower_bound(_srow + _pseg[p],
+											 _srow + _pseg[p + 1], i) - _srow;
+
+					if (s == _pseg[p + 1] || _srow[s] != i) {
+						mismatch = true;
+						return;
+					}
+
+					int c = _sptr[s];
+
+					for (; k < iptr[i + 1] && jptr[k] / _panel_cols == p;
+						 ++k, ++c) {
+						if (c == _sptr[s + 1] || _jptr[c] != jptr[k]) {
+							mismatch = true;
+							return;
+						}
+
+						_aelem[c] = aelem[k];
+					}
+
+					if (c != _sptr[s + 1]) {
+						mismatch = true;
+						return;
+					}
+				}
+			}
+		});
+
+		if (mismatch.load()) {
+			throw RefreshPatternMismatch();
+		}
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector into existing Vector
+	 * @details Every thread owns a block of rows with equal number
+	 * of elements (see nnz_range()). Panels are processed one by
+	 * one by all the threads, partial sums are accumulated into y.
+	 *
+	 * @param vec Given vector (of size cols)
+	 * @param res Result of multiplication (of size rows)
+	 */
+	void multiply(const Vector<T> &vec, Vector<T> &res) const
+	{
+		if (vec.size() != _cols || res.size() != _rows) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("BlockedCSR::multiply",
+			(long long)_size_of_aelem * (sizeof(T) + sizeof(int)) +
+			2LL * _nsegs * sizeof(int) +
+			(long long)_cols * sizeof(T) + 2LL * _npanels * _rows * sizeof(T));
+
+		const T *x = vec.data();
+		T *y = res.data();
+		Barrier barrier;
+
+		parallel([&](int tid, int nthreads) {
+			SPARSE_TRACE_SCOPE("BlockedCSR::multiply");
+
+			int lo, hi;
+			nnz_range(_iptr, _rows, tid, nthreads, lo, hi);
+
+			for (int i = lo; i < hi; ++i) {
+				y[i] = _eval;
+			}
+
+			for (int p = 0; p < _npanels; ++p) {
+				int s = std::lower_bound(_srow + _pseg[p], _srow + _pseg[p + 1], lo) - _srow;
+
+				for (; s < _pseg[p + 1] && _srow[s] < hi; ++s) {
+					T sum = 0;
+
+					for (int k = _sptr[s]; k < _sptr[s + 1]; ++k) {
+						sum += _aelem[k] * x[_jptr[k]];
+					}
+
+					y[_srow[s]] += sum;
+				}
+
+				// Keep the threads on the same panel, so its part
+				// of x is loaded into the shared cache only once
+				if (_npanels > 1) {
+					barrier.wait(nthreads);
+				}
+			}
+		});
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector
+	 * @details See multiply(const Vector<T>&, Vector<T>&)
+	 *
+	 * @param vec Given vector
+	 * @return Result of multiplication
+	 */
+	Vector<T> operator* (const Vector<T> &vec) const
+	{
+		Vector<T> res(_rows);
+		multiply(vec, res);
+		return res;
+	}
+};
+
+#endif // BLOCKEDCSR_H
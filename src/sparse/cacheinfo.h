@@ -0,0 +1,146 @@
+#ifndef CACHEINFO_H
+#define CACHEINFO_H
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Sizes of data caches of the machine
+ * @details Read from /sys/devices/system/cpu/cpu0/cache (or from
+ * sysconf) once. When a level cannot be detected, a typical size
+ * is assumed: 32 KiB for L1, 1 MiB for L2 and 8 MiB for LLC.
+ */
+class CacheInfo
+{
+	long _l1;
+	long _l2;
+	long _llc;
+
+	CacheInfo()
+		: _l1(0), _l2(0), _llc(0)
+	{
+		long levels[4] = {0, 0, 0, 0};
+
+		for (int index = 0; ; ++index) {
+			std::ostringstream dir;
+			dir << "/sys/devices/system/cpu/cpu0/cache/index" << index << "/";
+
+			std::ifstream level_file((dir.str() + "level").c_str());
+			std::ifstream type_file((dir.str() + "type").c_str());
+			std::ifstream size_file((dir.str() + "size").c_str());
+
+			int level = 0;
+			std::string type;
+			std::string size;
+
+			if (!(level_file >> level) || !(type_file >> type) ||
+				!(size_file >> size)) {
+				break;
+			}
+
+			if (type != "Instruction" && level >= 1 && level <= 3) {
+				long bytes = parse_size(size);
+				levels[level] = (bytes > levels[level]) ? bytes : levels[level];
+			}
+		}
+
+#if defined(__linux__) && defined(_SC_LEVEL1_DCACHE_SIZE)
+		if (levels[1] <= 0) {
+			levels[1] = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+		}
+		if (levels[2] <= 0) {
+			levels[2] = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		}
+		if (levels[3] <= 0) {
+			levels[3] = sysconf(_SC_LEVEL3_CACHE_SIZE);
+		}
+#endif
+
+		_l1 = (levels[1] > 0) ? levels[1] : 32L << 10;
+		_l2 = (levels[2] > 0) ? levels[2] : 1L << 20;
+
+		if (levels[3] > 0) {
+			_llc = levels[3];
+		}
+		else if (levels[2] > 0) {
+			_llc = levels[2];
+		}
+		else {
+			_llc = 8L << 20;
+		}
+	}
+
+	CacheInfo(const CacheInfo &);
+	CacheInfo& operator= (const CacheInfo &);
+
+public:
+	/**
+	 * @brief Gets the instance of CacheInfo
+	 * @return Reference to CacheInfo
+	 */
+	static CacheInfo& instance()
+	{
+		static CacheInfo info;
+		return info;
+	}
+
+	/**
+	 * @brief Parses the size of cache in sysfs format
+	 * (e.g. "48K", "2048K", "32M")
+	 *
+	 * @param size Size with optional suffix
+	 * @return Size in bytes
+	 */
+	static long parse_size(const std::string &size)
+	{
+		char *end = 0;
+		long bytes = strtol(size.c_str(), &end, 10);
+
+		if (end != 0 && (*end == 'K' || *end == 'k')) {
+			bytes <<= 10;
+		}
+		else if (end != 0 && (*end == 'M' || *end == 'm')) {
+			bytes <<= 20;
+		}
+		else if (end != 0 && (*end == 'G' || *end == 'g')) {
+			bytes <<= 30;
+		}
+
+		return bytes;
+	}
+
+	/**
+	 * @brief Gets the size of L1 data cache (per core)
+	 * @return Size in bytes
+	 */
+	long l1() const
+	{
+		return _l1;
+	}
+
+	/**
+	 * @brief Gets the size of L2 cache
+	 * @return Size in bytes
+	 */
+	long l2() const
+	{
+		return _l2;
+	}
+
+	/**
+	 * @brief Gets the size of the last level cache
+	 * @return Size in bytes
+	 */
+	long llc() const
+	{
+		return _llc;
+	}
+};
+
+#endif // CACHEINFO_H
@@ -0,0 +1,521 @@
+#ifndef CHEBYSHEV_H
+#define CHEBYSHEV_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "vector.h"
+#include "csr.h"
+#include "cslr.h"
+#include "precond.h"
+#include "reduce.h"
+#include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Default degree of Chebyshev polynomial
+ */
+const int CHEB_DEGREE = 4;
+
+/**
+ * @brief Default number of Lanczos steps estimating the spectrum
+ */
+const int CHEB_LANCZOS_STEPS = 10;
+
+/**
+ * @brief Factor of the largest Ritz value taken as the upper
+ * bound of spectrum (Lanczos approaches it from below)
+ */
+const double CHEB_SAFETY = 1.1;
+
+/**
+ * @brief Ratio hi / lo taken when the lower bound of spectrum is
+ * not positive (e.g. the smallest Ritz value of a nonsymmetric
+ * matrix)
+ */
+const double CHEB_RATIO = 30;
+
+/**
+ * @brief Chebyshev - polynomial preconditioner and smoother
+ * @details Approximates A^-1 by the Chebyshev polynomial of D^-1 A
+ * (D is the diagonal of A) that is smallest on the interval
+ * [lo, hi] of its spectrum. The interval is estimated once by
+ * a few Lanczos steps of D^-1/2 A D^-1/2 (the only reductions,
+ * made by the constructor): hi is the largest Ritz value times
+ * CHEB_SAFETY, lo is either hi / ratio (smoothing, only the upper
+ * part of spectrum is damped) or the smallest Ritz value
+ * (preconditioning), and hi / CHEB_RATIO if that is not positive.
+ * It may also be set by set_bounds().
+ *
+ * Application is the Chebyshev iteration of given degree:
+ * degree - 1 products by the matrix (one more for smooth()) and
+ * one fused vector update per step, without any inner product,
+ * so its cost does not grow with the number of threads. The work
+ * vectors are allocated by the constructor. The matrix should
+ * be symmetric with positive diagonal (at least its spectrum
+ * should be real and positive). Supports CSR and CSLR matrices.
+ *
+ * @tparam T Type of data
+ * @tparam SMTRX Type of sparse matrix (CSR<T> or CSLR<T>)
+ */
+template <typename T, typename SMTRX = CSR<T> >
+class Chebyshev : public Preconditioner<T>
+{
+	const SMTRX &_A;
+	int _n;
+	int _degree;
+
+	T _lo;
+	T _hi;
+
+	T *_dinv;
+	Vector<T> _r;
+	Vector<T> _d;
+	Vector<T> _w;
+
+	Chebyshev(const Chebyshev &);
+	Chebyshev& operator= (const Chebyshev &);
+
+	/**
+	 * @brief Gets the size of square CSR matrix
+	 */
+	static int order(const CSR<T> &A)
+	{
+		if (A.rows() != A.cols()) {
+			throw MultSizeMismatch();
+		}
+
+		return A.rows();
+	}
+
+	/**
+	 * @brief Gets the size of CSLR matrix
+	 */
+	static int order(const CSLR<T> &A)
+	{
+		return A.size();
+	}
+
+	/**
+	 * @brief Adds the cost of SpMV by CSR matrix
+	 */
+	static void spmv_cost(const CSR<T> &A, double &flops, double &bytes)
+	{
+		flops += 2.0 * A.size_of_aelem();
+		bytes += (double)A.size_of_aelem() * (sizeof(T) + sizeof(int)) +
+				 (A.rows() + 1.0) * sizeof(int) + 2.0 * A.rows() * sizeof(T);
+	}
+
+	/**
+	 * @brief Adds the cost of SpMV by CSLR matrix
+	 */
+	static void spmv_cost(const CSLR<T> &A, double &flops, double &bytes)
+	{
+		int values = A.symmetric() ? 1 : 2;
+
+		flops += 2.0 * (A.size() + 2.0 * A.size_of_altr());
+		bytes += (double)A.size_of_altr() * (values * sizeof(T) + sizeof(int)) +
+				 (A.size() + 1.0) * sizeof(int) + 3.0 * A.size() * sizeof(T);
+	}
+
+	/**
+	 * @brief Finds the diagonal of CSR matrix
+	 */
+	static void diagonal(const CSR<T> &A, T *diag)
+	{
+		const int *iptr = A.iptr();
+		const int *jptr = A.jptr();
+		const T *aelem = A.aelem();
+
+		parallel_for(0, A.rows(), [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				diag[i] = 0;
+
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					if (jptr[k] == i) {
+						diag[i] += aelem[k];
+					}
+				}
+			}
+		}, 1024);
+	}
+
+	/**
+	 * @brief Finds the diagonal of CSLR matrix
+	 */
+	static void diagonal(const CSLR<T> &A, T *diag)
+	{
+		std::copy(A.adiag(), A.adiag() + A.size(), diag);
+	}
+
+	/**
+	 * @brief Counts the eigenvalues of symmetric tridiagonal
+	 * matrix below x (Sturm sequence)
+	 *
+	 * @param alpha Diagonal (k elements)
+	 * @param beta Off-diagonal (beta[i] couples i - 1 and i)
+	 * @param k Size of matrix
+	 * @param x Point
+	 * @return Number of eigenvalues below x
+	 */
+	static int sturm(const T *alpha, const T *beta, int k, T x)
+	{
+		int count = 0;
+		T q = 1;
+
+		for (int i = 0; i < k; ++i) {
+			T b2 = (i > 0) ? beta[i] * beta[i] : 0;
+			q = alpha[i] - x - ((i > 0) ? b2 / q : 0);
+
+			if (q == 0) {
+				q = 1e-300;
+			}
+
+			count += (q < 0);
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief Finds the j-th smallest eigenvalue of symmetric
+	 * tridiagonal matrix by bisection
+	 */
+	static T bisect(const T *alpha, const T *beta, int k, int j)
+	{
+		T lo = alpha[0];
+		T hi = alpha[0];
+
+		// Gershgorin interval
+		for (int i = 0; i < k; ++i) {
+			T r = ((i > 0) ? fabs(beta[i]) : 0) +
+				  ((i + 1 < k) ? fabs(beta[i + 1]) : 0);
+
+			lo = std::min(lo, alpha[i] - r);
+			hi = std::max(hi, alpha[i] + r);
+		}
+
+		for (int it = 0; it < 100 && hi - lo > 1e-14 * std::max(fabs(lo), fabs(hi)); ++it) {
+			T mid = (lo + hi) / 2;
+
+			if (sturm(alpha, beta, k, mid) > j) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+
+		return (lo + hi) / 2;
+	}
+
+	/**
+	 * @brief Estimates the extreme eigenvalues of D^-1 A by
+	 * Lanczos steps of D^-1/2 A D^-1/2 (which has the same
+	 * spectrum and is symmetric for symmetric A)
+	 * @details The start vector is pseudo-random, but fixed
+	 *
+	 * @param steps Number of steps
+	 * @param rmin Smallest Ritz value
+	 * @param rmax Largest Ritz value
+	 */
+	void lanczos(int steps, T &rmin, T &rmax) const
+	{
+		SPARSE_TRACE_SCOPE("Chebyshev::lanczos");
+
+		Vector<T> v(_n);
+		Vector<T> prev(_n);
+		Vector<T> u(_n);
+		Vector<T> w(_n);
+		T *pv = v.data();
+		T *pp = prev.data();
+		T *pu = u.data();
+		T *pw = w.data();
+
+		std::vector<T> scale(_n);
+		std::vector<T> alpha(steps);
+		std::vector<T> beta(steps + 1, 0);
+
+		parallel_for(0, _n, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				unsigned h = (unsigned)i * 2654435761u;
+				scale[i] = sqrt(fabs(_dinv[i]));
+				pv[i] = 0.5 + (T)((h >> 8) & 0xffff) / 65536;
+				pp[i] = 0;
+			}
+		}, 4096);
+
+		T norm = nrm2(v);
+		T b = 0;
+		int k = 0;
+
+		while (k < steps && norm > 0) {
+			parallel_for(0, _n, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i) {
+					pv[i] /= norm;
+					pu[i] = scale[i] * pv[i];
+				}
+			}, 4096);
+
+			_A.multiply(u, w);
+
+			parallel_for(0, _n, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i) {
+					pw[i] = scale[i] * pw[i] - b * pp[i];
+				}
+			}, 4096);
+
+			T a = dot(w, v);
+
+			parallel_for(0, _n, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i) {
+					pw[i] -= a * pv[i];
+					pp[i] = pv[i];
+					pv[i] = pw[i];
+				}
+			}, 4096);
+
+			alpha[k++] = a;
+			b = norm = nrm2(v);
+			beta[k] = b;
+		}
+
+		rmin = bisect(&alpha[0], &beta[0], k, 0);
+		rmax = bisect(&alpha[0], &beta[0], k, k - 1);
+	}
+
+	/**
+	 * @brief Makes the Chebyshev iteration for D^-1 A x = D^-1 b
+	 *
+	 * @param b Right-hand side
+	 * @param x Initial guess, replaced by the result
+	 * @param zero True if x is zero (its product is skipped)
+	 */
+	void iterate(const Vector<T> &b, Vector<T> &x, bool zero)
+	{
+		const T *pb = b.data();
+		T *px = x.data();
+		T *pr = _r.data();
+		T *pd = _d.data();
+		const T *pw = _w.data();
+
+		T theta = (_hi + _lo) / 2;
+		T delta = (_hi - _lo) / 2;
+		T sigma = (delta > 0) ? theta / delta : 0;
+		T rho = (delta > 0) ? 1 / sigma : 0;
+
+		if (!zero) {
+			_A.multiply(x, _w);
+		}
+
+		numa_for<T>(_n, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				pr[i] = _dinv[i] * (zero ? pb[i] : pb[i] - pw[i]);
+				pd[i] = pr[i] / theta;
+			}
+		});
+
+		for (int k = 1; k < _degree; ++k) {
+			_A.multiply(_d, _w);
+
+			// Interval of zero width: Richardson with 1 / theta
+			T rho1 = (delta > 0) ? 1 / (2 * sigma - rho) : 0;
+			T c1 = rho1 * rho;
+			T c2 = (delta > 0) ? 2 * rho1 / delta : 1 / theta;
+			bool first = zero && k == 1;
+
+			numa_for<T>(_n, [&](size_t lo, size_t hi) {
+				for (size_t i = lo; i < hi; ++i) {
+					px[i] = (first ? 0 : px[i]) + pd[i];
+					pr[i] -= _dinv[i] * pw[i];
+					pd[i] = c1 * pd[i] + c2 * pr[i];
+				}
+			});
+
+			rho = rho1;
+		}
+
+		bool first = zero && _degree == 1;
+
+		numa_for<T>(_n, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				px[i] = (first ? 0 : px[i]) + pd[i];
+			}
+		});
+	}
+
+public:
+	/**
+	 * @brief Creates an instance of Chebyshev preconditioner
+	 * and estimates the spectrum of D^-1 A
+	 *
+	 * @param A Square matrix (must outlive the preconditioner)
+	 * @param degree Degree of polynomial (number of steps)
+	 * @param ratio Lower bound as hi / ratio (e.g. 30 for
+	 * smoothing in multigrid), 0 - the smallest Ritz value
+	 * @param steps Number of Lanczos steps
+	 */
+	Chebyshev(const SMTRX &A, int degree = CHEB_DEGREE, T ratio = 0,
+			  int steps = CHEB_LANCZOS_STEPS)
+		: _A(A), _n(order(A)), _degree(std::max(1, degree)),
+		  _lo(0), _hi(0), _dinv(0), _r(_n), _d(_n), _w(_n)
+	{
+		SPARSE_PROFILE_SCOPE("Chebyshev::setup", 0);
+		SPARSE_TRACE_SCOPE("Chebyshev::setup");
+
+		_dinv = new T[_n];
+		diagonal(A, _dinv);
+
+		for (int i = 0; i < _n; ++i) {
+			if (_dinv[i] == 0) {
+				delete[] _dinv;
+				throw ZeroPivot(i);
+			}
+
+			_dinv[i] = 1 / _dinv[i];
+		}
+
+		T rmin = 0;
+		T rmax = 0;
+
+		if (_n > 0) {
+			lanczos(std::max(1, std::min(steps, _n)), rmin, rmax);
+		}
+
+		rmax *= CHEB_SAFETY;
+		set_bounds((ratio > 0) ? rmax / ratio : rmin, rmax);
+	}
+
+	/**
+	 * @brief Deletes an instance of Chebyshev
+	 */
+	~Chebyshev()
+	{
+		delete[] _dinv;
+	}
+
+	/**
+	 * @brief Sets the interval of spectrum of D^-1 A damped by
+	 * the polynomial
+	 * @details A lower bound that is not positive is replaced
+	 * by hi / CHEB_RATIO: the polynomial cannot be small on an
+	 * interval that reaches 0, and Chebyshev iteration on it
+	 * stalls.
+	 *
+	 * @param lo Lower bound
+	 * @param hi Upper bound
+	 */
+	void set_bounds(T lo, T hi)
+	{
+		_lo = std::min(lo, hi);
+		_hi = std::max(lo, hi);
+
+		if (!(_hi > 0)) {
+			_lo = _hi = 1;
+		}
+		if (!(_lo > 0)) {
+			_lo = _hi / (T)CHEB_RATIO;
+		}
+	}
+
+	/**
+	 * @brief Gets the lower bound of spectrum
+	 * @return Lower bound
+	 */
+	T lower() const
+	{
+		return _lo;
+	}
+
+	/**
+	 * @brief Gets the upper bound of spectrum
+	 * @return Upper bound
+	 */
+	T upper() const
+	{
+		return _hi;
+	}
+
+	/**
+	 * @brief Gets the degree of polynomial
+	 * @return Degree
+	 */
+	int degree() const
+	{
+		return _degree;
+	}
+
+	/**
+	 * @brief Gets the size of matrix
+	 * @return Number of rows
+	 */
+	int size() const
+	{
+		return _n;
+	}
+
+	/**
+	 * @brief Estimates the cost of apply()
+	 * @details degree - 1 products and the fused updates (the
+	 * vectors of every update are read and written once)
+	 *
+	 * @param flops Number of floating-point operations
+	 * @param bytes Minimal traffic in bytes
+	 */
+	void apply_cost(double &flops, double &bytes) const
+	{
+		flops = 0;
+		bytes = 0;
+
+		for (int k = 1; k < _degree; ++k) {
+			spmv_cost(_A, flops, bytes);
+		}
+
+		flops += (6.0 * (_degree - 1) + 3) * _n;
+		bytes += (8.0 * (_degree - 1) + 6) * _n * sizeof(T);
+	}
+
+	/**
+	 * @brief Applies the polynomial: z = p(D^-1 A) D^-1 r
+	 * @details degree - 1 products, no reductions, allocates
+	 * nothing
+	 *
+	 * @param r Vector to precondition
+	 * @param z Result (distinct from r)
+	 */
+	void apply(const Vector<T> &r, Vector<T> &z)
+	{
+		if (r.size() != _n || z.size() != _n) {
+			throw VecSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("Chebyshev::apply", 0);
+		SPARSE_TRACE_SCOPE("Chebyshev::apply");
+
+		iterate(r, z, true);
+	}
+
+	/**
+	 * @brief Smooths the solution of A x = b: makes degree steps
+	 * of Chebyshev iteration from x
+	 * @details degree products, no reductions, allocates nothing
+	 *
+	 * @param b Right-hand side
+	 * @param x Approximate solution, improved in place
+	 */
+	void smooth(const Vector<T> &b, Vector<T> &x)
+	{
+		if (b.size() != _n || x.size() != _n) {
+			throw VecSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("Chebyshev::smooth", 0);
+		SPARSE_TRACE_SCOPE("Chebyshev::smooth");
+
+		iterate(b, x, false);
+	}
+};
+
+#endif // CHEBYSHEV_H
@@ -4,10 +4,16 @@
 #ifndef CSLR_H
 #define CSLR_H
 
-//#include <vector>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 
 #include "vector.h"
+#include "csr.h"
 #include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
 
 /**
  * @brief CSLR - Compressed Sparse (lower triangle) Row.
@@ -22,6 +28,10 @@
  * row appears in altr for the first time
  * - jptr - column-indices of the corresponding altr elements
  * 
+ * Numerically symmetric matrices can be switched to symmetric
+ * mode (see make_symmetric()): autr then aliases altr, so every
+ * off-diagonal value is stored and streamed once.
+ * 
  * @tparam T - Type of data stored in matrix.
  */
 template <typename T>
@@ -38,6 +48,184 @@ class CSLR
 	int *_iptr;
 
 	T _eval;
+	bool _symmetric;
+
+	/**
+	 * @brief Estimates the number of bytes streamed by
+	 * the multiplication by vector
+	 * @return Size of matrix plus sizes of both vectors
+	 */
+	long long spmv_bytes() const
+	{
+		int values = _symmetric ? 1 : 2;
+
+		return (long long)_size_of_altr * (values * sizeof(T) + sizeof(int)) +
+			   (long long)(_size + 1) * sizeof(int) +
+			   3LL * _size * sizeof(T);
+	}
+
+	/**
+	 * @brief Gets the buffer of the calling thread for the upper
+	 * elements that fall outside of its block of rows
+	 * @details Kept between products, so that a product does not
+	 * allocate (nor fault pages in) every time
+	 *
+	 * @param size Number of elements
+	 * @return Pointer to array
+	 */
+	static T* scatter_scratch(size_t size)
+	{
+		static thread_local std::vector<T> scratch;
+
+		if (scratch.size() < size) {
+			scratch.resize(size);
+		}
+
+		return scratch.data();
+	}
+
+	/**
+	 * @brief Multiplies the rows [lo, hi) by vector
+	 * @details Sets y[lo, hi) and adds the upper elements of
+	 * these rows to y[j] for lo <= j, or to out[j - first] for
+	 * j < lo.
+	 * Rows go in increasing order, so y[j] is set before the
+	 * rows below add to it.
+	 *
+	 * @tparam Symmetric Whether autr aliases altr
+	 * @param x Vector
+	 * @param y Result
+	 * @param lo First row
+	 * @param hi Past the last row
+	 * @param first Leftmost column of the rows
+	 * @param out Buffer for the columns [first, lo)
+	 */
+	template <bool Symmetric>
+	void multiply_rows(const T *x, T *y, int lo, int hi, int first,
+					   T *out) const
+	{
+		for (int i = lo; i < hi; ++i) {
+			T xi = x[i];
+			T sum = _adiag[i] * xi;
+			int k = _iptr[i];
+
+			// Columns are sorted, so only a prefix of row may fall
+			// outside of the block
+			for (; k < _iptr[i + 1] && _jptr[k] < lo; ++k) {
+				int j = _jptr[k];
+				T a = _altr[k];
+
+				sum += a * x[j];
+				out[j - first] += (Symmetric ? a : _autr[k]) * xi;
+			}
+
+			for (; k < _iptr[i + 1]; ++k) {
+				int j = _jptr[k];
+				T a = _altr[k];
+
+				sum += a * x[j];
+				y[j] += (Symmetric ? a : _autr[k]) * xi;
+			}
+
+			y[i] = sum;
+		}
+	}
+
+	/**
+	 * @brief Deletes all the arrays of matrix
+	 */
+	void release()
+	{
+		delete[] _adiag;
+		delete[] _altr;
+		delete[] _iptr;
+		delete[] _jptr;
+
+		if (!_symmetric) {
+			delete[] _autr;
+		}
+	}
+
+	/**
+	 * @brief Copies all the data from other matrix
+	 * @details Arrays must not be allocated yet
+	 * 
+	 * @param other Reference to other CSLR matrix
+	 */
+	void copy(const CSLR &other)
+	{
+		_size = other._size;
+		_size_of_altr = other._size_of_altr;
+		_eval = other._eval;
+		_symmetric = other._symmetric;
+
+		_adiag = new T[_size];
+		_altr = new T[_size_of_altr];
+		_autr = _symmetric ? _altr : new T[_size_of_altr];
+		_iptr = new int[_size + 1];
+		_jptr = new int[_size_of_altr];
+
+		for (int i = 0; i < _size; ++i) {
+			_adiag[i] = other._adiag[i];
+			_iptr[i] = other._iptr[i];
+		}
+
+		_iptr[_size] = other._iptr[_size];
+
+		for (int i = 0; i < _size_of_altr; ++i) {
+			_altr[i] = other._altr[i];
+			_jptr[i] = other._jptr[i];
+		}
+
+		if (!_symmetric) {
+			for (int i = 0; i < _size_of_altr; ++i) {
+				_autr[i] = other._autr[i];
+			}
+		}
+	}
+
+	/**
+	 * @brief Leaves symmetric mode: gives autr its own copy
+	 * of values (before they are changed independently)
+	 */
+	void unshare()
+	{
+		if (!_symmetric) {
+			return;
+		}
+
+		_autr = new T[_size_of_altr];
+
+		for (int k = 0; k < _size_of_altr; ++k) {
+			_autr[k] = _altr[k];
+		}
+
+		_symmetric = false;
+	}
+
+	/**
+	 * @brief Creates an instance of uninitialized CSLR matrix
+	 * @details Only allocates memory for all the arrays.
+	 * Used by the kernels that build a new matrix themselves
+	 * 
+	 * @param size Size of matrix (number of rows)
+	 * @param size_of_altr Number of nonempty elements in lower
+	 * triangular matrix
+	 * @param eval Empty value
+	 */
+	CSLR(int size, int size_of_altr, T eval)
+	{
+		_size = size;
+		_size_of_altr = size_of_altr;
+		_eval = eval;
+		_symmetric = false;
+
+		_adiag = new T[_size];
+		_altr = new T[_size_of_altr];
+		_autr = new T[_size_of_altr];
+		_iptr = new int[_size + 1];
+		_jptr = new int[_size_of_altr];
+	}
 
 public:
 	/**
@@ -55,6 +243,7 @@ public:
 	{
 		_size = size;
 		_eval = eval;
+		_symmetric = false;
 
 		_adiag = new T[_size];
 		_iptr = new int[_size + 1];
@@ -112,11 +301,12 @@ public:
 		_size = size;
 		_size_of_altr = size_of_altr;
 		_eval = eval;
+		_symmetric = false;
 
 		_adiag = new T[_size];
 		_altr = new T[_size_of_altr];
 		_autr = new T[_size_of_altr];
-		_iptr = new int[_size];
+		_iptr = new int[_size + 1];
 		_jptr = new int[_size_of_altr];
 
 		for (int i = 0; i < _size; ++i) {
@@ -145,11 +335,15 @@ public:
 	 * nonempty elements of lower triangular matrix
 	 * @param size Size of matrix (number of rows)
 	 * @param eval Empty value
+	 * @param symmetric Create in symmetric mode: elements (i, j)
+	 * and (j, i) share the value, insert() may set either of them
 	 */
-	CSLR(int *num_in_ltrows, int *jptr, int size, T eval = 0)
+	CSLR(int *num_in_ltrows, int *jptr, int size, T eval = 0,
+		 bool symmetric = false)
 	{
 		_size = size;
 		_eval = eval;
+		_symmetric = symmetric;
 
 		_adiag = new T[_size];
 		_iptr = new int[_size + 1];
@@ -165,7 +359,7 @@ public:
 		_iptr[_size] = _size_of_altr;
 
 		_altr = new T[_size_of_altr];
-		_autr = new T[_size_of_altr];
+		_autr = _symmetric ? _altr : new T[_size_of_altr];
 		_jptr = new int[_size_of_altr];
 
 		for (int i = 0; i < _size_of_altr; ++i) {
@@ -176,47 +370,103 @@ public:
 	}
 
 	/**
-	 * @brief Copies the data of CSLR matrix
-	 * from other CSLR matrix
+	 * @brief Creates an instance of CSLR matrix from CSR matrix
+	 * @details The portrait of given matrix must be symmetric
+	 * and its rows must have sorted column-indices.
+	 * All the diagonal elements are treated as nonempty.
 	 * 
-	 * @param other Reference to other CSLR matrix
+	 * @param mtrx Square CSR matrix with symmetric portrait
 	 */
-	CSLR(const CSLR &other)
+	CSLR(const CSR<T> &mtrx)
 	{
-		_size = other._size;
-		_size_of_altr = other._size_of_altr;
-		_eval = other._eval;
+		if (mtrx.rows() != mtrx.cols()) {
+			throw PortraitNotSymmetric();
+		}
+
+		// Rows of transposed matrix are columns of the
+		// given one - they hold the upper triangle
+		CSR<T> trans = mtrx.transpose();
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+		const int *tiptr = trans.iptr();
+		const int *tjptr = trans.jptr();
+		const T *taelem = trans.aelem();
+
+		_size = mtrx.rows();
+		_eval = 0;
+		_symmetric = false;
 
 		_adiag = new T[_size];
+		_iptr = new int[_size + 1];
+
+		_size_of_altr = 0;
+
+		for (int i = 0; i < _size; ++i) {
+			_iptr[i] = _size_of_altr;
+			_adiag[i] = 0;
+
+			for (int k = iptr[i]; k < iptr[i + 1] && jptr[k] < i; ++k) {
+				++_size_of_altr;
+			}
+		}
+
+		_iptr[_size] = _size_of_altr;
+
 		_altr = new T[_size_of_altr];
 		_autr = new T[_size_of_altr];
-		_iptr = new int[_size];
 		_jptr = new int[_size_of_altr];
 
-		for (int i = 0; i < _size; ++i) {
-			_adiag[i] = other._adiag[i];
-			_iptr[i] = other._iptr[i];
-		}
+		bool symmetric = true;
 
-		_iptr[_size] = other._iptr[_size];
+		for (int i = 0; i < _size && symmetric; ++i) {
+			int k = iptr[i];
+			int l = tiptr[i];
 
-		for (int i = 0; i < _size_of_altr; ++i) {
-			_altr[i] = other._altr[i];
-			_autr[i] = other._autr[i];
-			_jptr[i] = other._jptr[i];
+			for (int p = _iptr[i]; p < _iptr[i + 1]; ++p, ++k, ++l) {
+				if (l >= tiptr[i + 1] || tjptr[l] != jptr[k]) {
+					symmetric = false;
+					break;
+				}
+
+				_jptr[p] = jptr[k];
+				_altr[p] = aelem[k];
+				_autr[p] = taelem[l];
+			}
+
+			if (l < tiptr[i + 1] && tjptr[l] < i) {
+				symmetric = false;
+			}
+
+			if (k < iptr[i + 1] && jptr[k] == i) {
+				_adiag[i] = aelem[k];
+			}
+		}
+
+		if (!symmetric) {
+			release();
+			throw PortraitNotSymmetric();
 		}
 	}
 
+	/**
+	 * @brief Copies the data of CSLR matrix
+	 * from other CSLR matrix
+	 * 
+	 * @param other Reference to other CSLR matrix
+	 */
+	CSLR(const CSLR &other)
+	{
+		copy(other);
+	}
+
 	/**
 	 * @brief Deletes an instance of CSLR matrix
 	 */
 	~CSLR()
 	{
-		delete[] _adiag;
-		delete[] _altr;
-		delete[] _autr;
-		delete[] _iptr;
-		delete[] _jptr;
+		release();
 	}
 
 	/**
@@ -228,28 +478,12 @@ public:
 	 */
 	CSLR& operator= (const CSLR &other)
 	{
-		_size = other._size;
-		_size_of_altr = other._size_of_altr;
-		_eval = other._eval;
-
-		_adiag = new T[_size];
-		_altr = new T[_size_of_altr];
-		_autr = new T[_size_of_altr];
-		_iptr = new int[_size];
-		_jptr = new int[_size_of_altr];
-
-		for (int i = 0; i < _size; ++i) {
-			_adiag[i] = other._adiag[i];
-			_iptr[i] = other._iptr[i];
+		if (this == &other) {
+			return *this;
 		}
 
-		_iptr[_size] = other._iptr[_size];
-
-		for (int i = 0; i < _size_of_altr; ++i) {
-			_altr[i] = other._altr[i];
-			_autr[i] = other._autr[i];
-			_jptr[i] = other._jptr[i];
-		}
+		release();
+		copy(other);
 
 		return *this;
 	}
@@ -276,6 +510,7 @@ public:
 	/**
 	 * @brief Gets autr - an array of nonempty elements of
 	 * upper triangular matrix
+	 * @details In symmetric mode it is the same array as altr
 	 * @return autr array
 	 */
 	T* autr() const
@@ -322,6 +557,63 @@ public:
 		return _size_of_altr;
 	}
 
+	/**
+	 * @brief Checks if the matrix is in symmetric mode
+	 * (autr aliases altr)
+	 * @return True in symmetric mode
+	 */
+	bool symmetric() const
+	{
+		return _symmetric;
+	}
+
+	/**
+	 * @brief Checks if the values of matrix are symmetric
+	 * @details Compares altr and autr element by element
+	 * 
+	 * @param tol Allowed absolute difference
+	 * @return True if |altr[k] - autr[k]| <= tol for all k
+	 */
+	bool is_symmetric(T tol = 0) const
+	{
+		for (int k = 0; k < _size_of_altr; ++k) {
+			T diff = _altr[k] - _autr[k];
+
+			if (diff > tol || -diff > tol) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Switches the matrix to symmetric mode
+	 * @details The upper values are dropped and autr becomes an
+	 * alias of altr, which removes a third of the storage and of
+	 * the traffic of multiplication. Later changes of either
+	 * array apply to both triangles.
+	 * 
+	 * @param tol Allowed absolute difference between altr and autr
+	 * @return Reference to this matrix
+	 */
+	CSLR& make_symmetric(T tol = 0)
+	{
+		if (_symmetric) {
+			return *this;
+		}
+
+		if (!is_symmetric(tol)) {
+			throw ValuesNotSymmetric();
+		}
+
+		delete[] _autr;
+		_autr = _altr;
+		_symmetric = true;
+
+		return *this;
+	}
+
 	/**
 	 * @brief Inserts an element to the matrix
 	 * @details The space for this element should already
@@ -365,6 +657,176 @@ public:
 		}
 	}
 
+	/**
+	 * @brief Converts CSLR matrix to CSR format
+	 * @details Row i of the result holds the lower elements of
+	 * row i, the diagonal element (always stored) and the upper
+	 * elements of column i, in increasing order of columns.
+	 * 
+	 * @return CSR matrix
+	 */
+	CSR<T> to_csr() const
+	{
+		std::vector<int> iptr(_size + 1, 0);
+
+		for (int i = 0; i < _size; ++i) {
+			iptr[i + 1] += _iptr[i + 1] - _iptr[i] + 1;
+
+			for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+				++iptr[_jptr[k] + 1];
+			}
+		}
+
+		for (int i = 0; i < _size; ++i) {
+			iptr[i + 1] += iptr[i];
+		}
+
+		int nnz = iptr[_size];
+		std::vector<int> jptr(nnz);
+		std::vector<T> aelem(nnz);
+		std::vector<int> pos(iptr.begin(), iptr.end() - 1);
+
+		// Rows are visited in increasing order, so the upper
+		// elements appended to row j = jptr[k] are sorted too
+		for (int i = 0; i < _size; ++i) {
+			for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+				jptr[pos[i]] = _jptr[k];
+				aelem[pos[i]++] = _altr[k];
+			}
+
+			jptr[pos[i]] = i;
+			aelem[pos[i]++] = _adiag[i];
+
+			for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+				int j = _jptr[k];
+				jptr[pos[j]] = i;
+				aelem[pos[j]++] = _autr[k];
+			}
+		}
+
+		return CSR<T>(nnz ? &aelem[0] : 0, &iptr[0], nnz ? &jptr[0] : 0,
+					  _size, _size, nnz);
+	}
+
+	/**
+	 * @brief Copies the values of matrix into CSR matrix made by
+	 * to_csr() (of the same portrait)
+	 * @details Refreshes the values without building the portrait
+	 * again: every upper element (i, j) of the result is found in
+	 * row j by binary search. Nothing is allocated.
+	 *
+	 * @param res CSR matrix with the portrait of to_csr()
+	 */
+	void to_csr(CSR<T> &res) const
+	{
+		if (res.rows() != _size || res.cols() != _size ||
+			res.size_of_aelem() != _size + 2 * _size_of_altr) {
+			throw RefreshPatternMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("CSLR::to_csr",
+							 res.size_of_aelem() * (sizeof(T) + sizeof(int)) +
+							 (_size + 2LL * _size_of_altr) * sizeof(T));
+
+		const int *iptr = res.iptr();
+		const int *jptr = res.jptr();
+		T *aelem = res.aelem();
+
+		parallel_for(0, _size, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				int k = iptr[i];
+
+				for (int p = _iptr[i]; p < _iptr[i + 1]; ++p) {
+					aelem[k++] = _altr[p];
+				}
+
+				aelem[k++] = _adiag[i];
+
+				for (; k < iptr[i + 1]; ++k) {
+					int j = jptr[k];
+					const int *pos = std::lower_bound(
+						_jptr + _iptr[j], _jptr + _iptr[j + 1], i);
+
+					aelem[k] = _autr[pos - _jptr];
+				}
+			}
+		});
+	}
+
+	/**
+	 * @brief Multiplies CSLR matrix by Vector into existing Vector
+	 * @details Every thread takes a block of rows (of the same
+	 * number of lower elements). Row i sets res[i] and adds its
+	 * upper elements to res[j] with j < i: those of rows of the
+	 * same block go to res directly, the others go to a buffer of
+	 * the thread, which the owners of the rows add after a barrier
+	 * (in order of threads). Rows must have sorted column-indices
+	 * (as for SkylineLU). In symmetric mode every off-diagonal
+	 * value is loaded once and applied to both res[i] and
+	 * res[jptr[j]].
+	 * 
+	 * @param vec Given vector
+	 * @param res Result of multiplication
+	 */
+	void multiply(const Vector<T> &vec, Vector<T> &res) const
+	{
+		if (vec.size() != _size || res.size() != _size) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("CSLR::operator*", spmv_bytes());
+
+		const T *x = vec.data();
+		T *y = res.data();
+
+		int nthreads = num_threads();
+		std::vector<int> los(nthreads + 1, _size);
+		std::vector<int> firsts(nthreads, 0);
+		std::vector<T*> bufs(nthreads, (T*)0);
+		Barrier barrier;
+
+		parallel([&](int tid, int used) {
+			SPARSE_TRACE_SCOPE("CSLR::operator*");
+
+			int lo, hi;
+			nnz_range(_iptr, _size, tid, used, lo, hi);
+
+			// Leftmost column the rows of block reach
+			int first = lo;
+
+			for (int i = lo; i < hi; ++i) {
+				if (_iptr[i] < _iptr[i + 1]) {
+					first = std::min(first, _jptr[_iptr[i]]);
+				}
+			}
+
+			T *buf = scatter_scratch(lo - first);
+			std::fill(buf, buf + (lo - first), T());
+
+			los[tid] = lo;
+			firsts[tid] = first;
+			bufs[tid] = buf;
+
+			if (_symmetric) {
+				multiply_rows<true>(x, y, lo, hi, first, buf);
+			}
+			else {
+				multiply_rows<false>(x, y, lo, hi, first, buf);
+			}
+
+			barrier.wait(used);
+
+			for (int t = tid + 1; t < used; ++t) {
+				int from = std::max(lo, firsts[t]);
+				int to = std::min(hi, los[t]);
+
+				for (int j = from; j < to; ++j) {
+					y[j] += bufs[t][j - firsts[t]];
+				}
+			}
+		});
+	}
+
 	/**
 	 * @brief Multiplies CSLR matrix by vector.
 	 * @details Note that for large sparse matrices this
@@ -373,25 +835,417 @@ public:
 	 * @param vec Given vector
 	 * @return Result of multiplication
 	 */
-	Vector<T> operator* (const Vector<T> &vec)
+	Vector<T> operator* (const Vector<T> &vec) const
 	{
-		if (vec.size() != _size) {
-			throw MultSizeMismatch();
+		Vector<T> res(_size);
+		multiply(vec, res);
+		return res;
+	}
+
+	/**
+	 * @brief Multiplies all the elements of matrix by scalar value
+	 * 
+	 * @param alpha Scalar value
+	 * @return Reference to this matrix
+	 */
+	CSLR& scale(T alpha)
+	{
+		SPARSE_PROFILE_SCOPE("CSLR::scale",
+							 2LL * (_size + 2 * _size_of_altr) * sizeof(T));
+
+		parallel_for(0, _size, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				_adiag[i] *= alpha;
+			}
+		}, 4096);
+
+		parallel_for(0, _size_of_altr, [&](int lo, int hi) {
+			for (int k = lo; k < hi; ++k) {
+				_altr[k] *= alpha;
+			}
+
+			if (!_symmetric) {
+				for (int k = lo; k < hi; ++k) {
+					_autr[k] *= alpha;
+				}
+			}
+		}, 4096);
+
+		return *this;
+	}
+
+	/**
+	 * @brief Overwrites the values of matrix
+	 * @details The portrait (iptr and jptr) is kept, so everything
+	 * derived from it (plans, symbolic factorizations) stays
+	 * valid. Nothing is allocated. In symmetric mode autr must be
+	 * 0 or equal to altr, otherwise ValuesNotSymmetric is thrown
+	 * before anything is changed.
+	 *
+	 * @param adiag New diagonal (size() elements)
+	 * @param altr New lower values (size_of_altr() elements)
+	 * @param autr New upper values (0 - same as altr)
+	 * @return Reference to this matrix
+	 */
+	CSLR& set_values(const T *adiag, const T *altr, const T *autr = 0)
+	{
+		if (_symmetric && autr != 0 && autr != altr) {
+			for (int k = 0; k < _size_of_altr; ++k) {
+				if (altr[k] != autr[k]) {
+					throw ValuesNotSymmetric();
+				}
+			}
 		}
 
-		Vector<T> res(_size);
+		SPARSE_PROFILE_SCOPE("CSLR::set_values",
+							 2LL * (_size + 2 * _size_of_altr) * sizeof(T));
 
-		for (int i = 0; i < _size; ++i) {
-			res[i] = _adiag[i] * vec.get(i);
+		const T *upper = (autr != 0) ? autr : altr;
+
+		parallel_for(0, _size, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				_adiag[i] = adiag[i];
+			}
+		}, 4096);
+
+		parallel_for(0, _size_of_altr, [&](int lo, int hi) {
+			for (int k = lo; k < hi; ++k) {
+				_altr[k] = altr[k];
+			}
+
+			if (!_symmetric) {
+				for (int k = lo; k < hi; ++k) {
+					_autr[k] = upper[k];
+				}
+			}
+		}, 4096);
+
+		return *this;
+	}
+
+	/**
+	 * @brief Overwrites the values of matrix with the values of
+	 * CSR matrix of the same portrait
+	 * @details The portrait must be the one this matrix was made
+	 * from by CSLR(const CSR<T>&): sorted rows, the lower elements
+	 * of row i in the same order. Lower elements are copied in
+	 * order, every upper element (i, j) is found in row j by binary
+	 * search. Diagonal elements may be missing (they are zero
+	 * then), all the others must be present: the upper elements
+	 * are counted. Throws RefreshPatternMismatch (or
+	 * ValuesNotSymmetric in symmetric mode) when the portraits
+	 * (values) do not match; the values of matrix are undefined
+	 * then.
+	 *
+	 * @param mtrx CSR matrix
+	 * @return Reference to this matrix
+	 */
+	CSLR& set_values(const CSR<T> &mtrx)
+	{
+		if (mtrx.rows() != _size || mtrx.cols() != _size ||
+			mtrx.size_of_aelem() > _size + 2 * _size_of_altr) {
+			throw RefreshPatternMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("CSLR::set_values",
+							 mtrx.size_of_aelem() * (sizeof(T) + sizeof(int)) +
+							 (_size + 2LL * _size_of_altr) * sizeof(T));
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+
+		// 1 - other portrait, 2 - asymmetric values
+		std::atomic<int> error(0);
+		std::atomic<long long> upper(0);
+
+		parallel_for(0, _size, [&](int lo, int hi) {
+			long long count = 0;
+
+			for (int i = lo; i < hi; ++i) {
+				int k = iptr[i];
+
+				for (int p = _iptr[i]; p < _iptr[i + 1]; ++p, ++k) {
+					if (k >= iptr[i + 1] || jptr[k] != _jptr[p]) {
+						error = 1;
+						return;
+					}
+
+					_altr[p] = aelem[k];
+				}
+
+				_adiag[i] = 0;
+
+				if (k < iptr[i + 1] && jptr[k] == i) {
+					_adiag[i] = aelem[k++];
+				}
+
+				count += iptr[i + 1] - k;
+
+				for (; k < iptr[i + 1]; ++k) {
+					int j = jptr[k];
+					const int *first = _jptr + _iptr[j];
+					const int *last = _jptr + _iptr[j + 1];
+					const int *pos = std::lower_bound(first, last, i);
+
+					if (j <= i || pos == last || *pos != i) {
+						error = 1;
+						return;
+					}
+
+					if (!_symmetric) {
+						_autr[pos - _jptr] = aelem[k];
+						continue;
+					}
+
+					// Element (j, i) of CSR matrix
+					const int *rfirst = jptr + iptr[j];
+					const int *rlast = jptr + iptr[j + 1];
+					const int *rpos = std::lower_bound(rfirst, rlast, i);
+
+					if (rpos == rlast || *rpos != i) {
+						error = 1;
+						return;
+					}
+
+					if (aelem[rpos - jptr] != aelem[k]) {
+						error = 2;
+						return;
+					}
+				}
+			}
 
-			for (int j = _iptr[i]; j < _iptr[i + 1]; ++j) {
-				res[i] += _altr[j] * vec.get(_jptr[j]);
-				res[_jptr[j]] += _autr[j] * vec.get(i);
+			upper.fetch_add(count);
+		});
+
+		if (error.load() == 1) {
+			throw RefreshPatternMismatch();
+		}
+
+		if (error.load() == 2) {
+			throw ValuesNotSymmetric();
+		}
+
+		if (upper.load() != _size_of_altr) {
+			throw RefreshPatternMismatch();
+		}
+
+		return *this;
+	}
+
+	/**
+	 * @brief Checks if two matrices have the same portrait
+	 * (same iptr and jptr)
+	 * 
+	 * @param other Reference to other CSLR matrix
+	 * @return True if portraits are identical
+	 */
+	bool same_pattern(const CSLR &other) const
+	{
+		if (_size != other._size ||
+			_size_of_altr != other._size_of_altr) {
+			return false;
+		}
+
+		for (int i = 0; i <= _size; ++i) {
+			if (_iptr[i] != other._iptr[i]) {
+				return false;
+			}
+		}
+
+		for (int k = 0; k < _size_of_altr; ++k) {
+			if (_jptr[k] != other._jptr[k]) {
+				return false;
 			}
 		}
 
+		return true;
+	}
+
+	/**
+	 * @brief Computes alpha * this + beta * other in place
+	 * @details Fast path of addition for matrices with identical
+	 * portraits: only the values are touched. The portraits are
+	 * not compared (only sizes are), this is up to the caller
+	 * (see same_pattern()). This matrix leaves symmetric mode
+	 * unless other is symmetric too.
+	 * 
+	 * @param other Matrix with the same portrait
+	 * @param alpha Coefficient of this matrix
+	 * @param beta Coefficient of other matrix
+	 * @return Reference to this matrix
+	 */
+	CSLR& axpby(const CSLR &other, T alpha, T beta)
+	{
+		if (_size != other._size) {
+			throw AddSizeMismatch();
+		}
+
+		if (_size_of_altr != other._size_of_altr) {
+			throw AddPatternMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("CSLR::axpby",
+							 3LL * (_size + 2 * _size_of_altr) * sizeof(T));
+
+		if (!other._symmetric) {
+			unshare();
+		}
+
+		parallel_for(0, _size, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				_adiag[i] = alpha * _adiag[i] + beta * other._adiag[i];
+			}
+		}, 4096);
+
+		parallel_for(0, _size_of_altr, [&](int lo, int hi) {
+			for (int k = lo; k < hi; ++k) {
+				_altr[k] = alpha * _altr[k] + beta * other._altr[k];
+			}
+
+			if (!_symmetric) {
+				for (int k = lo; k < hi; ++k) {
+					_autr[k] = alpha * _autr[k] + beta * other._autr[k];
+				}
+			}
+		}, 4096);
+
+		return *this;
+	}
+
+	/**
+	 * @brief Computes alpha * a + beta * b
+	 * @details If the portraits of a and b are identical, the
+	 * values are simply combined (see axpby()). Otherwise the
+	 * portrait of the result is the union of portraits: sorted
+	 * rows of lower triangular matrices are merged (upper ones
+	 * follow them), first to count the elements of each row and
+	 * then to fill them. Both passes are linear and run in
+	 * parallel over rows. Column-indices in the rows of both
+	 * matrices must be sorted. The sum of two symmetric mode
+	 * matrices is in symmetric mode too.
+	 * 
+	 * @param a First matrix
+	 * @param b Second matrix
+	 * @param alpha Coefficient of a
+	 * @param beta Coefficient of b
+	 * @return Sum of matrices
+	 */
+	static CSLR add(const CSLR &a, const CSLR &b, T alpha = 1, T beta = 1)
+	{
+		if (a._size != b._size) {
+			throw AddSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("CSLR::add",
+							 2 * (a.spmv_bytes() + b.spmv_bytes()));
+
+		if (a.same_pattern(b)) {
+			CSLR res(a);
+			return res.axpby(b, alpha, beta);
+		}
+
+		CSLR res(a._size, 0, a._eval);
+
+		parallel_for(0, a._size, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				int ka = a._iptr[i];
+				int kb = b._iptr[i];
+				int count = 0;
+
+				while (ka < a._iptr[i + 1] && kb < b._iptr[i + 1]) {
+					if (a._jptr[ka] <= b._jptr[kb]) {
+						kb += (a._jptr[ka] == b._jptr[kb]);
+						++ka;
+					}
+					else {
+						++kb;
+					}
+					++count;
+				}
+
+				res._iptr[i + 1] = count + (a._iptr[i + 1] - ka) +
+										   (b._iptr[i + 1] - kb);
+				res._adiag[i] = alpha * a._adiag[i] + beta * b._adiag[i];
+			}
+		}, 256);
+
+		res._iptr[0] = 0;
+
+		for (int i = 0; i < a._size; ++i) {
+			res._iptr[i + 1] += res._iptr[i];
+		}
+
+		res._size_of_altr = res._iptr[a._size];
+
+		// Upper values of symmetric mode matrices are the lower
+		// ones, so the merge below writes them twice, identically
+		delete[] res._altr;
+		delete[] res._autr;
+		delete[] res._jptr;
+		res._symmetric = a._symmetric && b._symmetric;
+		res._altr = new T[res._size_of_altr];
+		res._autr = res._symmetric ? res._altr : new T[res._size_of_altr];
+		res._jptr = new int[res._size_of_altr];
+
+		parallel_for(0, a._size, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				int ka = a._iptr[i];
+				int kb = b._iptr[i];
+				int k = res._iptr[i];
+
+				while (ka < a._iptr[i + 1] && kb < b._iptr[i + 1]) {
+					if (a._jptr[ka] < b._jptr[kb]) {
+						res._jptr[k] = a._jptr[ka];
+						res._altr[k] = alpha * a._altr[ka];
+						res._autr[k++] = alpha * a._autr[ka++];
+					}
+					else if (a._jptr[ka] > b._jptr[kb]) {
+						res._jptr[k] = b._jptr[kb];
+						res._altr[k] = beta * b._altr[kb];
+						res._autr[k++] = beta * b._autr[kb++];
+					}
+					else {
+						res._jptr[k] = a._jptr[ka];
+						res._altr[k] = alpha * a._altr[ka] + beta * b._altr[kb];
+						res._autr[k++] = alpha * a._autr[ka++] +
+										 beta * b._autr[kb++];
+					}
+				}
+
+				for (; ka < a._iptr[i + 1]; ++ka) {
+					res._jptr[k] = a._jptr[ka];
+					res._altr[k] = alpha * a._altr[ka];
+					res._autr[k++] = alpha * a._autr[ka];
+				}
+
+				for (; kb < b._iptr[i + 1]; ++kb) {
+					res._jptr[k] = b._jptr[kb];
+					res._altr[k] = beta * b._altr[kb];
+					res._autr[k++] = beta * b._autr[kb];
+				}
+			}
+		}, 256);
+
 		return res;
 	}
 };
 
+/**
+ * @brief Computes alpha * a + beta * b for CSLR matrices
+ * @details See CSLR::add()
+ * 
+ * @param a First matrix
+ * @param b Second matrix
+ * @param alpha Coefficient of a
+ * @param beta Coefficient of b
+ * @tparam T Type of data stored in matrices
+ * @return Sum of matrices
+ */
+template <typename T>
+CSLR<T> add(const CSLR<T> &a, const CSLR<T> &b, T alpha = 1, T beta = 1)
+{
+	return CSLR<T>::add(a, b, alpha, beta);
+}
+
 #endif // CSLR_H
\ No newline at end of file
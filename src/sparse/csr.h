@@ -2,8 +2,36 @@
 #define CSR_H
 
 #include <vector>
+#include <chrono>
 
+#include "vector.h"
 #include "exception.h"
+#include "parallel.h"
+#include "numa.h"
+#include "accumulator.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Statistics of sparse matrix-matrix multiplication
+ * @details Filled by CSR::multiply(const CSR&, SpGEMMInfo*)
+ */
+struct SpGEMMInfo
+{
+    double symbolic_time;   // seconds
+    double numeric_time;    // seconds
+    long long flops;        // number of multiply-add operations
+    int nnz;                // number of nonempty elements of result
+
+    /**
+     * @brief Gets the throughput of multiplication
+     * @return Nonempty elements of result per second
+     */
+    double nnz_per_second() const
+    {
+        return nnz / (symbolic_time + numeric_time);
+    }
+};
 
 /**
  * @brief CSR - Compressed Sparse Row.
@@ -31,6 +59,71 @@ class CSR
 
     T _eval;
 
+    /**
+     * @brief Creates an instance of uninitialized CSR matrix
+     * @details Only allocates memory for iptr, jptr and aelem.
+     * Used by the kernels that build a new matrix themselves
+     * (e.g. transpose)
+     * 
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param size_of_aelem Number of nonempty elements
+     * @param eval Empty value
+     */
+    CSR(int rows, int cols, int size_of_aelem, T eval)
+    {
+        _rows = rows;
+        _cols = cols;
+        _size_of_aelem = size_of_aelem;
+        _eval = eval;
+
+        _aelem = numa_alloc<T>(_size_of_aelem);
+        _iptr = numa_alloc<int>(_rows + 1);
+        _jptr = numa_alloc<int>(_size_of_aelem);
+    }
+
+    /**
+     * @brief Estimates the number of bytes streamed by
+     * the multiplication by vector
+     * @return Size of matrix plus sizes of both vectors
+     */
+    long long spmv_bytes() const
+    {
+        return (long long)_size_of_aelem * (sizeof(T) + sizeof(int)) +
+               (long long)(_rows + 1) * sizeof(int) +
+               (long long)(_rows + _cols) * sizeof(T);
+    }
+
+    /**
+     * @brief Finds where the merge path crosses given diagonal
+     * @details Returns the point (row, element) with
+     * row + element = diag, such that all the rows before row
+     * end at or before element
+     * 
+     * @param diag Index of diagonal (0 to rows + size_of_aelem)
+     * @param row Number of finished rows
+     * @param elem Number of consumed elements
+     */
+    void merge_path_search(long long diag, int &row, int &elem) const
+    {
+        int lo = (diag > _size_of_aelem) ? (int)(diag - _size_of_aelem) : 0;
+        int hi = (diag < _rows) ? (int)diag : _rows;
+
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+
+            if (_iptr[mid + 1] <= diag - mid - 1) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+
+        row = lo;
+        elem = (int)(diag - lo);
+    }
+
 public:
     /**
      * @brief Creates an instance of CSR sparse matrix
@@ -49,7 +142,7 @@ public:
         _cols = (cols == 0) ? rows : cols;
         _eval = 0;
 
-        _iptr = new int[_rows + 1];
+        _iptr = numa_alloc<int>(_rows + 1);
         int *jptr_buff = new int[_rows * _cols];
 
         _size_of_aelem = 0;
@@ -66,8 +159,8 @@ public:
 
         _iptr[_rows] = _size_of_aelem;
 
-        _jptr = new int[_size_of_aelem];
-        _aelem = new T[_size_of_aelem];
+        _jptr = numa_alloc<int>(_size_of_aelem);
+        _aelem = numa_alloc<T>(_size_of_aelem);
 
         for (int i = 1; i <= _rows; ++i) {
             for (int k = _iptr[i - 1]; k < _iptr[i]; ++k) {
@@ -92,20 +185,13 @@ public:
         _size_of_aelem = other._size_of_aelem;
         _eval = other._eval;
 
-        _aelem = new T[_size_of_aelem];
-        _iptr = new int[_rows];
-        _jptr = new int[_size_of_aelem];
+        _aelem = numa_alloc<T>(_size_of_aelem);
+        _iptr = numa_alloc<int>(_rows + 1);
+        _jptr = numa_alloc<int>(_size_of_aelem);
 
-        for (int i = 0; i < _rows; ++i) {
-            _iptr[i] = other._iptr[i];
-        }
-
-        _iptr[_rows] = other._iptr[_rows];
-
-        for (int i = 0; i < _size_of_aelem; ++i) {
-            _aelem[i] = other._aelem[i];
-            _jptr[i] = other._jptr[i];
-        }
+        numa_copy(_iptr, other._iptr, _rows + 1);
+        numa_copy(_aelem, other._aelem, _size_of_aelem);
+        numa_copy(_jptr, other._jptr, _size_of_aelem);
     }
 
     /**
@@ -130,20 +216,13 @@ public:
         _size_of_aelem = size_of_aelem;
         _eval = eval;
 
-        _aelem = new T[_size_of_aelem];
-        _iptr = new int[_rows];
-        _jptr = new int[_size_of_aelem];
+        _aelem = numa_alloc<T>(_size_of_aelem);
+        _iptr = numa_alloc<int>(_rows + 1);
+        _jptr = numa_alloc<int>(_size_of_aelem);
 
-        for (int i = 0; i < _rows; ++i) {
-            _iptr[i] = iptr[i];
-        }
-
-        _iptr[_rows] = iptr[_rows];
-
-        for (int i = 0; i < _size_of_aelem; ++i) {
-            _aelem[i] = aelem[i];
-            _jptr[i] = jptr[i];
-        }
+        numa_copy(_iptr, iptr, _rows + 1);
+        numa_copy(_aelem, aelem, _size_of_aelem);
+        numa_copy(_jptr, jptr, _size_of_aelem);
     }
 
     /**
@@ -166,7 +245,7 @@ public:
         _cols = cols;
         _eval = eval;
 
-        _iptr = new int[_rows + 1];
+        _iptr = numa_alloc<int>(_rows + 1);
 
         _size_of_aelem = 0;
 
@@ -177,8 +256,8 @@ public:
 
         _iptr[_rows] = _size_of_aelem;
 
-        _aelem = new T[_size_of_aelem];
-        _jptr = new int[_size_of_aelem];
+        _aelem = numa_alloc<T>(_size_of_aelem);
+        _jptr = numa_alloc<int>(_size_of_aelem);
 
         for (int i = 0; i < _size_of_aelem; ++i) {
             _aelem[i] = 0;
@@ -205,25 +284,26 @@ public:
      */
     CSR& operator= (const CSR &other)
     {
+        if (this == &other) {
+            return *this;
+        }
+
+        delete[] _aelem;
+        delete[] _iptr;
+        delete[] _jptr;
+
         _rows = other._rows;
         _cols = other._cols;
         _size_of_aelem = other._size_of_aelem;
         _eval = other._eval;
 
-        _aelem = new T[_size_of_aelem];
-        _iptr = new int[_rows];
-        _jptr = new int[_size_of_aelem];
-
-        for (int i = 0; i < _rows; ++i) {
-            _iptr[i] = other._iptr[i];
-        }
-
-        _iptr[_rows] = other._iptr[_rows];
+        _aelem = numa_alloc<T>(_size_of_aelem);
+        _iptr = numa_alloc<int>(_rows + 1);
+        _jptr = numa_alloc<int>(_size_of_aelem);
 
-        for (int i = 0; i < _size_of_aelem; ++i) {
-            _aelem[i] = other._aelem[i];
-            _jptr[i] = other._jptr[i];
-        }
+        numa_copy(_iptr, other._iptr, _rows + 1);
+        numa_copy(_aelem, other._aelem, _size_of_aelem);
+        numa_copy(_jptr, other._jptr, _size_of_aelem);
 
         return *this;
     }
@@ -286,6 +366,15 @@ public:
         return _size_of_aelem;
     }
 
+    /**
+	 * @brief Gets the empty value of matrix
+	 * @return Empty value
+	 */
+    T eval() const
+    {
+        return _eval;
+    }
+
     /**
      * @brief Inserts an element to the matrix
      * @details The space for this element should already
@@ -326,6 +415,8 @@ public:
             throw MultSizeMismatch();
         }
 
+        SPARSE_PROFILE_SCOPE("CSR::operator*", spmv_bytes());
+
         std::vector<T> res(_rows);
 
         for (int i = 0; i < _rows; ++i) {
@@ -338,6 +429,661 @@ public:
 
         return res;
     }
+
+    /**
+     * @brief Multiplies CSR matrix by Vector.
+     * @details Rows are processed in parallel, every thread gets
+     * the same number of nonempty elements (see nnz_range()), so
+     * it reads the part of matrix it placed on its NUMA node.
+     * 
+     * @param vec Given vector
+     * @return Result of multiplication
+     */
+    Vector<T> operator* (const Vector<T> &vec) const
+    {
+        Vector<T> res(_rows);
+        multiply(vec, res);
+        return res;
+    }
+
+    /**
+     * @brief Multiplies CSR matrix by Vector into existing Vector.
+     * @details See operator*(const Vector<T>&)
+     * 
+     * @param vec Given vector (of size cols)
+     * @param res Result of multiplication (of size rows)
+     */
+    void multiply(const Vector<T> &vec, Vector<T> &res) const
+    {
+        if (vec.size() != _cols || res.size() != _rows) {
+            throw MultSizeMismatch();
+        }
+
+        SPARSE_PROFILE_SCOPE("CSR::operator*", spmv_bytes());
+
+        const T *x = vec.data();
+        T *y = res.data();
+
+        parallel([&](int tid, int nthreads) {
+            SPARSE_TRACE_SCOPE("CSR::operator*");
+
+            int lo, hi;
+            nnz_range(_iptr, _rows, tid, nthreads, lo, hi);
+
+            for (int i = lo; i < hi; ++i) {
+                T sum = _eval;
+
+                for (int j = _iptr[i]; j < _iptr[i + 1]; ++j) {
+                    sum += _aelem[j] * x[_jptr[j]];
+                }
+
+                y[i] = sum;
+            }
+        });
+    }
+
+    /**
+     * @brief Multiplies CSR matrix by Vector with merge-path
+     * partitioning.
+     * @details The work is seen as a path that merges the list of
+     * row ends with the list of nonempty elements: every step
+     * either consumes an element or finishes a row. The path is
+     * split into equal parts by binary search along diagonals,
+     * so every thread gets the same amount of work even when a
+     * few rows hold most of the elements. A row split between
+     * threads is finished by the last of them; the others carry
+     * their partial sums out, and the sums are added afterwards.
+     * Prefer it to operator* for matrices with highly skewed row
+     * lengths (e.g. power-law graphs).
+     * 
+     * @param vec Given vector
+     * @return Result of multiplication
+     */
+    Vector<T> multiply_merge_path(const Vector<T> &vec) const
+    {
+        Vector<T> res(_rows);
+        multiply_merge_path(vec, res);
+        return res;
+    }
+
+    /**
+     * @brief Multiplies CSR matrix by Vector with merge-path
+     * partitioning into existing Vector.
+     * @details See multiply_merge_path(const Vector<T>&)
+     * 
+     * @param vec Given vector (of size cols)
+     * @param res Result of multiplication (of size rows)
+     */
+    void multiply_merge_path(const Vector<T> &vec, Vector<T> &res) const
+    {
+        if (vec.size() != _cols || res.size() != _rows) {
+            throw MultSizeMismatch();
+        }
+
+        SPARSE_PROFILE_SCOPE("CSR::multiply_merge_path", spmv_bytes());
+
+        const T *x = vec.data();
+        T *y = res.data();
+
+        int nthreads = num_threads();
+        std::vector<int> carry_row(nthreads, _rows);
+        std::vector<T> carry_val(nthreads, 0);
+        int used = 1;
+
+        parallel([&](int tid, int n) {
+            SPARSE_TRACE_SCOPE("CSR::multiply_merge_path");
+
+            if (tid == 0) {
+                used = n;
+            }
+
+            long long total = (long long)_rows + _size_of_aelem;
+            int i, k, i_end, k_end;
+
+            merge_path_search(total * tid / n, i, k);
+            merge_path_search(total * (tid + 1) / n, i_end, k_end);
+
+            T sum = 0;
+
+            for (; i < i_end; ++i) {
+                for (; k < _iptr[i + 1]; ++k) {
+                    sum += _aelem[k] * x[_jptr[k]];
+                }
+
+                y[i] = sum + _eval;
+                sum = 0;
+            }
+
+            for (; k < k_end; ++k) {
+                sum += _aelem[k] * x[_jptr[k]];
+            }
+
+            carry_row[tid] = i_end;
+            carry_val[tid] = sum;
+        });
+
+        for (int t = 0; t < used; ++t) {
+            if (carry_row[t] < _rows) {
+                y[carry_row[t]] += carry_val[t];
+            }
+        }
+    }
+
+    /**
+     * @brief Multiplies transposed CSR matrix by vector.
+     * @details Computes A^T * vec without building the transposed
+     * matrix. Each thread scatters the contributions of its rows
+     * into a private buffer, then the buffers are summed up
+     * column-wise. Prefer transpose() when the same A^T is
+     * going to be applied many times.
+     * 
+     * @param vec Given vector (of size rows)
+     * @return Result of multiplication (of size cols)
+     */
+    std::vector<T> multiply_transpose(const std::vector<T> &vec) const
+    {
+        if (vec.size() != _rows) {
+            throw MultSizeMismatch();
+        }
+
+        SPARSE_PROFILE_SCOPE("CSR::multiply_transpose", spmv_bytes());
+
+        int nthreads = num_threads();
+        T *buff = new T[(size_t)nthreads * _cols];
+        std::vector<T> res(_cols);
+
+        Barrier barrier;
+
+        parallel([&](int tid, int used) {
+            T *own = buff + (size_t)tid * _cols;
+
+            for (int j = 0; j < _cols; ++j) {
+                own[j] = 0;
+            }
+
+            int lo, hi;
+            nnz_range(_iptr, _rows, tid, used, lo, hi);
+
+            for (int i = lo; i < hi; ++i) {
+                for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+                    own[_jptr[k]] += _aelem[k] * vec[i];
+                }
+            }
+
+            barrier.wait(used);
+            ThreadPool::range(_cols, tid, used, lo, hi);
+
+            for (int j = lo; j < hi; ++j) {
+                res[j] = _eval;
+
+                for (int t = 0; t < used; ++t) {
+                    res[j] += buff[(size_t)t * _cols + j];
+                }
+            }
+        });
+
+        delete[] buff;
+        return res;
+    }
+
+    /**
+     * @brief Builds the transposed CSR matrix
+     * @details Counting sort of the elements by their column-indices.
+     * Every thread counts the columns of its own block of rows, the
+     * counters are turned into write positions by a prefix sum and
+     * then every thread places its elements independently. Rows of
+     * the result have sorted column-indices. Since CSR of A^T is CSC
+     * of A this can also be used as a CSR to CSC conversion.
+     * 
+     * @return Transposed matrix
+     */
+    CSR transpose() const
+    {
+        SPARSE_PROFILE_SCOPE("CSR::transpose", 2 * spmv_bytes());
+
+        int nthreads = num_threads();
+        int *pos = new int[(size_t)nthreads * _cols];
+
+        CSR res(_cols, _rows, _size_of_aelem, _eval);
+
+        Barrier barrier;
+
+        parallel([&](int tid, int used) {
+            int *own = pos + (size_t)tid * _cols;
+
+            for (int j = 0; j < _cols; ++j) {
+                own[j] = 0;
+            }
+
+            // Both loops below must see the same static partition
+            // of rows, so they are kept in one region
+            int lo, hi;
+            nnz_range(_iptr, _rows, tid, used, lo, hi);
+
+            for (int i = lo; i < hi; ++i) {
+                for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+                    ++own[_jptr[k]];
+                }
+            }
+
+            barrier.wait(used);
+
+            if (tid == 0) {
+                int offset = 0;
+
+                for (int j = 0; j < _cols; ++j) {
+                    res._iptr[j] = offset;
+
+                    for (int t = 0; t < used; ++t) {
+                        int count = pos[(size_t)t * _cols + j];
+                        pos[(size_t)t * _cols + j] = offset;
+                        offset += count;
+                    }
+                }
+
+                res._iptr[_cols] = offset;
+            }
+
+            barrier.wait(used);
+
+            for (int i = lo; i < hi; ++i) {
+                for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+                    int p = own[_jptr[k]]++;
+                    res._jptr[p] = i;
+                    res._aelem[p] = _aelem[k];
+                }
+            }
+        });
+
+        delete[] pos;
+        return res;
+    }
+
+    /**
+     * @brief Multiplies CSR matrix by other CSR matrix.
+     * @details See multiply(const CSR&, SpGEMMInfo*)
+     * 
+     * @param other Right-hand operand
+     * @return Result of multiplication
+     */
+    CSR operator* (const CSR &other) const
+    {
+        return multiply(other);
+    }
+
+    /**
+     * @brief Multiplies CSR matrix by other CSR matrix.
+     * @details Row-by-row Gustavson algorithm in two phases.
+     * The symbolic phase counts the nonempty elements of every
+     * row of the result, which allows to allocate it exactly.
+     * The numeric phase computes the values. Both phases run
+     * in parallel over rows, each thread with its own
+     * RowAccumulator, which works with a dense array for dense
+     * rows and with a hash table for sparse ones.
+     * Rows of the result have sorted column-indices.
+     * 
+     * @param other Right-hand operand
+     * @param info If not null, receives timings and throughput
+     * @return Result of multiplication
+     */
+    CSR multiply(const CSR &other, SpGEMMInfo *info = 0) const
+    {
+        if (_cols != other._rows) {
+            throw MultSizeMismatch();
+        }
+
+        SPARSE_PROFILE_SCOPE("CSR::multiply(CSR)",
+                             spmv_bytes() + other.spmv_bytes());
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
+        CSR res(_rows, other._cols, 0, _eval);
+
+        // Accumulators are created lazily by the threads that use
+        // them and are shared by both phases
+        int nthreads = num_threads();
+        std::vector< RowAccumulator<T>* > accs(nthreads, 0);
+        std::vector<long long> flops(nthreads, 0);
+
+        parallel_for(0, _rows, [&](int lo, int hi) {
+            int tid = thread_id();
+
+            if (accs[tid] == 0) {
+                accs[tid] = new RowAccumulator<T>(other._cols);
+            }
+
+            RowAccumulator<T> &acc = *accs[tid];
+
+            for (int i = lo; i < hi; ++i) {
+                int bound = 0;
+
+                for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+                    bound += other._iptr[_jptr[k] + 1] - other._iptr[_jptr[k]];
+                }
+
+                acc.start(bound);
+                flops[tid] += bound;
+
+                for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+                    int row = _jptr[k];
+
+                    for (int l = other._iptr[row]; l < other._iptr[row + 1]; ++l) {
+                        acc.insert(other._jptr[l]);
+                    }
+                }
+
+                res._iptr[i + 1] = acc.count();
+            }
+        }, 64);
+
+        res._iptr[0] = 0;
+
+        for (int i = 0; i < _rows; ++i) {
+            res._iptr[i + 1] += res._iptr[i];
+        }
+
+        res._size_of_aelem = res._iptr[_rows];
+
+        delete[] res._aelem;
+        delete[] res._jptr;
+        res._aelem = numa_alloc<T>(res._size_of_aelem);
+        res._jptr = numa_alloc<int>(res._size_of_aelem);
+
+        std::chrono::steady_clock::time_point middle =
+            std::chrono::steady_clock::now();
+
+        parallel_for(0, _rows, [&](int lo, int hi) {
+            int tid = thread_id();
+
+            if (accs[tid] == 0) {
+                accs[tid] = new RowAccumulator<T>(other._cols);
+            }
+
+            RowAccumulator<T> &acc = *accs[tid];
+
+            for (int i = lo; i < hi; ++i) {
+                acc.start(res._iptr[i + 1] - res._iptr[i]);
+
+                for (int k = _iptr[i]; k < _iptr[i + 1]; ++k) {
+                    int row = _jptr[k];
+
+                    for (int l = other._iptr[row]; l < other._iptr[row + 1]; ++l) {
+                        acc.add(other._jptr[l], _aelem[k] * other._aelem[l]);
+                    }
+                }
+
+                acc.gather(res._jptr + res._iptr[i], res._aelem + res._iptr[i]);
+            }
+        }, 64);
+
+        long long total = 0;
+
+        for (int t = 0; t < nthreads; ++t) {
+            total += flops[t];
+            delete accs[t];
+        }
+
+        if (info != 0) {
+            std::chrono::steady_clock::time_point end =
+                std::chrono::steady_clock::now();
+
+            info->symbolic_time =
+                std::chrono::duration<double>(middle - start).count();
+            info->numeric_time =
+                std::chrono::duration<double>(end - middle).count();
+            info->flops = total;
+            info->nnz = res._size_of_aelem;
+        }
+
+        return res;
+    }
+
+    /**
+     * @brief Multiplies all the elements of matrix by scalar value
+     * 
+     * @param alpha Scalar value
+     * @return Reference to this matrix
+     */
+    CSR& scale(T alpha)
+    {
+        SPARSE_PROFILE_SCOPE("CSR::scale",
+                             2LL * _size_of_aelem * sizeof(T));
+
+        parallel_for(0, _size_of_aelem, [&](int lo, int hi) {
+            for (int k = lo; k < hi; ++k) {
+                _aelem[k] *= alpha;
+            }
+        }, 4096);
+
+        return *this;
+    }
+
+    /**
+     * @brief Overwrites the values of matrix
+     * @details The portrait (iptr and jptr) is kept, so everything
+     * derived from it (plans, symbolic factorizations) stays
+     * valid. Nothing is allocated.
+     *
+     * @param aelem New values in the order of storage
+     * (size_of_aelem() elements)
+     * @return Reference to this matrix
+     */
+    CSR& set_values(const T *aelem)
+    {
+        SPARSE_PROFILE_SCOPE("CSR::set_values",
+                             2LL * _size_of_aelem * sizeof(T));
+
+        parallel_for(0, _size_of_aelem, [&](int lo, int hi) {
+            for (int k = lo; k < hi; ++k) {
+                _aelem[k] = aelem[k];
+            }
+        }, 4096);
+
+        return *this;
+    }
+
+    /**
+     * @brief Overwrites the values of matrix with the values of
+     * other matrix of the same portrait
+     * @details Throws RefreshPatternMismatch unless the portraits
+     * are identical (see same_pattern())
+     *
+     * @param other Matrix with the same portrait
+     * @return Reference to this matrix
+     */
+    CSR& set_values(const CSR &other)
+    {
+        if (!same_pattern(other)) {
+            throw RefreshPatternMismatch();
+        }
+
+        return set_values(other._aelem);
+    }
+
+    /**
+     * @brief Checks if two matrices have the same portrait
+     * (same iptr and jptr)
+     * 
+     * @param other Reference to other CSR matrix
+     * @return True if portraits are identical
+     */
+    bool same_pattern(const CSR &other) const
+    {
+        if (_rows != other._rows || _cols != other._cols ||
+            _size_of_aelem != other._size_of_aelem) {
+            return false;
+        }
+
+        for (int i = 0; i <= _rows; ++i) {
+            if (_iptr[i] != other._iptr[i]) {
+                return false;
+            }
+        }
+
+        for (int k = 0; k < _size_of_aelem; ++k) {
+            if (_jptr[k] != other._jptr[k]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Computes alpha * this + beta * other in place
+     * @details Fast path of addition for matrices with identical
+     * portraits: only the values are touched. The portraits are
+     * not compared (only sizes are), this is up to the caller
+     * (see same_pattern()).
+     * 
+     * @param other Matrix with the same portrait
+     * @param alpha Coefficient of this matrix
+     * @param beta Coefficient of other matrix
+     * @return Reference to this matrix
+     */
+    CSR& axpby(const CSR &other, T alpha, T beta)
+    {
+        if (_rows != other._rows || _cols != other._cols) {
+            throw AddSizeMismatch();
+        }
+
+        if (_size_of_aelem != other._size_of_aelem) {
+            throw AddPatternMismatch();
+        }
+
+        SPARSE_PROFILE_SCOPE("CSR::axpby",
+                             3LL * _size_of_aelem * sizeof(T));
+
+        parallel_for(0, _size_of_aelem, [&](int lo, int hi) {
+            for (int k = lo; k < hi; ++k) {
+                _aelem[k] = alpha * _aelem[k] + beta * other._aelem[k];
+            }
+        }, 4096);
+
+        return *this;
+    }
+
+    /**
+     * @brief Computes alpha * a + beta * b
+     * @details If the portraits of a and b are identical, the
+     * values are simply combined (see axpby()). Otherwise the
+     * portrait of the result is the union of portraits: sorted
+     * rows of a and b are merged, first to count the elements of
+     * each row and then to fill them. Both passes are linear and
+     * run in parallel over rows. Column-indices in the rows of
+     * both matrices must be sorted.
+     * 
+     * @param a First matrix
+     * @param b Second matrix
+     * @param alpha Coefficient of a
+     * @param beta Coefficient of b
+     * @return Sum of matrices
+     */
+    static CSR add(const CSR &a, const CSR &b, T alpha = 1, T beta = 1)
+    {
+        if (a._rows != b._rows || a._cols != b._cols) {
+            throw AddSizeMismatch();
+        }
+
+        SPARSE_PROFILE_SCOPE("CSR::add",
+                             2 * (a.spmv_bytes() + b.spmv_bytes()));
+
+        if (a.same_pattern(b)) {
+            CSR res(a);
+            return res.axpby(b, alpha, beta);
+        }
+
+        CSR res(a._rows, a._cols, 0, a._eval);
+
+        parallel_for(0, a._rows, [&](int lo, int hi) {
+            for (int i = lo; i < hi; ++i) {
+                int ka = a._iptr[i];
+                int kb = b._iptr[i];
+                int count = 0;
+
+                while (ka < a._iptr[i + 1] && kb < b._iptr[i + 1]) {
+                    if (a._jptr[ka] <= b._jptr[kb]) {
+                        kb += (a._jptr[ka] == b._jptr[kb]);
+                        ++ka;
+                    }
+                    else {
+                        ++kb;
+                    }
+                    ++count;
+                }
+
+                res._iptr[i + 1] = count + (a._iptr[i + 1] - ka) +
+                                           (b._iptr[i + 1] - kb);
+            }
+        }, 256);
+
+        res._iptr[0] = 0;
+
+        for (int i = 0; i < a._rows; ++i) {
+            res._iptr[i + 1] += res._iptr[i];
+        }
+
+        res._size_of_aelem = res._iptr[a._rows];
+
+        delete[] res._aelem;
+        delete[] res._jptr;
+        res._aelem = numa_alloc<T>(res._size_of_aelem);
+        res._jptr = numa_alloc<int>(res._size_of_aelem);
+
+        parallel_for(0, a._rows, [&](int lo, int hi) {
+            for (int i = lo; i < hi; ++i) {
+                int ka = a._iptr[i];
+                int kb = b._iptr[i];
+                int k = res._iptr[i];
+
+                while (ka < a._iptr[i + 1] && kb < b._iptr[i + 1]) {
+                    if (a._jptr[ka] < b._jptr[kb]) {
+                        res._jptr[k] = a._jptr[ka];
+                        res._aelem[k++] = alpha * a._aelem[ka++];
+                    }
+                    else if (a._jptr[ka] > b._jptr[kb]) {
+                        res._jptr[k] = b._jptr[kb];
+                        res._aelem[k++] = beta * b._aelem[kb++];
+                    }
+                    else {
+                        res._jptr[k] = a._jptr[ka];
+                        res._aelem[k++] = alpha * a._aelem[ka++] +
+                                          beta * b._aelem[kb++];
+                    }
+                }
+
+                for (; ka < a._iptr[i + 1]; ++ka) {
+                    res._jptr[k] = a._jptr[ka];
+                    res._aelem[k++] = alpha * a._aelem[ka];
+                }
+
+                for (; kb < b._iptr[i + 1]; ++kb) {
+                    res._jptr[k] = b._jptr[kb];
+                    res._aelem[k++] = beta * b._aelem[kb];
+                }
+            }
+        }, 256);
+
+        return res;
+    }
 };
 
+/**
+ * @brief Computes alpha * a + beta * b for CSR matrices
+ * @details See CSR::add()
+ * 
+ * @param a First matrix
+ * @param b Second matrix
+ * @param alpha Coefficient of a
+ * @param beta Coefficient of b
+ * @tparam T Type of data stored in matrices
+ * @return Sum of matrices
+ */
+template <typename T>
+CSR<T> add(const CSR<T> &a, const CSR<T> &b, T alpha = 1, T beta = 1)
+{
+    return CSR<T>::add(a, b, alpha, beta);
+}
+
 #endif // CSR_H
\ No newline at end of file
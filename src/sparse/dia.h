@@ -0,0 +1,335 @@
+#ifndef DIA_H
+#define DIA_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "vector.h"
+#include "csr.h"
+#include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Rows multiplied at once by DIA kernel: the block of y
+ * stays in L1 while all the diagonals pass over it
+ */
+const int DIA_ROW_BLOCK = 512;
+
+/**
+ * @brief DIA - Diagonal storage format.
+ * @details Meant for matrices of structured grids, whose
+ * nonempty elements lie on a few diagonals. Every such diagonal
+ * is stored densely, so no column-indices are kept at all:
+ * - offsets - offset j - i of every stored diagonal (sorted)
+ * - data - diagonal after diagonal, rows elements each: element
+ *   (i, i + offsets[d]) is data[d * rows + i]; the positions
+ *   outside of matrix are padded with zeros
+ *
+ * The inner loop of multiplication reads data, x and y
+ * contiguously and is vectorized by the compiler.
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class DIA
+{
+	int _rows;
+	int _cols;
+	int _ndiag;
+	long long _nnz;
+	T _eval;
+
+	int *_offsets;
+	T *_data;
+
+	DIA(const DIA &);
+	DIA& operator= (const DIA &);
+
+	/**
+	 * @brief Finds the offsets of nonempty diagonals
+	 *
+	 * @param mtrx CSR matrix
+	 * @return Sorted offsets
+	 */
+	static std::vector<int> find_offsets(const CSR<T> &mtrx)
+	{
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		int rows = mtrx.rows();
+
+		// Offset j - i lies in [-(rows - 1), cols - 1]
+		std::vector<char> used(rows + mtrx.cols(), 0);
+		std::vector<int> offsets;
+
+		for (int i = 0; i < rows; ++i) {
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				int pos = jptr[k] - i + rows;
+
+				if (!used[pos]) {
+					used[pos] = 1;
+					offsets.push_back(jptr[k] - i);
+				}
+			}
+		}
+
+		std::sort(offsets.begin(), offsets.end());
+		return offsets;
+	}
+
+public:
+	/**
+	 * @brief Gets the fill ratio of DIA storage of matrix
+	 * @details Stored elements (with padding) per nonempty one
+	 *
+	 * @param mtrx CSR matrix
+	 * @return Fill ratio
+	 */
+	static double fill(const CSR<T> &mtrx)
+	{
+		if (mtrx.size_of_aelem() == 0) {
+			return 1;
+		}
+
+		return (double)find_offsets(mtrx).size() * mtrx.rows() /
+			   mtrx.size_of_aelem();
+	}
+
+	/**
+	 * @brief Creates an instance of DIA matrix from CSR matrix
+	 * @details Throws FillInExceeded if the diagonals would
+	 * hold more than max_fill elements per nonempty one
+	 * (e.g. for unstructured matrices)
+	 *
+	 * @param mtrx CSR matrix
+	 * @param max_fill Largest allowed fill ratio (0 - no limit)
+	 */
+	DIA(const CSR<T> &mtrx, double max_fill = 2.0)
+	{
+		SPARSE_PROFILE_SCOPE("DIA::DIA", 0);
+
+		std::vector<int> offsets = find_offsets(mtrx);
+
+		_rows = mtrx.rows();
+		_cols = mtrx.cols();
+		_ndiag = offsets.size();
+		_nnz = mtrx.size_of_aelem();
+		_eval = mtrx.eval();
+
+		double ratio = (_nnz > 0) ? (double)_ndiag * _rows / _nnz : 1;
+
+		if (max_fill > 0 && ratio > max_fill) {
+			throw FillInExceeded("DIA", ratio, max_fill);
+		}
+
+		_offsets = new int[_ndiag];
+		_data = new T[(size_t)_ndiag * _rows];
+
+		std::vector<int> index(_rows + _cols, -1);
+
+		for (int d = 0; d < _ndiag; ++d) {
+			_offsets[d] = offsets[d];
+			index[offsets[d] + _rows] = d;
+		}
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+
+		// Same partition as multiply(), so that every thread
+		// touches its own pages first
+		parallel([&](int tid, int nthreads) {
+			int lo, hi;
+			ThreadPool::range(_rows, tid, nthreads, lo, hi);
+
+			for (int d = 0; d < _ndiag; ++d) {
+				std::fill(_data + (size_t)d * _rows + lo,
+						  _data + (size_t)d * _rows + hi, T());
+			}
+
+			for (int i = lo; i < hi; ++i) {
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					int d = index[jptr[k] - i + _rows];
+					_data[(size_t)d * _rows + i] += aelem[k];
+				}
+			}
+		});
+	}
+
+	/**
+	 * @brief Deletes an instance of DIA matrix
+	 */
+	~DIA()
+	{
+		delete[] _offsets;
+		delete[] _data;
+	}
+
+	/**
+	 * @brief Gets the number of rows in matrix
+	 * @return Number of rows
+	 */
+	int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @brief Gets the number of columns in matrix
+	 * @return Number of columns
+	 */
+	int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @brief Gets the number of stored diagonals
+	 * @return Number of diagonals
+	 */
+	int diagonals() const
+	{
+		return _ndiag;
+	}
+
+	/**
+	 * @brief Gets the offsets of stored diagonals
+	 * @return offsets array
+	 */
+	const int* offsets() const
+	{
+		return _offsets;
+	}
+
+	/**
+	 * @brief Gets the values of diagonals
+	 * @return data array (diagonal after diagonal)
+	 */
+	const T* data() const
+	{
+		return _data;
+	}
+
+	/**
+	 * @brief Overwrites the values of matrix with the values of
+	 * CSR matrix of the same portrait
+	 * @details The diagonal of every element is found among the
+	 * stored ones by binary search; nothing is allocated. Throws
+	 * RefreshPatternMismatch if an element lies on a diagonal that
+	 * is not stored (the values are undefined then).
+	 *
+	 * @param mtrx CSR matrix
+	 */
+	void set_values(const CSR<T> &mtrx)
+	{
+		if (mtrx.rows() != _rows || mtrx.cols() != _cols ||
+			mtrx.size_of_aelem() != _nnz) {
+			throw RefreshPatternMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("DIA::set_values",
+			(long long)_ndiag * _rows * sizeof(T) +
+			_nnz * (sizeof(T) + sizeof(int)));
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+		std::atomic<bool> mismatch(false);
+
+		parallel([&](int tid, int nthreads) {
+			int lo, hi;
+			ThreadPool::range(_rows, tid, nthreads, lo, hi);
+
+			for (int d = 0; d < _ndiag; ++d) {
+				std::fill(_data + (size_t)d * _rows + lo,
+						  _data + (size_t)d * _rows + hi, T());
+			}
+
+			for (int i = lo; i < hi; ++i) {
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					int off = jptr[k] - i;
+					const int *pos = std::lower_bound(_offsets,
+													  _offsets + _ndiag, off);
+
+					if (pos == _offsets + _ndiag || *pos != off) {
+						mismatch = true;
+						return;
+					}
+
+					_data[(size_t)(pos - _offsets) * _rows + i] += aelem[k];
+				}
+			}
+		});
+
+		if (mismatch.load()) {
+			throw RefreshPatternMismatch();
+		}
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector into existing Vector
+	 * @details Every thread takes an equal range of rows and
+	 * walks it in blocks of DIA_ROW_BLOCK rows: all the
+	 * diagonals are applied to a block before the next one.
+	 *
+	 * @param vec Given vector (of size cols)
+	 * @param res Result of multiplication (of size rows)
+	 */
+	void multiply(const Vector<T> &vec, Vector<T> &res) const
+	{
+		if (vec.size() != _cols || res.size() != _rows) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("DIA::multiply",
+			(long long)_ndiag * _rows * sizeof(T) + _ndiag * sizeof(int) +
+			(long long)(_rows + _cols) * sizeof(T));
+
+		const T *x = vec.data();
+		T *y = res.data();
+
+		parallel([&](int tid, int nthreads) {
+			SPARSE_TRACE_SCOPE("DIA::multiply");
+
+			int lo, hi;
+			ThreadPool::range(_rows, tid, nthreads, lo, hi);
+
+			for (int b = lo; b < hi; b += DIA_ROW_BLOCK) {
+				int e = std::min(b + DIA_ROW_BLOCK, hi);
+
+				for (int i = b; i < e; ++i) {
+					y[i] = _eval;
+				}
+
+				for (int d = 0; d < _ndiag; ++d) {
+					int off = _offsets[d];
+					int first = std::max(b, -off);
+					int last = std::min(e, _cols - off);
+					const T *a = _data + (size_t)d * _rows;
+
+					for (int i = first; i < last; ++i) {
+						y[i] += a[i] * x[i + off];
+					}
+				}
+			}
+		});
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector
+	 * @details See multiply(const Vector<T>&, Vector<T>&)
+	 *
+	 * @param vec Given vector
+	 * @return Result of multiplication
+	 */
+	Vector<T> operator* (const Vector<T> &vec) const
+	{
+		Vector<T> res(_rows);
+		multiply(vec, res);
+		return res;
+	}
+};
+
+#endif // DIA_H
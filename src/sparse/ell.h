@@ -0,0 +1,625 @@
+#ifndef ELL_H
+#define ELL_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "vector.h"
+#include "csr.h"
+#include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Rows multiplied at once by ELL kernel: the block of y
+ * stays in L1 while all the columns of ELL pass over it
+ */
+const int ELL_ROW_BLOCK = 512;
+
+template <typename T>
+class HYB;
+
+/**
+ * @brief ELL - ELLPACK storage format.
+ * @details Meant for matrices whose rows have (almost) the same
+ * number of nonempty elements. Every row is padded to width
+ * elements and the rows are stored column after column:
+ * - jptr - column-index of k-th element of row i is
+ *   jptr[k * rows + i]
+ * - aelem - value of k-th element of row i is aelem[k * rows + i]
+ *
+ * Padding elements are zeros with the column of the last
+ * element of their row. Multiplication needs no row pointers and
+ * its inner loop runs over consecutive rows, which the compiler
+ * vectorizes (with gathers of x).
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class ELL
+{
+	int _rows;
+	int _cols;
+	int _width;
+	long long _nnz;
+	T _eval;
+
+	int *_jptr;
+	T *_aelem;
+
+	friend class HYB<T>;
+
+	ELL(const ELL &);
+	ELL& operator= (const ELL &);
+
+	/**
+	 * @brief Creates an instance of ELL matrix from the first
+	 * width elements of every row of CSR matrix (used by HYB)
+	 *
+	 * @param mtrx CSR matrix
+	 * @param width Number of elements kept in every row
+	 * @param truncate Tag of this constructor
+	 */
+	ELL(const CSR<T> &mtrx, int width, bool truncate)
+	{
+		(void)truncate;
+		build(mtrx, width);
+	}
+
+	/**
+	 * @brief Fills the arrays from CSR matrix
+	 *
+	 * @param mtrx CSR matrix
+	 * @param width Number of elements kept in every row
+	 */
+	void build(const CSR<T> &mtrx, int width)
+	{
+		SPARSE_PROFILE_SCOPE("ELL::build", 0);
+
+		_rows = mtrx.rows();
+		_cols = mtrx.cols();
+		_width = width;
+		_eval = mtrx.eval();
+
+		_jptr = new int[(size_t)_width * _rows];
+		_aelem = new T[(size_t)_width * _rows];
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		long long nnz = 0;
+
+		// Same partition as multiply(), so that every thread
+		// touches its own pages first
+		parallel([&](int tid, int nthreads) {
+			int lo, hi;
+			ThreadPool::range(_rows, tid, nthreads, lo, hi);
+
+			for (int i = lo; i < hi; ++i) {
+				int len = std::min(iptr[i + 1] - iptr[i], _width);
+				int pad = (len > 0) ? jptr[iptr[i] + len - 1] : 0;
+
+				for (int k = 0; k < len; ++k) {
+					_jptr[(size_t)k * _rows + i] = jptr[iptr[i] + k];
+				}
+
+				for (int k = len; k < _width; ++k) {
+					_jptr[(size_t)k * _rows + i] = pad;
+				}
+			}
+		});
+
+		copy_values(mtrx, true);
+
+		for (int i = 0; i < _rows; ++i) {
+			nnz += std::min(iptr[i + 1] - iptr[i], _width);
+		}
+
+		_nnz = nnz;
+	}
+
+	/**
+	 * @brief Copies the values of the first width elements of
+	 * every row of CSR matrix (zeros for padding)
+	 * @details Checks that these elements have the stored
+	 * column-indices and, unless truncate is set, that no row is
+	 * longer than width. On mismatch the values are undefined.
+	 *
+	 * @param mtrx CSR matrix
+	 * @param truncate Whether rows may be longer than width
+	 * @return True if the portrait matches
+	 */
+	bool copy_values(const CSR<T> &mtrx, bool truncate)
+	{
+		SPARSE_PROFILE_SCOPE("ELL::copy_values",
+			(long long)_width * _rows * (sizeof(T) + sizeof(int)) +
+			mtrx.size_of_aelem() * (long long)(sizeof(T) + sizeof(int)));
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+		std::atomic<bool> mismatch(false);
+
+		parallel([&](int tid, int nthreads) {
+			int lo, hi;
+			ThreadPool::range(_rows, tid, nthreads, lo, hi);
+
+			for (int i = lo; i < hi; ++i) {
+				int len = iptr[i + 1] - iptr[i];
+
+				if (len > _width && !truncate) {
+					mismatch = true;
+					return;
+				}
+
+				len = std::min(len, _width);
+
+				for (int k = 0; k < len; ++k) {
+					if (_jptr[(size_t)k * _rows + i] != jptr[iptr[i] + k]) {
+						mismatch = true;
+						return;
+					}
+
+					_aelem[(size_t)k * _rows + i] = aelem[iptr[i] + k];
+				}
+
+				for (int k = len; k < _width; ++k) {
+					_aelem[(size_t)k * _rows + i] = 0;
+				}
+			}
+		});
+
+		return !mismatch.load();
+	}
+
+	/**
+	 * @brief Multiplies rows [lo, hi) into y
+	 */
+	void multiply_rows(const T *x, T *y, int lo, int hi) const
+	{
+		// Sums are kept in a local array: the compiler knows it
+		// does not alias x and vectorizes the loop over rows
+		T sum[ELL_ROW_BLOCK];
+
+		for (int b = lo; b < hi; b += ELL_ROW_BLOCK) {
+			int n = std::min(ELL_ROW_BLOCK, hi - b);
+
+			for (int i = 0; i < n; ++i) {
+				sum[i] = 0;
+			}
+
+			for (int k = 0; k < _width; ++k) {
+				const int *j = _jptr + (size_t)k * _rows + b;
+				const T *a = _aelem + (size_t)k * _rows + b;
+
+				for (int i = 0; i < n; ++i) {
+					sum[i] += a[i] * x[j[i]];
+				}
+			}
+
+			for (int i = 0; i < n; ++i) {
+				y[b + i] = sum[i] + _eval;
+			}
+		}
+	}
+
+public:
+	/**
+	 * @brief Gets the length of the longest row of matrix
+	 *
+	 * @param mtrx CSR matrix
+	 * @return Number of nonempty elements in the longest row
+	 */
+	static int max_row(const CSR<T> &mtrx)
+	{
+		const int *iptr = mtrx.iptr();
+		int width = 0;
+
+		for (int i = 0; i < mtrx.rows(); ++i) {
+			width = std::max(width, iptr[i + 1] - iptr[i]);
+		}
+
+		return width;
+	}
+
+	/**
+	 * @brief Gets the fill ratio of ELL storage of matrix
+	 * @details Stored elements (with padding) per nonempty one
+	 *
+	 * @param mtrx CSR matrix
+	 * @return Fill ratio
+	 */
+	static double fill(const CSR<T> &mtrx)
+	{
+		if (mtrx.size_of_aelem() == 0) {
+			return 1;
+		}
+
+		return (double)max_row(mtrx) * mtrx.rows() / mtrx.size_of_aelem();
+	}
+
+	/**
+	 * @brief Creates an instance of ELL matrix from CSR matrix
+	 * @details Throws FillInExceeded if padding to the longest
+	 * row would store more than max_fill elements per nonempty
+	 * one (use HYB for such matrices)
+	 *
+	 * @param mtrx CSR matrix
+	 * @param max_fill Largest allowed fill ratio (0 - no limit)
+	 */
+	ELL(const CSR<T> &mtrx, double max_fill = 2.0)
+	{
+		double ratio = fill(mtrx);
+
+		if (max_fill > 0 && ratio > max_fill) {
+			throw FillInExceeded("ELL", ratio, max_fill);
+		}
+
+		build(mtrx, max_row(mtrx));
+	}
+
+	/**
+	 * @brief Deletes an instance of ELL matrix
+	 */
+	~ELL()
+	{
+		delete[] _jptr;
+		delete[] _aelem;
+	}
+
+	/**
+	 * @brief Gets the number of rows in matrix
+	 * @return Number of rows
+	 */
+	int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @brief Gets the number of columns in matrix
+	 * @return Number of columns
+	 */
+	int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @brief Gets the number of elements stored in every row
+	 * @return Width of matrix
+	 */
+	int width() const
+	{
+		return _width;
+	}
+
+	/**
+	 * @brief Gets the number of nonempty (not padding) elements
+	 * @return Number of nonempty elements
+	 */
+	long long size_of_aelem() const
+	{
+		return _nnz;
+	}
+
+	/**
+	 * @brief Gets column-indices of elements
+	 * @return jptr array (column after column)
+	 */
+	const int* jptr() const
+	{
+		return _jptr;
+	}
+
+	/**
+	 * @brief Gets values of elements
+	 * @return aelem array (column after column)
+	 */
+	const T* aelem() const
+	{
+		return _aelem;
+	}
+
+	/**
+	 * @brief Overwrites the values of matrix with the values of
+	 * CSR matrix of the same portrait
+	 * @details Column-indices (and padding) are kept; nothing is
+	 * allocated. Throws RefreshPatternMismatch if a row is longer
+	 * than width or its columns differ (the values are undefined
+	 * then).
+	 *
+	 * @param mtrx CSR matrix
+	 */
+	void set_values(const CSR<T> &mtrx)
+	{
+		if (mtrx.rows() != _rows || mtrx.cols() != _cols ||
+			mtrx.size_of_aelem() != _nnz ||
+			!copy_values(mtrx, false)) {
+			throw RefreshPatternMismatch();
+		}
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector into existing Vector
+	 * @details Every thread takes an equal range of rows and
+	 * walks it in blocks of ELL_ROW_BLOCK rows.
+	 *
+	 * @param vec Given vector (of size cols)
+	 * @param res Result of multiplication (of size rows)
+	 */
+	void multiply(const Vector<T> &vec, Vector<T> &res) const
+	{
+		if (vec.size() != _cols || res.size() != _rows) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("ELL::multiply",
+			(long long)_width * _rows * (sizeof(T) + sizeof(int)) +
+			(long long)(_rows + _cols) * sizeof(T));
+
+		const T *x = vec.data();
+		T *y = res.data();
+
+		parallel([&](int tid, int nthreads) {
+			SPARSE_TRACE_SCOPE("ELL::multiply");
+
+			int lo, hi;
+			ThreadPool::range(_rows, tid, nthreads, lo, hi);
+			multiply_rows(x, y, lo, hi);
+		});
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector
+	 * @details See multiply(const Vector<T>&, Vector<T>&)
+	 *
+	 * @param vec Given vector
+	 * @return Result of multiplication
+	 */
+	Vector<T> operator* (const Vector<T> &vec) const
+	{
+		Vector<T> res(_rows);
+		multiply(vec, res);
+		return res;
+	}
+};
+
+/**
+ * @brief HYB - hybrid ELL + COO storage format.
+ * @details The regular part of matrix (the first width elements
+ * of every row) is kept in ELL format, the elements of longer
+ * rows beyond it are kept as a list of (row, column, value)
+ * sorted by rows. Unlike ELL the format never refuses a matrix:
+ * the width is chosen so that padding stays bounded.
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class HYB
+{
+	ELL<T> _ell;
+
+	int _ncoo;
+	int *_crow;
+	int *_cjptr;
+	T *_caelem;
+
+	HYB(const HYB &);
+	HYB& operator= (const HYB &);
+
+public:
+	/**
+	 * @brief Chooses the width of ELL part
+	 * @details The k-th column of ELL part is kept while at
+	 * least a third of rows have k or more elements: an ELL
+	 * element costs one index, a COO one costs two indices and
+	 * a scattered update of y. The fill of ELL part is therefore
+	 * at most 3.
+	 *
+	 * @param mtrx CSR matrix
+	 * @return Width of ELL part
+	 */
+	static int auto_width(const CSR<T> &mtrx)
+	{
+		const int *iptr = mtrx.iptr();
+		int rows = mtrx.rows();
+		std::vector<int> count(ELL<T>::max_row(mtrx) + 2, 0);
+
+		for (int i = 0; i < rows; ++i) {
+			++count[iptr[i + 1] - iptr[i]];
+		}
+
+		int need = std::max(1, rows / 3);
+		int longer = 0;
+
+		for (int k = (int)count.size() - 1; k > 0; --k) {
+			// longer - number of rows with k or more elements
+			longer += count[k];
+
+			if (longer >= need) {
+				return k;
+			}
+		}
+
+		return 0;
+	}
+
+	/**
+	 * @brief Creates an instance of HYB matrix from CSR matrix
+	 *
+	 * @param mtrx CSR matrix
+	 * @param width Width of ELL part (-1 - see auto_width())
+	 */
+	HYB(const CSR<T> &mtrx, int width = -1)
+		: _ell(mtrx, (width >= 0) ? width : auto_width(mtrx), true)
+	{
+		SPARSE_PROFILE_SCOPE("HYB::HYB", 0);
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+		int w = _ell.width();
+
+		_ncoo = mtrx.size_of_aelem() - _ell.size_of_aelem();
+		_crow = new int[_ncoo];
+		_cjptr = new int[_ncoo];
+		_caelem = new T[_ncoo];
+
+		int c = 0;
+
+		for (int i = 0; i < mtrx.rows(); ++i) {
+			for (int k = iptr[i] + w; k < iptr[i + 1]; ++k) {
+				_crow[c] = i;
+				_cjptr[c] = jptr[k];
+				_caelem[c++] = aelem[k];
+			}
+		}
+	}
+
+	/**
+	 * @brief Deletes an instance of HYB matrix
+	 */
+	~HYB()
+	{
+		delete[] _crow;
+		delete[] _cjptr;
+		delete[] _caelem;
+	}
+
+	/**
+	 * @brief Gets the number of rows in matrix
+	 * @return Number of rows
+	 */
+	int rows() const
+	{
+		return _ell.rows();
+	}
+
+	/**
+	 * @brief Gets the number of columns in matrix
+	 * @return Number of columns
+	 */
+	int cols() const
+	{
+		return _ell.cols();
+	}
+
+	/**
+	 * @brief Gets the ELL part of matrix
+	 * @return ELL matrix
+	 */
+	const ELL<T>& ell() const
+	{
+		return _ell;
+	}
+
+	/**
+	 * @brief Gets the number of elements in COO part
+	 * @return Number of elements
+	 */
+	int coo_size() const
+	{
+		return _ncoo;
+	}
+
+	/**
+	 * @brief Overwrites the values of matrix with the values of
+	 * CSR matrix of the same portrait
+	 * @details The ELL part and the COO list are kept; nothing
+	 * is allocated. Throws RefreshPatternMismatch if the columns
+	 * of a row differ from those of its ELL part and COO tail
+	 * (the values are undefined then).
+	 *
+	 * @param mtrx CSR matrix
+	 */
+	void set_values(const CSR<T> &mtrx)
+	{
+		if (mtrx.rows() != rows() || mtrx.cols() != cols() ||
+			mtrx.size_of_aelem() != _ell.size_of_aelem() + _ncoo) {
+			throw RefreshPatternMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("HYB::set_values",
+			mtrx.size_of_aelem() * (2LL * sizeof(T) + 2LL * sizeof(int)));
+
+		if (!_ell.copy_values(mtrx, true)) {
+			throw RefreshPatternMismatch();
+		}
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+		int w = _ell.width();
+		int c = 0;
+
+		for (int i = 0; i < mtrx.rows(); ++i) {
+			for (int k = iptr[i] + w; k < iptr[i + 1]; ++k, ++c) {
+				if (c == _ncoo || _crow[c] != i || _cjptr[c] != jptr[k]) {
+					throw RefreshPatternMismatch();
+				}
+
+				_caelem[c] = aelem[k];
+			}
+		}
+
+		if (c != _ncoo) {
+			throw RefreshPatternMismatch();
+		}
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector into existing Vector
+	 * @details Every thread multiplies the ELL part of its rows
+	 * and then adds the COO elements of the same rows, so no
+	 * two threads update the same element of res.
+	 *
+	 * @param vec Given vector (of size cols)
+	 * @param res Result of multiplication (of size rows)
+	 */
+	void multiply(const Vector<T> &vec, Vector<T> &res) const
+	{
+		if (vec.size() != cols() || res.size() != rows()) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("HYB::multiply",
+			(long long)_ell.width() * rows() * (sizeof(T) + sizeof(int)) +
+			(long long)_ncoo * (sizeof(T) + 2 * sizeof(int)) +
+			(long long)(rows() + cols()) * sizeof(T));
+
+		const T *x = vec.data();
+		T *y = res.data();
+
+		parallel([&](int tid, int nthreads) {
+			SPARSE_TRACE_SCOPE("HYB::multiply");
+
+			int lo, hi;
+			ThreadPool::range(rows(), tid, nthreads, lo, hi);
+			_ell.multiply_rows(x, y, lo, hi);
+
+			int c = std::lower_bound(_crow, _crow + _ncoo, lo) - _crow;
+
+			for (; c < _ncoo && _crow[c] < hi; ++c) {
+				y[_crow[c]] += _caelem[c] * x[_cjptr[c]];
+			}
+		});
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector
+	 * @details See multiply(const Vector<T>&, Vector<T>&)
+	 *
+	 * @param vec Given vector
+	 * @return Result of multiplication
+	 */
+	Vector<T> operator* (const Vector<T> &vec) const
+	{
+		Vector<T> res(rows());
+		multiply(vec, res);
+		return res;
+	}
+};
+
+#endif // ELL_H
@@ -3,6 +3,7 @@
 
 #include <exception>
 #include <sstream>
+#include <string>
 
 /**
  * @brief Exception that is thrown when trying to multiply the
@@ -18,6 +19,75 @@ public:
     }
 };
 
+/**
+ * @brief Exception that is thrown when trying to add
+ * CSR or CSLR matrices of different sizes
+ */
+class AddSizeMismatch : public std::exception
+{
+public:
+	const char* what() const throw()
+	{
+		return "Cannot add: sizes of matrices do not match.";
+	}
+};
+
+/**
+ * @brief Exception that is thrown when in-place addition
+ * is applied to CSR or CSLR matrices with different portraits
+ */
+class AddPatternMismatch : public std::exception
+{
+public:
+	const char* what() const throw()
+	{
+		return "Cannot add in place: portraits of matrices " \
+			   "do not match.";
+	}
+};
+
+/**
+ * @brief Exception that is thrown when the values of a matrix
+ * are refreshed from a matrix of other portrait
+ */
+class RefreshPatternMismatch : public std::exception
+{
+public:
+	const char* what() const throw()
+	{
+		return "Cannot refresh values: portraits of matrices " \
+			   "do not match.";
+	}
+};
+
+/**
+ * @brief Exception that is thrown when trying to convert
+ * a matrix with asymmetric portrait to CSLR format
+ */
+class PortraitNotSymmetric : public std::exception
+{
+public:
+	const char* what() const throw()
+	{
+		return "Cannot convert to CSLR: portrait of matrix " \
+			   "is not symmetric.";
+	}
+};
+
+/**
+ * @brief Exception that is thrown when trying to switch
+ * a CSLR matrix with asymmetric values to symmetric mode
+ */
+class ValuesNotSymmetric : public std::exception
+{
+public:
+	const char* what() const throw()
+	{
+		return "Cannot switch to symmetric mode: values of " \
+			   "matrix are not symmetric.";
+	}
+};
+
 /**
  * @brief Exception that is thrown when trying to insert the
  * nonexisting element CSR or CSIR matrix
@@ -55,6 +125,35 @@ public:
 	}
 };
 
+/**
+ * @brief Exception that is thrown when trying to get a reference
+ * to the empty element of SparseVector
+ */
+class VecNoSuchElement : public std::exception
+{
+	int _index;
+	std::string _msg;
+
+public:
+	VecNoSuchElement(int index)
+		: _index(index)
+	{
+		std::ostringstream osstrm;
+		osstrm << "SparseVector has no nonempty element at "
+			   << _index;
+		_msg = osstrm.str();
+	}
+
+	~VecNoSuchElement() throw()
+	{
+	}
+
+	const char* what() const throw()
+	{
+		return _msg.c_str();
+	}
+};
+
 /**
  * @brief Exception that is thrown when trying to apply an
  * arithmetic operation to Vector-s or SparseVector-s of
@@ -82,4 +181,113 @@ public:
 	}
 };
 
+/**
+ * @brief Exception that is thrown when saved SpMVPlan cannot
+ * be read or does not match the matrix
+ */
+class InvalidSpMVPlan : public std::exception
+{
+	std::string _msg;
+
+public:
+	InvalidSpMVPlan(const std::string &reason)
+		: _msg("Invalid SpMV plan: " + reason)
+	{
+	}
+
+	~InvalidSpMVPlan() throw()
+	{
+	}
+
+	const char* what() const throw()
+	{
+		return _msg.c_str();
+	}
+};
+
+/**
+ * @brief Exception that is thrown when StreamCSR file cannot
+ * be written or read
+ */
+class StreamIOError : public std::exception
+{
+	std::string _msg;
+
+public:
+	StreamIOError(const std::string &path, const std::string &reason)
+		: _msg("StreamCSR file " + path + ": " + reason)
+	{
+	}
+
+	~StreamIOError() throw()
+	{
+	}
+
+	const char* what() const throw()
+	{
+		return _msg.c_str();
+	}
+};
+
+/**
+ * @brief Exception that is thrown when conversion to a padded
+ * format (DIA, ELL) would store too many zeros
+ */
+class FillInExceeded : public std::exception
+{
+	std::string _msg;
+
+public:
+	FillInExceeded(const std::string &format, double fill, double max_fill)
+	{
+		std::ostringstream osstrm;
+		osstrm << "Cannot convert to " << format << ": fill ratio "
+			   << fill << " exceeds " << max_fill;
+		_msg = osstrm.str();
+	}
+
+	~FillInExceeded() throw()
+	{
+	}
+
+	const char* what() const throw()
+	{
+		return _msg.c_str();
+	}
+};
+
+/**
+ * @brief Exception that is thrown when a direct factorization
+ * meets a zero pivot (it does not pivot, so the matrix has to
+ * be e.g. diagonally dominant or positive definite)
+ */
+class ZeroPivot : public std::exception
+{
+	std::string _msg;
+	int _row;
+
+public:
+	ZeroPivot(int row)
+		: _row(row)
+	{
+		std::ostringstream osstrm;
+		osstrm << "Cannot factor matrix: zero pivot in row " << row;
+		_msg = osstrm.str();
+	}
+
+	~ZeroPivot() throw()
+	{
+	}
+
+	int row() const
+	{
+		return _row;
+	}
+
+	const char* what() const throw()
+	{
+		return _msg.c_str();
+	}
+};
+
 #endif // EXCEPTION_H
\ No newline at end of file
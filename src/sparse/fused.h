@@ -0,0 +1,365 @@
+#ifndef FUSED_H
+#define FUSED_H
+
+#include <vector>
+#include <algorithm>
+
+#include "vector.h"
+#include "csr.h"
+#include "cslr.h"
+#include "exception.h"
+#include "parallel.h"
+#include "numa.h"
+#include "reduce.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Rows updated at once by multi_axpy(): the block of y
+ * stays in L1 while all the vectors pass over it
+ */
+const int FUSED_ROW_BLOCK = 256;
+
+/**
+ * @brief Reduces leaf p = [lo, hi) of y: <y, y> and <y, v[k]>
+ * @details Component k of leaf goes to part[p * 2 * (nv + 1) + k],
+ * its error to part[p * 2 * (nv + 1) + nv + 1 + k]
+ * (see reduce_combine())
+ *
+ * @param y Result of multiplication
+ * @param v Vectors to reduce against
+ * @param nv Number of vectors
+ * @param p Index of leaf
+ * @param lo First row of leaf
+ * @param hi Past the last row of leaf
+ * @param mode Summation mode
+ * @param part Sums of leaves
+ */
+template <typename T>
+void fused_reduce(const T *y, const Vector<T> *const *v, int nv, int p,
+				  int lo, int hi, SumMode mode, T *part)
+{
+	T *sums = part + (size_t)p * 2 * (nv + 1);
+	bool exact = (mode == SUM_COMPENSATED);
+
+	for (int k = 0; k <= nv; ++k) {
+		DotTerm<T> term = {y, (k == 0) ? y : v[k - 1]->data(), exact};
+		reduce_leaf(term, lo, hi, mode, sums[k], sums[nv + 1 + k]);
+	}
+}
+
+/**
+ * @brief Computes <y, y> and <y, v[k]> for all k in one pass
+ * over y
+ * @details Every leaf of y (see REDUCE_CHUNK) is loaded once and
+ * reduced against all the vectors (instead of nv + 1 separate
+ * sweeps). The results do not depend on the number of threads
+ * and are bit-identical to those of spmv_dots().
+ *
+ * @param y Given vector
+ * @param v Vectors (of the same size as y)
+ * @param nv Number of vectors
+ * @param dots Result: dots[0] = <y, y>, dots[k + 1] = <y, v[k]>
+ * @param mode Summation mode
+ */
+template <typename T>
+void multi_dot(const Vector<T> &y, const Vector<T> *const *v, int nv, T *dots,
+			   SumMode mode = SUM_PAIRWISE)
+{
+	int n = y.size();
+	int nleaves = (n + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+
+	SPARSE_PROFILE_SCOPE("multi_dot", (nv + 1LL) * n * sizeof(T));
+
+	T *part = reduce_scratch<T>((size_t)nleaves * 2 * (nv + 1));
+	const T *py = y.data();
+
+	parallel_for(0, nleaves, [&](int lo, int hi) {
+		SPARSE_TRACE_SCOPE("multi_dot");
+
+		for (int p = lo; p < hi; ++p) {
+			fused_reduce(py, v, nv, p, p * REDUCE_CHUNK,
+						 std::min((p + 1) * REDUCE_CHUNK, n), mode, part);
+		}
+	}, std::max(1, nleaves / (4 * num_threads())));
+
+	reduce_combine(part, nleaves, nv + 1, mode, dots);
+}
+
+/**
+ * @brief Computes the projections of block of vectors w on q and
+ * the Gram matrix of w in one pass
+ * @details A single (reproducible) reduction for the whole block,
+ * as needed by block Gram-Schmidt with CholQR. Every leaf of all
+ * the vectors is loaded once.
+ *
+ * @param q Vectors (of the same size as w)
+ * @param nq Number of vectors q
+ * @param w Block of vectors
+ * @param nw Number of vectors w
+ * @param dots Result: nq * nw projections dots[i * nw + j] =
+ * <q[i], w[j]> followed by the upper triangle of Gram matrix,
+ * <w[i], w[j]> for i <= j packed by rows
+ * @param mode Summation mode
+ */
+template <typename T>
+void block_dot(const Vector<T> *const *q, int nq, const Vector<T> *const *w,
+			   int nw, T *dots, SumMode mode = SUM_PAIRWISE)
+{
+	int n = (nw > 0) ? w[0]->size() : 0;
+	int nleaves = (n + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+	int ncomp = nq * nw + nw * (nw + 1) / 2;
+
+	SPARSE_PROFILE_SCOPE("block_dot", (long long)(nq + nw) * n * sizeof(T));
+
+	T *part = reduce_scratch<T>((size_t)nleaves * 2 * ncomp);
+	bool exact = (mode == SUM_COMPENSATED);
+
+	parallel_for(0, nleaves, [&](int lo, int hi) {
+		SPARSE_TRACE_SCOPE("block_dot");
+
+		for (int p = lo; p < hi; ++p) {
+			T *sums = part + (size_t)p * 2 * ncomp;
+			int b = p * REDUCE_CHUNK;
+			int e = std::min(b + REDUCE_CHUNK, n);
+			int c = 0;
+
+			for (int i = 0; i < nq; ++i) {
+				for (int j = 0; j < nw; ++j, ++c) {
+					DotTerm<T> term = {q[i]->data(), w[j]->data(), exact};
+					reduce_leaf(term, b, e, mode, sums[c], sums[ncomp + c]);
+				}
+			}
+
+			for (int i = 0; i < nw; ++i) {
+				for (int j = i; j < nw; ++j, ++c) {
+					DotTerm<T> term = {w[i]->data(), w[j]->data(), exact};
+					reduce_leaf(term, b, e, mode, sums[c], sums[ncomp + c]);
+				}
+			}
+		}
+	}, std::max(1, nleaves / (4 * num_threads())));
+
+	reduce_combine(part, nleaves, ncomp, mode, dots);
+}
+
+/**
+ * @brief Computes y = scale * (y + alpha * sum(coef[k] * v[k]))
+ * in one pass over y
+ *
+ * @param alpha Common factor
+ * @param coef Coefficients (nv elements)
+ * @param v Vectors (of the same size as y)
+ * @param nv Number of vectors
+ * @param y Updated vector
+ * @param scale Factor of the result
+ */
+template <typename T>
+void multi_axpy(T alpha, const T *coef, const Vector<T> *const *v, int nv,
+				Vector<T> &y, T scale = T(1))
+{
+	SPARSE_PROFILE_SCOPE("multi_axpy", (nv + 2LL) * y.size() * sizeof(T));
+
+	T *py = y.data();
+
+	numa_for<T>(y.size(), [&](size_t lo, size_t hi) {
+		for (size_t b = lo; b < hi; b += FUSED_ROW_BLOCK) {
+			size_t e = std::min(b + FUSED_ROW_BLOCK, hi);
+
+			for (int k = 0; k < nv; ++k) {
+				const T *vk = v[k]->data();
+				T a = alpha * coef[k];
+
+				for (size_t i = b; i < e; ++i) {
+					py[i] += a * vk[i];
+				}
+			}
+
+			if (scale != T(1)) {
+				for (size_t i = b; i < e; ++i) {
+					py[i] *= scale;
+				}
+			}
+		}
+	});
+}
+
+/**
+ * @brief Computes y = A * x together with <y, y> and <y, v[k]>
+ * @details Generic version for any matrix: multiplication is
+ * followed by multi_dot(). CSR and CSLR have fused overloads.
+ *
+ * @param A Matrix
+ * @param x Given vector
+ * @param y Result of multiplication
+ * @param v Vectors (of the same size as y)
+ * @param nv Number of vectors
+ * @param dots Result: dots[0] = <y, y>, dots[k + 1] = <y, v[k]>
+ * @param mode Summation mode
+ */
+template <typename SMTRX, typename T>
+void spmv_dots(const SMTRX &A, const Vector<T> &x, Vector<T> &y,
+			   const Vector<T> *const *v, int nv, T *dots,
+			   SumMode mode = SUM_PAIRWISE)
+{
+	A.multiply(x, y);
+	multi_dot(y, v, nv, dots, mode);
+}
+
+/**
+ * @brief Computes y = A * x together with <y, y> and <y, v[k]>
+ * for CSR matrix in one pass
+ * @details Every thread gets the rows of nnz_range() (as
+ * CSR::operator*) rounded to whole leaves of REDUCE_CHUNK rows,
+ * and reduces each leaf right after computing it, so y is written
+ * once and never read back from memory. The reductions are the
+ * same as those of multi_dot() for any number of threads.
+ *
+ * @param A CSR matrix
+ * @param x Given vector (of size cols)
+ * @param y Result of multiplication (of size rows)
+ * @param v Vectors (of size rows)
+ * @param nv Number of vectors
+ * @param dots Result: dots[0] = <y, y>, dots[k + 1] = <y, v[k]>
+ * @param mode Summation mode
+ */
+template <typename T>
+void spmv_dots(const CSR<T> &A, const Vector<T> &x, Vector<T> &y,
+			   const Vector<T> *const *v, int nv, T *dots,
+			   SumMode mode = SUM_PAIRWISE)
+{
+	if (x.size() != A.cols() || y.size() != A.rows()) {
+		throw MultSizeMismatch();
+	}
+
+	int rows = A.rows();
+	int nleaves = (rows + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+
+	SPARSE_PROFILE_SCOPE("spmv_dots",
+		(long long)A.size_of_aelem() * (sizeof(T) + sizeof(int)) +
+		(rows + 1LL) * sizeof(int) +
+		(long long)(A.cols() + (nv + 1) * rows) * sizeof(T));
+
+	const int *iptr = A.iptr();
+	const int *jptr = A.jptr();
+	const T *aelem = A.aelem();
+	const T *px = x.data();
+	T *py = y.data();
+	T eval = A.eval();
+
+	T *part = reduce_scratch<T>((size_t)nleaves * 2 * (nv + 1));
+
+	parallel([&](int tid, int nthreads) {
+		SPARSE_TRACE_SCOPE("spmv_dots");
+
+		int lo, hi;
+		nnz_range(iptr, rows, tid, nthreads, lo, hi);
+
+		// Neighbouring threads round the same boundary alike
+		int first = (lo == rows) ? nleaves : (lo + REDUCE_CHUNK / 2) / REDUCE_CHUNK;
+		int last = (hi == rows) ? nleaves : (hi + REDUCE_CHUNK / 2) / REDUCE_CHUNK;
+
+		for (int p = first; p < last; ++p) {
+			int b = p * REDUCE_CHUNK;
+			int e = std::min(b + REDUCE_CHUNK, rows);
+
+			for (int i = b; i < e; ++i) {
+				T sum = eval;
+
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					sum += aelem[k] * px[jptr[k]];
+				}
+
+				py[i] = sum;
+			}
+
+			fused_reduce(py, v, nv, p, b, e, mode, part);
+		}
+	});
+
+	reduce_combine(part, nleaves, nv + 1, mode, dots);
+}
+
+/**
+ * @brief Computes y = A * x together with <y, y> and <y, v[k]>
+ * for CSLR matrix in one pass
+ * @details Rows are walked from the last one: row i adds its upper
+ * elements to y[j] with j < i only, so y[i] is complete as soon as
+ * row i is done, and every leaf of y is reduced (in the same way as
+ * by multi_dot()) while still in cache. The part of
+ * y below the lowest column seen so far is zeroed lazily. Works
+ * in symmetric mode as well.
+ *
+ * @param A CSLR matrix
+ * @param x Given vector
+ * @param y Result of multiplication
+ * @param v Vectors (of size of matrix)
+ * @param nv Number of vectors
+ * @param dots Result: dots[0] = <y, y>, dots[k + 1] = <y, v[k]>
+ * @param mode Summation mode
+ */
+template <typename T>
+void spmv_dots(const CSLR<T> &A, const Vector<T> &x, Vector<T> &y,
+			   const Vector<T> *const *v, int nv, T *dots,
+			   SumMode mode = SUM_PAIRWISE)
+{
+	int n = A.size();
+	int nleaves = (n + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+
+	if (x.size() != n || y.size() != n) {
+		throw MultSizeMismatch();
+	}
+
+	SPARSE_PROFILE_SCOPE("spmv_dots",
+		(long long)A.size_of_altr() *
+		((A.symmetric() ? 1 : 2) * sizeof(T) + sizeof(int)) +
+		(n + 1LL) * sizeof(int) + (nv + 3LL) * n * sizeof(T));
+	SPARSE_TRACE_SCOPE("spmv_dots");
+
+	const int *iptr = A.iptr();
+	const int *jptr = A.jptr();
+	const T *adiag = A.adiag();
+	const T *altr = A.altr();
+	const T *autr = A.autr();
+	const T *px = x.data();
+	T *py = y.data();
+
+	T *part = reduce_scratch<T>((size_t)nleaves * 2 * (nv + 1));
+
+	// y[zero, n) is initialized
+	int zero = n;
+
+	for (int i = n - 1; i >= 0; --i) {
+		int first = i;
+
+		for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+			first = std::min(first, jptr[k]);
+		}
+
+		if (first < zero) {
+			std::fill(py + first, py + zero, T());
+			zero = first;
+		}
+
+		T xi = px[i];
+		T sum = py[i] + adiag[i] * xi;
+
+		for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+			int j = jptr[k];
+			sum += altr[k] * px[j];
+			py[j] += autr[k] * xi;
+		}
+
+		py[i] = sum;
+
+		if (i % REDUCE_CHUNK == 0) {
+			int p = i / REDUCE_CHUNK;
+			fused_reduce(py, v, nv, p, i, std::min(i + REDUCE_CHUNK, n),
+						 mode, part);
+		}
+	}
+
+	reduce_combine(part, nleaves, nv + 1, mode, dots);
+}
+
+#endif // FUSED_H
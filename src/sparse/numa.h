@@ -0,0 +1,303 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "parallel.h"
+
+/**
+ * NUMA-aware placement of data.
+ *
+ * Linux places a page on the node of the thread that touches it
+ * first. Arrays of matrices and vectors are therefore allocated
+ * with numa_alloc(), which touches every page from the thread of
+ * the pool that will later process it: the array is split into
+ * num_threads() equal parts in the same way as ThreadPool::range()
+ * splits iterations. Kernels over rows use nnz_range(), which
+ * splits the rows so that every thread gets an equal share of
+ * nonempty elements, i.e. (almost) the same part of aelem and
+ * jptr that it touched first.
+ *
+ * Only aelem and jptr are matched this way. Row pointers and
+ * vectors (including the result of SpMV) keep the equal split of
+ * elements, since vector kernels (numa_for()) use it. On matrices
+ * with skewed rows (e.g. power law) a thread's rows of iptr and y
+ * may therefore lie on another node. This costs O(rows) remote
+ * traffic against O(nnz) local traffic.
+ *
+ * This only pays off when thread t always runs on the same node,
+ * so numa_pin_threads() pins the threads of pool in blocks: the
+ * first num_threads() / nodes() threads to the cores of node 0,
+ * the next block to node 1 and so on.
+ */
+
+/**
+ * @brief Cores of every NUMA node of the machine
+ * @details Read from /sys/devices/system/node. On machines
+ * without NUMA (or other systems) all the cores are assumed to
+ * belong to a single node.
+ */
+class NumaTopology
+{
+	std::vector< std::vector<int> > _cpus;
+
+	NumaTopology()
+	{
+		for (int node = 0; ; ++node) {
+			std::ostringstream path;
+			path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+			std::ifstream file(path.str().c_str());
+			std::string list;
+
+			if (!file || !std::getline(file, list)) {
+				break;
+			}
+
+			_cpus.push_back(parse_cpulist(list));
+		}
+
+		if (_cpus.empty()) {
+			int n = (int)std::thread::hardware_concurrency();
+			_cpus.push_back(std::vector<int>());
+
+			for (int cpu = 0; cpu < (n > 0 ? n : 1); ++cpu) {
+				_cpus[0].push_back(cpu);
+			}
+		}
+	}
+
+	NumaTopology(const NumaTopology &);
+	NumaTopology& operator= (const NumaTopology &);
+
+public:
+	/**
+	 * @brief Gets the instance of NumaTopology
+	 * @return Reference to NumaTopology
+	 */
+	static NumaTopology& instance()
+	{
+		static NumaTopology topology;
+		return topology;
+	}
+
+	/**
+	 * @brief Parses the list of cores in sysfs format
+	 * (e.g. "0-3,8-11")
+	 *
+	 * @param list List of cores
+	 * @return Indices of cores
+	 */
+	static std::vector<int> parse_cpulist(const std::string &list)
+	{
+		std::vector<int> cpus;
+		std::istringstream in(list);
+		std::string item;
+
+		while (std::getline(in, item, ',')) {
+			if (item.empty()) {
+				continue;
+			}
+
+			size_t dash = item.find('-');
+			int first = atoi(item.c_str());
+			int last = (dash == std::string::npos) ? first
+												   : atoi(item.c_str() + dash + 1);
+
+			for (int cpu = first; cpu <= last; ++cpu) {
+				cpus.push_back(cpu);
+			}
+		}
+
+		return cpus;
+	}
+
+	/**
+	 * @brief Gets the number of nodes with cores
+	 * @return Number of nodes
+	 */
+	int nodes() const
+	{
+		return _cpus.size();
+	}
+
+	/**
+	 * @brief Gets the cores of node
+	 *
+	 * @param node Index of node
+	 * @return Indices of cores
+	 */
+	const std::vector<int>& cpus(int node) const
+	{
+		return _cpus[node];
+	}
+
+	/**
+	 * @brief Gets the node thread tid of nthreads is placed on
+	 * by numa_pin_threads()
+	 *
+	 * @param tid Index of thread
+	 * @param nthreads Number of threads
+	 * @return Index of node
+	 */
+	int node_of_thread(int tid, int nthreads) const
+	{
+		return (int)((long long)tid * nodes() / nthreads);
+	}
+
+	/**
+	 * @brief Gets the cores for the threads of pool so that
+	 * consecutive threads share a node
+	 *
+	 * @param nthreads Number of threads
+	 * @return Core of every thread
+	 */
+	std::vector<int> thread_cpus(int nthreads) const
+	{
+		std::vector<int> cpus(nthreads);
+
+		for (int t = 0; t < nthreads; ++t) {
+			int node = node_of_thread(t, nthreads);
+			int first = (int)(((long long)node * nthreads + nodes() - 1) / nodes());
+			const std::vector<int> &own = _cpus[node];
+
+			cpus[t] = own.empty() ? t : own[(t - first) % own.size()];
+		}
+
+		return cpus;
+	}
+};
+
+/**
+ * @brief Pins the threads of pool to match the data placement
+ * @details Should be called after ThreadPool::set_num_threads()
+ * and before the data is allocated
+ *
+ * @return True on success
+ */
+inline bool numa_pin_threads()
+{
+	ThreadPool &pool = ThreadPool::instance();
+	return pool.pin_threads(NumaTopology::instance().thread_cpus(pool.num_threads()));
+}
+
+/**
+ * @brief Arrays shorter than this (in bytes) are not distributed
+ * between threads: they are too small to matter and usually come
+ * from the already touched heap anyway
+ */
+const size_t NUMA_MIN_BYTES = 1 << 17;
+
+/**
+ * @brief Runs f(lo, hi) over the parts of an array of size
+ * elements of type T, one part per thread of pool
+ * @details The parts are the same for all arrays of the same
+ * size, so the threads that placed an array with numa_alloc()
+ * process their own pages. Small arrays are processed serially.
+ *
+ * @param size Number of elements
+ * @param f Function object
+ */
+template <typename T, typename F>
+void numa_for(size_t size, F f)
+{
+	if (size * sizeof(T) < NUMA_MIN_BYTES) {
+		f((size_t)0, size);
+		return;
+	}
+
+	parallel([&](int tid, int nthreads) {
+		f(size * tid / nthreads, size * (tid + 1) / nthreads);
+	});
+}
+
+/**
+ * @brief Allocates an array and touches its pages from the
+ * threads that will process them
+ * @details The array is released with delete[]. Elements are
+ * left uninitialized (the touched ones are set to T()).
+ *
+ * @param size Number of elements
+ * @return Pointer to array
+ */
+template <typename T>
+T* numa_alloc(size_t size)
+{
+	T *arr = new T[size];
+
+	if (size * sizeof(T) < NUMA_MIN_BYTES) {
+		return arr;
+	}
+
+	const size_t step = (4096 / sizeof(T) > 0) ? 4096 / sizeof(T) : 1;
+
+	numa_for<T>(size, [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i += step) {
+			arr[i] = T();
+		}
+	});
+
+	return arr;
+}
+
+/**
+ * @brief Copies an array with the same partition as numa_alloc()
+ * @details Keeps the pages of dst on the nodes they were
+ * placed on
+ *
+ * @param dst Destination array
+ * @param src Source array
+ * @param size Number of elements
+ */
+template <typename T>
+void numa_copy(T *dst, const T *src, size_t size)
+{
+	numa_for<T>(size, [&](size_t lo, size_t hi) {
+		std::copy(src + lo, src + hi, dst + lo);
+	});
+}
+
+/**
+ * @brief Gets the rows of thread tid so that all the threads
+ * get the same number of nonempty elements
+ * @details Matches the pages of aelem and jptr placed by
+ * numa_alloc() (but not those of iptr and of vectors, which are
+ * split by rows). Adjacent threads get adjacent ranges and all
+ * the rows are covered.
+ *
+ * @param iptr Row pointers of CSR-like matrix (rows + 1 elements)
+ * @param rows Number of rows
+ * @param tid Index of thread
+ * @param nthreads Number of threads
+ * @param lo First row of thread
+ * @param hi Past the last row of thread
+ */
+inline void nnz_range(const int *iptr, int rows, int tid, int nthreads,
+					  int &lo, int &hi)
+{
+	long long nnz = iptr[rows] - iptr[0];
+
+	if (tid == 0) {
+		lo = 0;
+	}
+	else {
+		int target = iptr[0] + (int)(nnz * tid / nthreads);
+		lo = std::lower_bound(iptr, iptr + rows, target) - iptr;
+	}
+
+	if (tid == nthreads - 1) {
+		hi = rows;
+	}
+	else {
+		int target = iptr[0] + (int)(nnz * (tid + 1) / nthreads);
+		hi = std::lower_bound(iptr, iptr + rows, target) - iptr;
+	}
+}
+
+#endif // NUMA_H
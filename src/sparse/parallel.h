@@ -0,0 +1,56 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "threadpool.h"
+
+/**
+ * @brief Gets the number of threads that parallel kernels
+ * of sparse matrices will use
+ * @details See ThreadPool::set_num_threads()
+ *
+ * @return Number of threads
+ */
+inline int num_threads()
+{
+	return ThreadPool::instance().num_threads();
+}
+
+/**
+ * @brief Gets the index of the calling thread inside
+ * the current parallel region
+ * @return Thread index (0 outside of parallel regions)
+ */
+inline int thread_id()
+{
+	return ThreadPool::thread_id();
+}
+
+/**
+ * @brief Runs f(tid, nthreads) on every thread of the shared pool
+ * @details See ThreadPool::parallel()
+ *
+ * @param f Function object
+ */
+template <typename F>
+void parallel(F f)
+{
+	ThreadPool::instance().parallel(f);
+}
+
+/**
+ * @brief Runs f(lo, hi) over the chunks of [begin, end) on the
+ * threads of the shared pool
+ * @details See ThreadPool::parallel_for()
+ *
+ * @param begin First iteration
+ * @param end Past the last iteration
+ * @param f Function object
+ * @param grain Number of iterations in chunk (0 - automatic)
+ */
+template <typename F>
+void parallel_for(int begin, int end, F f, int grain = 0)
+{
+	ThreadPool::instance().parallel_for(begin, end, f, grain);
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,519 @@
+#ifndef POWERS_H
+#define POWERS_H
+
+#include <vector>
+#include <algorithm>
+
+#include "vector.h"
+#include "csr.h"
+#include "fused.h"
+#include "exception.h"
+#include "parallel.h"
+#include "cacheinfo.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Largest ratio of work of blocked kernel (owned rows plus
+ * ghost zones of all levels) to the work of plain products, above
+ * which MatrixPowers falls back to plain products
+ */
+const double MPK_MAX_REDUNDANCY = 1.5;
+
+/**
+ * @brief Matrix powers kernel: x, A x, A^2 x, ..., A^k x
+ * (or any polynomial basis given by three-term recurrence) with
+ * the matrix read once per block instead of once per product.
+ * @details Rows are split into blocks whose working set fits in L2
+ * cache. For every block the rows needed by each level are found
+ * from the pattern: level k needs the owned rows, level j - 1 the
+ * rows of level j and all their columns (the ghost zone). Local
+ * rows are ordered by level (owned rows first, then the ghost
+ * rows added by every level), so each level computes a prefix of
+ * local rows. A block gathers x once, then computes all the levels
+ * while its rows stay in cache; ghost rows are computed
+ * redundantly by neighbouring blocks, no communication between
+ * blocks is needed.
+ *
+ * Only the local column indices are stored: values are read from
+ * the matrix, so CSR::set_values() is seen by the kernel. Every
+ * row is computed by the same operations as by CSR::multiply() and
+ * multi_axpy(), so the results do not depend on blocks nor on the
+ * number of threads. Patterns that need too large ghost zones (see
+ * MPK_MAX_REDUNDANCY) are multiplied by plain products.
+ *
+ * Arrays (concatenated over blocks):
+ * - bptr - first owned row of every block (nblocks + 1 elements)
+ * - count - number of local rows of every level 0..k of block
+ * - loff, lrow - local rows of block b: global rows
+ *   lrow[loff[b]..loff[b + 1])
+ * - poff, lptr, jloc - elements of local row r of block b:
+ *   local columns jloc[lptr[poff[b] + r]..lptr[poff[b] + r + 1])
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class MatrixPowers
+{
+	const CSR<T> &_A;
+	int _k;
+	int _nblocks;
+	int _max_local;
+	bool _blocked;
+	double _redundancy;
+
+	std::vector<int> _bptr;
+	std::vector<int> _count;
+	std::vector<long long> _loff;
+	std::vector<int> _lrow;
+	std::vector<long long> _poff;
+	std::vector<long long> _lptr;
+	std::vector<int> _jloc;
+
+	mutable std::vector<T> _work;
+
+	MatrixPowers(const MatrixPowers &);
+	MatrixPowers& operator= (const MatrixPowers &);
+
+	/**
+	 * @brief Finds the local rows and columns of block [lo, hi)
+	 *
+	 * @param lo First owned row
+	 * @param hi Past the last owned row
+	 * @param stamp Mark of block in mark
+	 * @param mark Block that last visited the row (rows elements)
+	 * @param local Local index of row in that block
+	 * @param rows Result: global rows by levels
+	 * @param count Result: number of rows of levels 0..k
+	 * @param ptr Result: first element of every local row of level 1
+	 * @param cols Result: local columns
+	 */
+	void build_block(int lo, int hi, int stamp, int *mark, int *local,
+					 std::vector<int> &rows, int *count,
+					 std::vector<long long> &ptr, std::vector<int> &cols) const
+	{
+		const int *iptr = _A.iptr();
+		const int *jptr = _A.jptr();
+
+		rows.clear();
+		ptr.clear();
+		cols.clear();
+
+		for (int i = lo; i < hi; ++i) {
+			mark[i] = stamp;
+			local[i] = i - lo;
+			rows.push_back(i);
+		}
+
+		count[_k] = hi - lo;
+		size_t frontier = 0;
+
+		for (int j = _k; j > 0; --j) {
+			size_t end = rows.size();
+
+			for (size_t r = frontier; r < end; ++r) {
+				int i = rows[r];
+
+				for (int t = iptr[i]; t < iptr[i + 1]; ++t) {
+					if (mark[jptr[t]] != stamp) {
+						mark[jptr[t]] = stamp;
+						rows.push_back(jptr[t]);
+					}
+				}
+			}
+
+			// New rows of level in global order (for locality)
+			std::sort(rows.begin() + end, rows.end());
+
+			for (size_t r = end; r < rows.size(); ++r) {
+				local[rows[r]] = (int)r;
+			}
+
+			frontier = end;
+			count[j - 1] = (int)rows.size();
+		}
+
+		ptr.push_back(0);
+
+		for (int r = 0; r < count[1]; ++r) {
+			int i = rows[r];
+
+			for (int t = iptr[i]; t < iptr[i + 1]; ++t) {
+				cols.push_back(local[jptr[t]]);
+			}
+
+			ptr.push_back((long long)cols.size());
+		}
+	}
+
+	/**
+	 * @brief Computes s levels of block b
+	 *
+	 * @param b Block
+	 * @param x Start vector
+	 * @param xm Vector before start (0 if none)
+	 * @param y Results
+	 * @param s Number of levels
+	 * @param alpha, beta, gamma Coefficients of recurrence
+	 * @param work Local vectors (3 * max_local elements)
+	 */
+	void run_block(int b, const T *x, const T *xm, Vector<T> *const *y,
+				   int s, const T *alpha, const T *beta, const T *gamma,
+				   T *work) const
+	{
+		const int *iptr = _A.iptr();
+		const T *aelem = _A.aelem();
+		T eval = _A.eval();
+
+		const int *count = &_count[b * (_k + 1)];
+		const int *rows = &_lrow[_loff[b]];
+		const long long *ptr = &_lptr[_poff[b]];
+		const int *cols = &_jloc[0];
+		int owned = _bptr[b + 1] - _bptr[b];
+		int lo = _bptr[b];
+
+		T *prev = work;
+		T *cur = work + _max_local;
+		T *next = work + 2 * _max_local;
+
+		// Level j of s takes the rows of level k - s + j
+		int base = _k - s;
+
+		for (int r = 0; r < count[base]; ++r) {
+			cur[r] = x[rows[r]];
+		}
+
+		if (xm) {
+			for (int r = 0; r < count[base + 1]; ++r) {
+				prev[r] = xm[rows[r]];
+			}
+		}
+
+		for (int j = 0; j < s; ++j) {
+			int n = count[base + j + 1];
+			bool three = (j > 0 || xm) && beta && beta[j] != T();
+			T a = alpha ? -alpha[j] : T();
+			T c = three ? -beta[j] : T();
+			T scale = gamma ? 1 / gamma[j] : T(1);
+			T *yj = y[j]->data() + lo;
+
+			for (int r = 0; r < n; ++r) {
+				const T *ar = aelem + iptr[rows[r]];
+				const int *cr = cols + ptr[r];
+				int len = (int)(ptr[r + 1] - ptr[r]);
+				T sum = eval;
+
+				for (int t = 0; t < len; ++t) {
+					sum += ar[t] * cur[cr[t]];
+				}
+
+				// Same operations as multi_axpy()
+				if (alpha || three) {
+					sum += a * cur[r];
+				}
+
+				if (three) {
+					sum += c * prev[r];
+				}
+
+				if (scale != T(1)) {
+					sum *= scale;
+				}
+
+				next[r] = sum;
+
+				if (r < owned) {
+					yj[r] = sum;
+				}
+			}
+
+			T *tmp = prev;
+			prev = cur;
+			cur = next;
+			next = tmp;
+		}
+	}
+
+	/**
+	 * @brief Computes s levels by plain products
+	 */
+	void run_plain(const Vector<T> &x, const Vector<T> *xm,
+				   Vector<T> *const *y, int s, const T *alpha,
+				   const T *beta, const T *gamma) const
+	{
+		for (int j = 0; j < s; ++j) {
+			const Vector<T> *cur = (j > 0) ? y[j - 1] : &x;
+			const Vector<T> *prev = (j > 1) ? y[j - 2] : ((j == 1) ? &x : xm);
+			bool three = prev && beta && beta[j] != T();
+
+			const Vector<T> *v[2] = {cur, prev};
+			T coef[2] = {alpha ? alpha[j] : T(), three ? beta[j] : T()};
+			int nv = three ? 2 : (alpha ? 1 : 0);
+
+			_A.multiply(*cur, *y[j]);
+			multi_axpy(T(-1), coef, v, nv, *y[j], gamma ? 1 / gamma[j] : T(1));
+		}
+	}
+
+public:
+	/**
+	 * @brief Chooses the number of owned rows per block from cache
+	 * sizes
+	 * @details The rows of block (values, columns and the local
+	 * vectors) take half of the L2 cache, the other half is left
+	 * for ghost zones.
+	 *
+	 * @param mtrx CSR matrix
+	 * @return Number of rows in block
+	 */
+	static int auto_block_rows(const CSR<T> &mtrx)
+	{
+		double per_row = 2 * sizeof(int) + 3 * sizeof(T);
+
+		if (mtrx.rows() > 0) {
+			per_row += (double)mtrx.size_of_aelem() / mtrx.rows() *
+					   (sizeof(T) + 2 * sizeof(int));
+		}
+
+		long rows = (long)(CacheInfo::instance().l2() / (2 * per_row));
+
+		return (int)std::max(256L, rows);
+	}
+
+	/**
+	 * @brief Creates the matrix powers kernel for square CSR matrix
+	 * @details Blocks are built in parallel.
+	 *
+	 * @param mtrx CSR matrix (must outlive the kernel)
+	 * @param k Largest number of products made at once
+	 * @param block_rows Owned rows per block (0 - chosen from cache
+	 * sizes, see auto_block_rows())
+	 */
+	MatrixPowers(const CSR<T> &mtrx, int k, int block_rows = 0)
+		: _A(mtrx), _k(std::max(k, 1)), _nblocks(0), _max_local(0),
+		  _blocked(false), _redundancy(1)
+	{
+		if (mtrx.rows() != mtrx.cols()) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("MatrixPowers::MatrixPowers", 0);
+
+		int n = mtrx.rows();
+		int nthreads = num_threads();
+		int rows = (block_rows > 0) ? block_rows : auto_block_rows(mtrx);
+
+		// Every thread gets a block at least
+		rows = std::max(1, std::min(rows, (n + nthreads - 1) / std::max(nthreads, 1)));
+		_nblocks = (n + rows - 1) / rows;
+
+		_bptr.resize(_nblocks + 1);
+		for (int b = 0; b <= _nblocks; ++b) {
+			_bptr[b] = (int)std::min((long long)b * rows, (long long)n);
+		}
+
+		if (_k == 1 || n == 0) {
+			return;
+		}
+
+		const int *iptr = mtrx.iptr();
+
+		std::vector< std::vector<int> > brows(_nblocks);
+		std::vector< std::vector<long long> > bptr(_nblocks);
+		std::vector< std::vector<int> > bcols(_nblocks);
+		std::vector<double> work(_nblocks, 0);
+
+		_count.resize((size_t)_nblocks * (_k + 1));
+
+		parallel([&](int tid, int nt) {
+			SPARSE_TRACE_SCOPE("MatrixPowers::build");
+
+			int first = (int)((long long)_nblocks * tid / nt);
+			int last = (int)((long long)_nblocks * (tid + 1) / nt);
+
+			if (first == last) {
+				return;
+			}
+
+			std::vector<int> mark(n, -1);
+			std::vector<int> local(n);
+
+			for (int b = first; b < last; ++b) {
+				int *count = &_count[(size_t)b * (_k + 1)];
+
+				build_block(_bptr[b], _bptr[b + 1], b, &mark[0], &local[0],
+							brows[b], count, bptr[b], bcols[b]);
+
+				for (int j = 1; j <= _k; ++j) {
+					for (int r = 0; r < count[j]; ++r) {
+						int i = brows[b][r];
+						work[b] += iptr[i + 1] - iptr[i] + 1;
+					}
+				}
+			}
+		});
+
+		double total = 0;
+
+		for (int b = 0; b < _nblocks; ++b) {
+			total += work[b];
+		}
+
+		_redundancy = total / ((double)_k * (mtrx.size_of_aelem() + n));
+
+		if (_redundancy > MPK_MAX_REDUNDANCY) {
+			_count.clear();
+			return;
+		}
+
+		_loff.resize(_nblocks + 1);
+		_poff.resize(_nblocks + 1);
+		_loff[0] = 0;
+		_poff[0] = 0;
+
+		long long cols = 0;
+
+		for (int b = 0; b < _nblocks; ++b) {
+			_loff[b + 1] = _loff[b] + (long long)brows[b].size();
+			_poff[b + 1] = _poff[b] + (long long)bptr[b].size();
+			_max_local = std::max(_max_local, (int)brows[b].size());
+		}
+
+		_lrow.resize(_loff[_nblocks]);
+		_lptr.resize(_poff[_nblocks]);
+
+		for (int b = 0; b < _nblocks; ++b) {
+			std::copy(brows[b].begin(), brows[b].end(), _lrow.begin() + _loff[b]);
+
+			for (size_t r = 0; r < bptr[b].size(); ++r) {
+				_lptr[_poff[b] + r] = cols + bptr[b][r];
+			}
+
+			cols += (long long)bcols[b].size();
+		}
+
+		_jloc.resize(cols);
+		cols = 0;
+
+		for (int b = 0; b < _nblocks; ++b) {
+			std::copy(bcols[b].begin(), bcols[b].end(), _jloc.begin() + cols);
+			cols += (long long)bcols[b].size();
+		}
+
+		_blocked = true;
+	}
+
+	/**
+	 * @brief Gets the largest number of products made at once
+	 * @return k
+	 */
+	int k() const
+	{
+		return _k;
+	}
+
+	/**
+	 * @brief Gets the number of blocks
+	 * @return Number of blocks
+	 */
+	int blocks() const
+	{
+		return _nblocks;
+	}
+
+	/**
+	 * @brief Checks if the kernel is blocked (otherwise plain
+	 * products are made)
+	 * @return true if blocked
+	 */
+	bool blocked() const
+	{
+		return _blocked;
+	}
+
+	/**
+	 * @brief Gets the ratio of work of blocked kernel to the work
+	 * of plain products (see MPK_MAX_REDUNDANCY)
+	 * @return Redundancy
+	 */
+	double redundancy() const
+	{
+		return _redundancy;
+	}
+
+	/**
+	 * @brief Computes y[j] = (A y[j - 1] - alpha[j] y[j - 1] -
+	 * beta[j] y[j - 2]) / gamma[j] for j = 0, ..., s - 1, where
+	 * y[-1] = x and y[-2] = xm
+	 * @details With zero coefficients (the default) the result is
+	 * A x, A^2 x, ..., A^s x. More than k products are made k at a
+	 * time.
+	 *
+	 * @param x Start vector
+	 * @param y Results (s vectors of size of matrix)
+	 * @param s Number of products
+	 * @param alpha Shifts (0 - none)
+	 * @param beta Coefficients of y[j - 2] (0 - none)
+	 * @param gamma Divisors (0 - none)
+	 * @param xm Vector before x (for beta[0]; 0 - none)
+	 */
+	void run(const Vector<T> &x, Vector<T> *const *y, int s,
+			 const T *alpha = 0, const T *beta = 0, const T *gamma = 0,
+			 const Vector<T> *xm = 0) const
+	{
+		int n = _A.rows();
+
+		if (x.size() != n || (xm && xm->size() != n)) {
+			throw MultSizeMismatch();
+		}
+
+		for (int j = 0; j < s; ++j) {
+			if (y[j]->size() != n) {
+				throw MultSizeMismatch();
+			}
+		}
+
+		SPARSE_PROFILE_SCOPE("MatrixPowers::run",
+			(long long)_A.size_of_aelem() * (sizeof(T) + sizeof(int)) +
+			(n + 1LL) * sizeof(int) + (s + 2LL) * n * sizeof(T));
+
+		for (int j = 0; j < s; j += _k) {
+			int chunk = std::min(_k, s - j);
+			const Vector<T> &start = (j > 0) ? *y[j - 1] : x;
+			const Vector<T> *before = (j > 1) ? y[j - 2] : ((j == 1) ? &x : xm);
+
+			const T *a = alpha ? alpha + j : 0;
+			const T *c = beta ? beta + j : 0;
+			const T *g = gamma ? gamma + j : 0;
+
+			if (!_blocked) {
+				run_plain(start, before, y + j, chunk, a, c, g);
+				continue;
+			}
+
+			int nthreads = num_threads();
+			size_t per_thread = 3 * (size_t)_max_local;
+
+			if (_work.size() < nthreads * per_thread) {
+				_work.resize(nthreads * per_thread);
+			}
+
+			const T *px = start.data();
+			const T *pxm = before ? before->data() : 0;
+
+			parallel([&](int tid, int nt) {
+				SPARSE_TRACE_SCOPE("MatrixPowers::run");
+
+				int first = (int)((long long)_nblocks * tid / nt);
+				int last = (int)((long long)_nblocks * (tid + 1) / nt);
+				T *work = &_work[tid * per_thread];
+
+				for (int b = first; b < last; ++b) {
+					run_block(b, px, pxm, y + j, chunk, a, c, g, work);
+				}
+			});
+		}
+	}
+};
+
+#endif // POWERS_H
@@ -0,0 +1,38 @@
+#ifndef PRECOND_H
+#define PRECOND_H
+
+#include "vector.h"
+
+/**
+ * @brief Interface of preconditioners of Krylov solvers
+ * @details apply() approximates z = A^-1 * r. It must be a fixed
+ * linear operator (the same for every call), since the solvers
+ * precondition from the right and apply it once more to the
+ * combination of basis vectors to update the solution. It may
+ * keep work vectors, therefore it is not const; a preconditioner
+ * serves one solver at a time.
+ *
+ * @tparam T Type of data
+ */
+template <typename T>
+class Preconditioner
+{
+public:
+	virtual ~Preconditioner() {}
+
+	/**
+	 * @brief Gets the size of preconditioned system
+	 * @return Number of rows
+	 */
+	virtual int size() const = 0;
+
+	/**
+	 * @brief Applies the preconditioner
+	 *
+	 * @param r Vector to precondition (e.g. residual)
+	 * @param z Result (of the same size, distinct from r)
+	 */
+	virtual void apply(const Vector<T> &r, Vector<T> &z) = 0;
+};
+
+#endif // PRECOND_H
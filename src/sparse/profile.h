@@ -0,0 +1,542 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "parallel.h"
+
+/**
+ * Instrumentation of hot kernels.
+ *
+ * Kernels mark themselves with SPARSE_PROFILE_SCOPE(name, bytes).
+ * Unless the library is compiled with -DSPARSE_PROFILE the macro
+ * expands to nothing, so neither the timer nor the expression of
+ * bytes is evaluated.
+ *
+ * With profiling compiled in, every scope adds its call, wall time
+ * and estimated bytes touched to the statistics of its kernel.
+ * If Profiler::enable_counters() succeeded, hardware counters
+ * (cycles, instructions, last level cache misses) of all the
+ * threads of parallel kernels are sampled as well. When the pool
+ * replaces its workers (ThreadPool::set_num_threads()), the
+ * counters are reopened for the new ones on entry of the next
+ * kernel.
+ */
+
+/**
+ * @brief Hardware counters sampled by Profiler
+ */
+enum ProfileCounter
+{
+	PROF_CYCLES,
+	PROF_INSTRUCTIONS,
+	PROF_CACHE_MISSES,
+	PROF_NUM_COUNTERS
+};
+
+/**
+ * @brief Accumulated statistics of a single kernel
+ */
+struct KernelStats
+{
+	std::string name;
+	long long calls;
+	long long nanoseconds;
+	long long bytes;
+	long long counters[PROF_NUM_COUNTERS];
+
+	/**
+	 * @brief Gets cumulative time of kernel
+	 * @return Time in seconds
+	 */
+	double seconds() const
+	{
+		return nanoseconds * 1e-9;
+	}
+};
+
+/**
+ * @brief Registry of kernel statistics
+ * @details A single instance is shared by the whole program.
+ * Statistics are stored in preallocated slots and updated with
+ * atomic operations, so kernels may be entered from any thread.
+ */
+class Profiler
+{
+public:
+	/**
+	 * @brief Maximal number of distinct kernels
+	 */
+	static const int MAX_KERNELS = 128;
+
+private:
+	struct Slot
+	{
+		std::string name;
+		std::atomic<long long> calls;
+		std::atomic<long long> nanoseconds;
+		std::atomic<long long> bytes;
+		std::atomic<long long> counters[PROF_NUM_COUNTERS];
+	};
+
+	Slot _slots[MAX_KERNELS];
+	std::atomic<int> _num_slots;
+	std::mutex _mutex;
+
+	std::vector<int> _fds;
+	mutable std::mutex _fds_mutex;
+	long long _closed[PROF_NUM_COUNTERS];
+	std::atomic<unsigned> _epoch;
+	bool _counters_enabled;
+
+	Profiler()
+		: _num_slots(0), _epoch(0), _counters_enabled(false)
+	{
+		for (int c = 0; c < PROF_NUM_COUNTERS; ++c) {
+			_closed[c] = 0;
+		}
+
+		reset();
+	}
+
+	Profiler(const Profiler &);
+	Profiler& operator= (const Profiler &);
+
+#ifdef __linux__
+	/**
+	 * @brief Opens hardware counter for the calling thread
+	 *
+	 * @param config One of PERF_COUNT_HW_* values
+	 * @return File descriptor or -1 on failure
+	 */
+	static int open_counter(unsigned long long config)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+
+	/**
+	 * @brief Opens the counters of every thread of the pool
+	 * @details Fails if any counter cannot be opened or if the
+	 * region did not run on all the threads (e.g. when called
+	 * from inside of a region)
+	 *
+	 * @param fds Output descriptors, PROF_NUM_COUNTERS per thread
+	 * @return True on success
+	 */
+	static bool open_counters(std::vector<int> &fds)
+	{
+		static const unsigned long long configs[PROF_NUM_COUNTERS] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES
+		};
+
+		int nthreads = num_threads();
+		fds.assign(nthreads * PROF_NUM_COUNTERS, -1);
+
+		parallel([&](int t, int) {
+			for (int c = 0; c < PROF_NUM_COUNTERS; ++c) {
+				fds[t * PROF_NUM_COUNTERS + c] = open_counter(configs[c]);
+			}
+		});
+
+		bool ok = true;
+
+		for (size_t k = 0; k < fds.size(); ++k) {
+			ok = ok && (fds[k] >= 0);
+		}
+
+		if (!ok) {
+			for (size_t k = 0; k < fds.size(); ++k) {
+				if (fds[k] >= 0) {
+					close(fds[k]);
+				}
+			}
+			fds.clear();
+		}
+
+		return ok;
+	}
+#endif
+
+public:
+	/**
+	 * @brief Gets the instance of Profiler
+	 * @return Reference to Profiler
+	 */
+	static Profiler& instance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	/**
+	 * @brief Deletes an instance of Profiler
+	 * @details Closes hardware counters
+	 */
+	~Profiler()
+	{
+#ifdef __linux__
+		for (size_t k = 0; k < _fds.size(); ++k) {
+			if (_fds[k] >= 0) {
+				close(_fds[k]);
+			}
+		}
+#endif
+	}
+
+	/**
+	 * @brief Gets the id of kernel by its name
+	 * @details Registers the kernel on first call. Meant to be
+	 * called once per call site (see SPARSE_PROFILE_SCOPE)
+	 *
+	 * @param name Name of kernel
+	 * @return Id of kernel
+	 */
+	int id(const char *name)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		int num = _num_slots.load();
+
+		for (int k = 0; k < num; ++k) {
+			if (_slots[k].name == name) {
+				return k;
+			}
+		}
+
+		if (num == MAX_KERNELS) {
+			return MAX_KERNELS - 1;
+		}
+
+		_slots[num].name = name;
+		_num_slots.store(num + 1);
+		return num;
+	}
+
+	/**
+	 * @brief Enables sampling of hardware counters
+	 * @details Opens cycles, instructions and cache misses counters
+	 * with perf_event_open for every thread used by parallel
+	 * kernels. Fails if the kernel does not allow it (see
+	 * /proc/sys/kernel/perf_event_paranoid) or on non-Linux systems.
+	 *
+	 * @return True if counters are enabled
+	 */
+	bool enable_counters()
+	{
+#ifdef __linux__
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_counters_enabled) {
+			return true;
+		}
+
+		unsigned epoch = ThreadPool::instance().epoch();
+		std::vector<int> fds;
+
+		if (!open_counters(fds)) {
+			return false;
+		}
+
+		_fds = fds;
+		_epoch.store(epoch);
+		_counters_enabled = true;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Reopens the counters if the pool replaced its workers
+	 * @details Counters of old workers are closed and their final
+	 * values are kept, so read_counters() never goes back. If the
+	 * new counters cannot be opened (e.g. inside of a region),
+	 * the old ones are kept and the next call retries.
+	 */
+	void update_counters()
+	{
+#ifdef __linux__
+		if (!_counters_enabled ||
+			_epoch.load() == ThreadPool::instance().epoch()) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		unsigned epoch = ThreadPool::instance().epoch();
+
+		if (_epoch.load() == epoch) {
+			return;
+		}
+
+		std::vector<int> fds;
+
+		if (!open_counters(fds)) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> fds_lock(_fds_mutex);
+
+		for (size_t k = 0; k < _fds.size(); ++k) {
+			long long val = 0;
+
+			if (read(_fds[k], &val, sizeof(val)) == sizeof(val)) {
+				_closed[k % PROF_NUM_COUNTERS] += val;
+			}
+
+			close(_fds[k]);
+		}
+
+		_fds = fds;
+		_epoch.store(epoch);
+#endif
+	}
+
+	/**
+	 * @brief Checks if hardware counters are sampled
+	 * @return True if counters are enabled
+	 */
+	bool counters_enabled() const
+	{
+		return _counters_enabled;
+	}
+
+	/**
+	 * @brief Reads hardware counters summed over all threads
+	 *
+	 * @param values Output array of PROF_NUM_COUNTERS values
+	 */
+	void read_counters(long long *values) const
+	{
+		std::lock_guard<std::mutex> lock(_fds_mutex);
+
+		for (int c = 0; c < PROF_NUM_COUNTERS; ++c) {
+			values[c] = _closed[c];
+		}
+
+#ifdef __linux__
+		for (size_t k = 0; k < _fds.size(); ++k) {
+			long long val = 0;
+
+			if (read(_fds[k], &val, sizeof(val)) == sizeof(val)) {
+				values[k % PROF_NUM_COUNTERS] += val;
+			}
+		}
+#endif
+	}
+
+	/**
+	 * @brief Adds a call of kernel to statistics
+	 *
+	 * @param id Id of kernel
+	 * @param nanoseconds Duration of call
+	 * @param bytes Estimated number of bytes touched
+	 * @param counters Increments of hardware counters (or null)
+	 */
+	void add(int id, long long nanoseconds, long long bytes,
+			 const long long *counters)
+	{
+		Slot &slot = _slots[id];
+
+		slot.calls.fetch_add(1, std::memory_order_relaxed);
+		slot.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+		slot.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+		if (counters != 0) {
+			for (int c = 0; c < PROF_NUM_COUNTERS; ++c) {
+				slot.counters[c].fetch_add(counters[c],
+										   std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * @brief Gets statistics of all the kernels that were
+	 * entered at least once
+	 * @return Vector of KernelStats
+	 */
+	std::vector<KernelStats> stats() const
+	{
+		std::vector<KernelStats> res;
+		int num = _num_slots.load();
+
+		for (int k = 0; k < num; ++k) {
+			const Slot &slot = _slots[k];
+
+			if (slot.calls.load() == 0) {
+				continue;
+			}
+
+			KernelStats stats;
+			stats.name = slot.name;
+			stats.calls = slot.calls.load();
+			stats.nanoseconds = slot.nanoseconds.load();
+			stats.bytes = slot.bytes.load();
+
+			for (int c = 0; c < PROF_NUM_COUNTERS; ++c) {
+				stats.counters[c] = slot.counters[c].load();
+			}
+
+			res.push_back(stats);
+		}
+
+		return res;
+	}
+
+	/**
+	 * @brief Clears all the statistics
+	 * @details Registered kernels are kept
+	 */
+	void reset()
+	{
+		for (int k = 0; k < MAX_KERNELS; ++k) {
+			_slots[k].calls.store(0);
+			_slots[k].nanoseconds.store(0);
+			_slots[k].bytes.store(0);
+
+			for (int c = 0; c < PROF_NUM_COUNTERS; ++c) {
+				_slots[k].counters[c].store(0);
+			}
+		}
+	}
+
+	/**
+	 * @brief Prints statistics as a text table
+	 * @details Bandwidth is estimated from the bytes reported by
+	 * kernels; with hardware counters also from cache misses
+	 * (64 bytes per miss)
+	 *
+	 * @param out Output stream
+	 */
+	void report(std::ostream &out) const
+	{
+		std::vector<KernelStats> all = stats();
+
+		out << std::left << std::setw(32) << "kernel"
+			<< std::right << std::setw(10) << "calls"
+			<< std::setw(14) << "total, ms"
+			<< std::setw(14) << "per call, us"
+			<< std::setw(10) << "GB/s";
+
+		if (_counters_enabled) {
+			out << std::setw(16) << "cycles"
+				<< std::setw(8) << "IPC"
+				<< std::setw(14) << "LLC misses"
+				<< std::setw(12) << "DRAM GB/s";
+		}
+
+		out << std::endl;
+
+		for (size_t k = 0; k < all.size(); ++k) {
+			const KernelStats &s = all[k];
+			double sec = s.seconds();
+
+			out << std::left << std::setw(32) << s.name
+				<< std::right << std::setw(10) << s.calls
+				<< std::setw(14) << sec * 1e3
+				<< std::setw(14) << sec * 1e6 / s.calls
+				<< std::setw(10) << (sec > 0 ? s.bytes / sec / 1e9 : 0);
+
+			if (_counters_enabled) {
+				long long cycles = s.counters[PROF_CYCLES];
+
+				out << std::setw(16) << cycles
+					<< std::setw(8) << (cycles > 0 ?
+						(double)s.counters[PROF_INSTRUCTIONS] / cycles : 0)
+					<< std::setw(14) << s.counters[PROF_CACHE_MISSES]
+					<< std::setw(12) << (sec > 0 ?
+						64.0 * s.counters[PROF_CACHE_MISSES] / sec / 1e9 : 0);
+			}
+
+			out << std::endl;
+		}
+	}
+};
+
+/**
+ * @brief Measures the scope of kernel
+ * @details Created by SPARSE_PROFILE_SCOPE. Reports to Profiler
+ * on destruction.
+ */
+class ProfileScope
+{
+	int _id;
+	long long _bytes;
+	std::chrono::steady_clock::time_point _start;
+	long long _counters[PROF_NUM_COUNTERS];
+
+public:
+	ProfileScope(int id, long long bytes)
+		: _id(id), _bytes(bytes)
+	{
+		Profiler &prof = Profiler::instance();
+
+		if (prof.counters_enabled()) {
+			prof.update_counters();
+			prof.read_counters(_counters);
+		}
+
+		_start = std::chrono::steady_clock::now();
+	}
+
+	~ProfileScope()
+	{
+		std::chrono::steady_clock::time_point end =
+			std::chrono::steady_clock::now();
+		Profiler &prof = Profiler::instance();
+
+		long long ns = std::chrono::duration_cast<
+			std::chrono::nanoseconds>(end - _start).count();
+
+		if (prof.counters_enabled()) {
+			long long counters[PROF_NUM_COUNTERS];
+			prof.read_counters(counters);
+
+			for (int c = 0; c < PROF_NUM_COUNTERS; ++c) {
+				counters[c] -= _counters[c];
+			}
+
+			prof.add(_id, ns, _bytes, counters);
+		}
+		else {
+			prof.add(_id, ns, _bytes, 0);
+		}
+	}
+};
+
+#ifdef SPARSE_PROFILE
+#define SPARSE_PROFILE_CONCAT_(a, b) a##b
+#define SPARSE_PROFILE_CONCAT(a, b) SPARSE_PROFILE_CONCAT_(a, b)
+#define SPARSE_PROFILE_SCOPE(name, bytes) \
+	static const int SPARSE_PROFILE_CONCAT(prof_id_, __LINE__) = \
+		Profiler::instance().id(name); \
+	ProfileScope SPARSE_PROFILE_CONCAT(prof_scope_, __LINE__)( \
+		SPARSE_PROFILE_CONCAT(prof_id_, __LINE__), (long long)(bytes))
+#else
+#define SPARSE_PROFILE_SCOPE(name, bytes)
+#endif
+
+#endif // PROFILE_H
@@ -0,0 +1,323 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "vector.h"
+#include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Summation modes of reductions
+ * - SUM_PAIRWISE - lanes and a fixed pairwise tree
+ * - SUM_COMPENSATED - the same order, but every addition (and
+ *   every product) keeps its rounding error (TwoSum / TwoProduct,
+ *   as in Kahan-Babuska-Neumaier summation and Ogita-Rump-Oishi
+ *   Dot2), so the result is as accurate as if computed in twice
+ *   the precision
+ */
+enum SumMode
+{
+	SUM_PAIRWISE,
+	SUM_COMPENSATED
+};
+
+/**
+ * @brief Elements in a leaf of reduction tree
+ * @details Leaves do not depend on the number of threads: a
+ * thread always sums whole leaves, and the sums of leaves are
+ * combined by the same tree, so results are bit-reproducible
+ * for any number of threads
+ */
+const int REDUCE_CHUNK = 2048;
+
+/**
+ * @brief Independent accumulators inside a leaf (SIMD lanes)
+ */
+const int REDUCE_LANES = 4;
+
+/**
+ * @brief Adds b to a keeping the rounding error in e (TwoSum)
+ */
+template <typename T>
+inline void two_sum(T &a, T b, T &e)
+{
+	T s = a + b;
+	T z = s - a;
+	e += (a - (s - z)) + (b - z);
+	a = s;
+}
+
+/**
+ * @brief Sums a leaf: term(i, e) returns the i-th term and adds
+ * its rounding error (if any) to e
+ *
+ * @param term Function object
+ * @param lo First index
+ * @param hi Past the last index
+ * @param mode Summation mode
+ * @param sum Sum of leaf
+ * @param comp Error of sum (zero in SUM_PAIRWISE mode)
+ */
+template <typename T, typename F>
+void reduce_leaf(F term, int lo, int hi, SumMode mode, T &sum, T &comp)
+{
+	T s[REDUCE_LANES];
+	T c[REDUCE_LANES];
+
+	for (int l = 0; l < REDUCE_LANES; ++l) {
+		s[l] = T();
+		c[l] = T();
+	}
+
+	int i = lo;
+
+	if (mode == SUM_PAIRWISE) {
+		for (; i + REDUCE_LANES <= hi; i += REDUCE_LANES) {
+			for (int l = 0; l < REDUCE_LANES; ++l) {
+				s[l] += term(i + l, c[l]);
+			}
+		}
+
+		for (int l = 0; i < hi; ++i, ++l) {
+			s[l] += term(i, c[l]);
+		}
+
+		sum = (s[0] + s[1]) + (s[2] + s[3]);
+		comp = T();
+		return;
+	}
+
+	for (; i + REDUCE_LANES <= hi; i += REDUCE_LANES) {
+		for (int l = 0; l < REDUCE_LANES; ++l) {
+			two_sum(s[l], term(i + l, c[l]), c[l]);
+		}
+	}
+
+	for (int l = 0; i < hi; ++i, ++l) {
+		two_sum(s[l], term(i, c[l]), c[l]);
+	}
+
+	T e = (c[0] + c[1]) + (c[2] + c[3]);
+	two_sum(s[0], s[1], e);
+	two_sum(s[2], s[3], e);
+	two_sum(s[0], s[2], e);
+
+	sum = s[0];
+	comp = e;
+}
+
+/**
+ * @brief Term of dot product; in compensated mode the rounding
+ * error of product is found with fma (TwoProduct)
+ */
+template <typename T>
+struct DotTerm
+{
+	const T *a;
+	const T *b;
+	bool exact;
+
+	T operator() (int i, T &e) const
+	{
+		T p = a[i] * b[i];
+
+		if (exact) {
+			e += fma(a[i], b[i], -p);
+		}
+
+		return p;
+	}
+};
+
+/**
+ * @brief Term of sum of absolute values
+ */
+template <typename T>
+struct AbsTerm
+{
+	const T *a;
+
+	T operator() (int i, T &e) const
+	{
+		(void)e;
+		return (a[i] < 0) ? -a[i] : a[i];
+	}
+};
+
+/**
+ * @brief Sums the leaves by fixed pairwise tree
+ * @details Component k of leaf p is at part[p * stride + k], its
+ * error at part[p * stride + ncomp + k]. The tree depends on the
+ * number of leaves only.
+ *
+ * @param part Sums of leaves
+ * @param lo First leaf
+ * @param hi Past the last leaf
+ * @param stride Distance between leaves (2 * ncomp)
+ * @param k Component
+ * @param mode Summation mode
+ * @param sum Sum
+ * @param comp Error of sum
+ */
+template <typename T>
+void reduce_tree(const T *part, int lo, int hi, int stride, int k,
+				 SumMode mode, T &sum, T &comp)
+{
+	if (hi - lo == 1) {
+		sum = part[(size_t)lo * stride + k];
+		comp = part[(size_t)lo * stride + stride / 2 + k];
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	T s2, c2;
+
+	reduce_tree(part, lo, mid, stride, k, mode, sum, comp);
+	reduce_tree(part, mid, hi, stride, k, mode, s2, c2);
+
+	if (mode == SUM_PAIRWISE) {
+		sum += s2;
+		return;
+	}
+
+	comp += c2;
+	two_sum(sum, s2, comp);
+}
+
+/**
+ * @brief Gets the scratch array for sums of leaves
+ * @details Kept per calling thread between reductions, so that
+ * a reduction does not allocate (nor fault pages in) every time
+ *
+ * @param size Number of elements
+ * @return Pointer to array
+ */
+template <typename T>
+T* reduce_scratch(size_t size)
+{
+	static thread_local std::vector<T> scratch;
+
+	if (scratch.size() < size) {
+		scratch.resize(size);
+	}
+
+	return scratch.data();
+}
+
+/**
+ * @brief Combines the sums of leaves of all ncomp components
+ *
+ * @param part Sums of leaves (2 * ncomp per leaf)
+ * @param nleaves Number of leaves
+ * @param ncomp Number of components
+ * @param mode Summation mode
+ * @param res Result (ncomp elements)
+ */
+template <typename T>
+void reduce_combine(const T *part, int nleaves, int ncomp, SumMode mode, T *res)
+{
+	for (int k = 0; k < ncomp; ++k) {
+		T sum = T();
+		T comp = T();
+
+		if (nleaves > 0) {
+			reduce_tree(part, 0, nleaves, 2 * ncomp, k, mode, sum, comp);
+		}
+
+		res[k] = sum + comp;
+	}
+}
+
+/**
+ * @brief Sums n terms in parallel, reproducibly
+ *
+ * @param term Function object, see reduce_leaf()
+ * @param n Number of terms
+ * @param mode Summation mode
+ * @return Sum
+ */
+template <typename T, typename F>
+T reduce_sum(F term, int n, SumMode mode)
+{
+	int nleaves = (n + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+	T *part = reduce_scratch<T>(2 * (size_t)nleaves);
+
+	parallel_for(0, nleaves, [&](int lo, int hi) {
+		for (int p = lo; p < hi; ++p) {
+			reduce_leaf(term, p * REDUCE_CHUNK,
+						std::min((p + 1) * REDUCE_CHUNK, n), mode,
+						part[2 * p], part[2 * p + 1]);
+		}
+	}, std::max(1, nleaves / (4 * num_threads())));
+
+	T res;
+	reduce_combine(part, nleaves, 1, mode, &res);
+	return res;
+}
+
+/**
+ * @brief Dot product of vectors
+ * @details SIMD- and thread-parallel; the result does not depend
+ * on the number of threads (see REDUCE_CHUNK)
+ *
+ * @param a First vector
+ * @param b Second vector (of the same size)
+ * @param mode Summation mode
+ * @return <a, b>
+ */
+template <typename T>
+T dot(const Vector<T> &a, const Vector<T> &b, SumMode mode = SUM_PAIRWISE)
+{
+	if (a.size() != b.size()) {
+		throw VecSizeMismatch();
+	}
+
+	SPARSE_PROFILE_SCOPE("dot", 2LL * a.size() * sizeof(T));
+	SPARSE_TRACE_SCOPE("dot");
+
+	DotTerm<T> term = {a.data(), b.data(), mode == SUM_COMPENSATED};
+	return reduce_sum<T>(term, a.size(), mode);
+}
+
+/**
+ * @brief Euclidean norm of vector
+ * @details See dot()
+ *
+ * @param a Vector
+ * @param mode Summation mode
+ * @return ||a||
+ */
+template <typename T>
+T nrm2(const Vector<T> &a, SumMode mode = SUM_PAIRWISE)
+{
+	SPARSE_PROFILE_SCOPE("nrm2", (long long)a.size() * sizeof(T));
+	SPARSE_TRACE_SCOPE("nrm2");
+
+	DotTerm<T> term = {a.data(), a.data(), mode == SUM_COMPENSATED};
+	return sqrt(reduce_sum<T>(term, a.size(), mode));
+}
+
+/**
+ * @brief Sum of absolute values of elements of vector
+ * @details See dot()
+ *
+ * @param a Vector
+ * @param mode Summation mode
+ * @return |a_0| + ... + |a_n-1|
+ */
+template <typename T>
+T asum(const Vector<T> &a, SumMode mode = SUM_PAIRWISE)
+{
+	SPARSE_PROFILE_SCOPE("asum", (long long)a.size() * sizeof(T));
+	SPARSE_TRACE_SCOPE("asum");
+
+	AbsTerm<T> term = {a.data()};
+	return reduce_sum<T>(term, a.size(), mode);
+}
+
+#endif // REDUCE_H
@@ -0,0 +1,545 @@
+#ifndef SCHWARZ_H
+#define SCHWARZ_H
+
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+#include "vector.h"
+#include "csr.h"
+#include "cslr.h"
+#include "skyline.h"
+#include "precond.h"
+#include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Default largest envelope (elements per triangle) of
+ * a subdomain factored by SkylineLU; larger subdomains are
+ * factored by ILU(0)
+ */
+const long long SCHWARZ_ENVELOPE = 1LL << 22;
+
+/**
+ * @brief Schwarz - block Jacobi and restricted additive Schwarz
+ * preconditioner
+ * @details Rows are split into contiguous blocks (by default one
+ * per thread of the pool). The subdomain of a block is its rows
+ * extended by overlap rows on both sides; its local matrix (the
+ * elements of these rows in the columns of subdomain) is factored
+ * independently of the others:
+ * - by SkylineLU of the local CSLR matrix (the portrait is made
+ *   symmetric by explicit zeros) if its envelope holds at most
+ *   max_envelope elements;
+ * - by ILU(0) of the local CSR matrix otherwise.
+ * The blocks are factored concurrently, and apply() solves all
+ * of them concurrently: each one gathers the residual of its
+ * subdomain, solves in place and writes the rows it owns, so for
+ * a given size of block the result does not depend on the number
+ * of threads. Without overlap it is block Jacobi; with overlap
+ * it is restricted additive Schwarz (RAS, as proposed by Cai and
+ * Sarkis), which is not symmetric, but a fixed operator. Nothing
+ * is allocated by apply().
+ *
+ * Rows of matrix must have sorted column-indices, and the local
+ * matrices must be factorable without pivoting (e.g. A is
+ * diagonally dominant or positive definite).
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class Schwarz : public Preconditioner<T>
+{
+	/**
+	 * @brief Block of rows
+	 * @details Exactly one of lu and ilu is set; x holds the
+	 * local vector of subdomain, flops counts the operations of
+	 * factorization.
+	 */
+	struct Block
+	{
+		int lo;
+		int hi;
+		int first;
+		int last;
+		SkylineLU<T> *lu;
+		CSR<T> *ilu;
+		int *diag;
+		Vector<T> *x;
+		double flops;
+	};
+
+	std::vector<Block> _blocks;
+	int _n;
+	int _overlap;
+
+	Schwarz(const Schwarz &);
+	Schwarz& operator= (const Schwarz &);
+
+	/**
+	 * @brief Deletes the factors of all blocks
+	 */
+	void release()
+	{
+		for (size_t b = 0; b < _blocks.size(); ++b) {
+			delete _blocks[b].lu;
+			delete _blocks[b].ilu;
+			delete[] _blocks[b].diag;
+			delete _blocks[b].x;
+		}
+
+		_blocks.clear();
+	}
+
+	/**
+	 * @brief Extracts the local matrix of rows and columns
+	 * [first, last)
+	 */
+	static CSR<T> extract(const CSR<T> &A, int first, int last)
+	{
+		const int *iptr = A.iptr();
+		const int *jptr = A.jptr();
+		const T *aelem = A.aelem();
+		int m = last - first;
+
+		std::vector<int> lptr(m + 1, 0);
+		std::vector<int> ljptr;
+		std::vector<T> laelem;
+
+		for (int i = first; i < last; ++i) {
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				if (jptr[k] >= first && jptr[k] < last) {
+					ljptr.push_back(jptr[k] - first);
+					laelem.push_back(aelem[k]);
+				}
+			}
+
+			lptr[i - first + 1] = ljptr.size();
+		}
+
+		int nnz = ljptr.size();
+
+		return CSR<T>(nnz ? &laelem[0] : 0, &lptr[0], nnz ? &ljptr[0] : 0,
+					  m, m, nnz);
+	}
+
+	/**
+	 * @brief Counts the envelope of the symmetric portrait of
+	 * square CSR matrix (see SkylineLU::envelope())
+	 */
+	static long long envelope(const CSR<T> &A)
+	{
+		const int *iptr = A.iptr();
+		const int *jptr = A.jptr();
+		int m = A.rows();
+
+		std::vector<int> first(m);
+		long long count = 0;
+
+		for (int i = 0; i < m; ++i) {
+			first[i] = i;
+		}
+
+		for (int i = 0; i < m; ++i) {
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				int j = jptr[k];
+
+				if (j < i) {
+					first[i] = std::min(first[i], j);
+				} else {
+					first[j] = std::min(first[j], i);
+				}
+			}
+		}
+
+		for (int i = 0; i < m; ++i) {
+			count += i - first[i];
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief Factors CSR matrix by ILU(0) in place
+	 * @details L (unit diagonal) and U replace the elements of
+	 * the portrait; diag receives the position of diagonal element
+	 * of every row
+	 *
+	 * @return Number of floating-point operations
+	 */
+	static long long ilu0(CSR<T> &M, int *diag)
+	{
+		const int *iptr = M.iptr();
+		const int *jptr = M.jptr();
+		T *a = M.aelem();
+		int m = M.rows();
+
+		std::vector<int> pos(m, -1);
+		long long flops = 0;
+
+		for (int i = 0; i < m; ++i) {
+			diag[i] = -1;
+
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				pos[jptr[k]] = k;
+
+				if (jptr[k] == i) {
+					diag[i] = k;
+				}
+			}
+
+			if (diag[i] < 0) {
+				throw ZeroPivot(i);
+			}
+
+			// Rows above are complete: eliminate in the order of
+			// columns, keeping the portrait of row i
+			for (int k = iptr[i]; k < diag[i]; ++k) {
+				int j = jptr[k];
+
+				a[k] /= a[diag[j]];
+				++flops;
+
+				for (int kk = diag[j] + 1; kk < iptr[j + 1]; ++kk) {
+					if (pos[jptr[kk]] >= 0) {
+						a[pos[jptr[kk]]] -= a[k] * a[kk];
+						flops += 2;
+					}
+				}
+			}
+
+			if (a[diag[i]] == 0) {
+				throw ZeroPivot(i);
+			}
+
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				pos[jptr[k]] = -1;
+			}
+		}
+
+		return flops;
+	}
+
+	/**
+	 * @brief Solves L U x = b of ILU(0) in place
+	 */
+	static void ilu0_solve(const CSR<T> &M, const int *diag, T *x)
+	{
+		const int *iptr = M.iptr();
+		const int *jptr = M.jptr();
+		const T *a = M.aelem();
+		int m = M.rows();
+
+		for (int i = 0; i < m; ++i) {
+			T s = x[i];
+
+			for (int k = iptr[i]; k < diag[i]; ++k) {
+				s -= a[k] * x[jptr[k]];
+			}
+
+			x[i] = s;
+		}
+
+		for (int i = m - 1; i >= 0; --i) {
+			T s = x[i];
+
+			for (int k = diag[i] + 1; k < iptr[i + 1]; ++k) {
+				s -= a[k] * x[jptr[k]];
+			}
+
+			x[i] = s / a[diag[i]];
+		}
+	}
+
+	/**
+	 * @brief Factors the local matrix of block
+	 */
+	static void factor(const CSR<T> &A, Block &B, long long max_envelope)
+	{
+		CSR<T> local = extract(A, B.first, B.last);
+
+		if (envelope(local) <= max_envelope) {
+			CSR<T> sym = CSR<T>::add(local, local.transpose(), 1, 0);
+			B.lu = new SkylineLU<T>(CSLR<T>(sym));
+
+			double bytes;
+			B.lu->factor_cost(B.flops, bytes);
+		} else {
+			B.ilu = new CSR<T>(local);
+			B.diag = new int[local.rows()];
+			B.flops = (double)ilu0(*B.ilu, B.diag);
+		}
+
+		B.x = new Vector<T>(B.last - B.first);
+	}
+
+	/**
+	 * @brief Splits the rows into blocks and factors them
+	 */
+	void setup(const CSR<T> &A, int block, long long max_envelope)
+	{
+		if (block <= 0) {
+			block = (_n + num_threads() - 1) / num_threads();
+		}
+		block = std::max(1, block);
+
+		for (int lo = 0; lo < _n; lo += block) {
+			Block B;
+			B.lo = lo;
+			B.hi = std::min(lo + block, _n);
+			B.first = std::max(0, B.lo - _overlap);
+			B.last = std::min(_n, B.hi + _overlap);
+			B.lu = 0;
+			B.ilu = 0;
+			B.diag = 0;
+			B.x = 0;
+			B.flops = 0;
+			_blocks.push_back(B);
+		}
+
+		int nblocks = _blocks.size();
+		std::vector<std::exception_ptr> errors(nblocks);
+
+		// Exceptions must not leave the region: the first one (in
+		// the order of blocks) is thrown after it
+		parallel_for(0, nblocks, [&](int lo, int hi) {
+			SPARSE_TRACE_SCOPE("Schwarz::factor");
+
+			for (int b = lo; b < hi; ++b) {
+				try {
+					factor(A, _blocks[b], max_envelope);
+				}
+				catch (const ZeroPivot &e) {
+					errors[b] = std::make_exception_ptr(
+						ZeroPivot(_blocks[b].first + e.row()));
+				}
+				catch (...) {
+					errors[b] = std::current_exception();
+				}
+			}
+		}, 1);
+
+		for (int b = 0; b < nblocks; ++b) {
+			if (errors[b]) {
+				std::rethrow_exception(errors[b]);
+			}
+		}
+	}
+
+public:
+	/**
+	 * @brief Splits CSR matrix into blocks and factors them
+	 *
+	 * @param A Square matrix (not referenced after construction)
+	 * @param block Number of rows in block (0 - one block per
+	 * thread)
+	 * @param overlap Number of rows added to the subdomain of
+	 * block on each side (0 - block Jacobi)
+	 * @param max_envelope Largest envelope factored by SkylineLU
+	 * (0 - ILU(0) only)
+	 */
+	Schwarz(const CSR<T> &A, int block = 0, int overlap = 0,
+			long long max_envelope = SCHWARZ_ENVELOPE)
+		: _n(A.rows()), _overlap(std::max(0, overlap))
+	{
+		if (A.rows() != A.cols()) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("Schwarz::setup", 0);
+		SPARSE_TRACE_SCOPE("Schwarz::setup");
+
+		try {
+			setup(A, block, max_envelope);
+		}
+		catch (...) {
+			release();
+			throw;
+		}
+	}
+
+	/**
+	 * @brief Splits CSLR matrix into blocks and factors them
+	 * @details The blocks are extracted from its CSR copy
+	 *
+	 * @param A Matrix (not referenced after construction)
+	 * @param block Number of rows in block (0 - one block per
+	 * thread)
+	 * @param overlap Number of rows added to the subdomain of
+	 * block on each side (0 - block Jacobi)
+	 * @param max_envelope Largest envelope factored by SkylineLU
+	 * (0 - ILU(0) only)
+	 */
+	Schwarz(const CSLR<T> &A, int block = 0, int overlap = 0,
+			long long max_envelope = SCHWARZ_ENVELOPE)
+		: _n(A.size()), _overlap(std::max(0, overlap))
+	{
+		SPARSE_PROFILE_SCOPE("Schwarz::setup", 0);
+		SPARSE_TRACE_SCOPE("Schwarz::setup");
+
+		try {
+			setup(A.to_csr(), block, max_envelope);
+		}
+		catch (...) {
+			release();
+			throw;
+		}
+	}
+
+	/**
+	 * @brief Deletes an instance of Schwarz
+	 */
+	~Schwarz()
+	{
+		release();
+	}
+
+	/**
+	 * @brief Gets the size of matrix
+	 * @return Number of rows
+	 */
+	int size() const
+	{
+		return _n;
+	}
+
+	/**
+	 * @brief Gets the number of blocks
+	 * @return Number of blocks
+	 */
+	int blocks() const
+	{
+		return _blocks.size();
+	}
+
+	/**
+	 * @brief Gets the number of blocks factored by SkylineLU
+	 * @return Number of blocks (the others use ILU(0))
+	 */
+	int direct_blocks() const
+	{
+		int count = 0;
+
+		for (size_t b = 0; b < _blocks.size(); ++b) {
+			count += (_blocks[b].lu != 0);
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief Gets the overlap of subdomains
+	 * @return Number of rows on each side
+	 */
+	int overlap() const
+	{
+		return _overlap;
+	}
+
+	/**
+	 * @brief Estimates the cost of setup
+	 * @details Operations of the factorizations; the minimal
+	 * traffic is every factor written once
+	 *
+	 * @param flops Number of floating-point operations
+	 * @param bytes Minimal traffic in bytes
+	 */
+	void setup_cost(double &flops, double &bytes) const
+	{
+		flops = 0;
+		bytes = 0;
+
+		for (size_t b = 0; b < _blocks.size(); ++b) {
+			const Block &B = _blocks[b];
+			flops += B.flops;
+
+			if (B.lu) {
+				double f;
+				double bb;
+
+				B.lu->factor_cost(f, bb);
+				bytes += bb;
+			} else {
+				bytes += (double)B.ilu->size_of_aelem() * (sizeof(T) + sizeof(int)) +
+						 (B.ilu->rows() + 1.0) * sizeof(int);
+			}
+		}
+	}
+
+	/**
+	 * @brief Estimates the cost of apply()
+	 * @details Forward and backward substitutions of all blocks,
+	 * and the gather and scatter of their vectors
+	 *
+	 * @param flops Number of floating-point operations
+	 * @param bytes Minimal traffic in bytes
+	 */
+	void apply_cost(double &flops, double &bytes) const
+	{
+		flops = 0;
+		bytes = 0;
+
+		for (size_t b = 0; b < _blocks.size(); ++b) {
+			const Block &B = _blocks[b];
+
+			if (B.lu) {
+				double f;
+				double bb;
+
+				B.lu->solve_cost(f, bb);
+				flops += f;
+				bytes += bb;
+			} else {
+				int m = B.ilu->rows();
+
+				flops += 2.0 * B.ilu->size_of_aelem() - m;
+				bytes += (double)B.ilu->size_of_aelem() * (sizeof(T) + sizeof(int)) +
+						 (m + 1.0) * sizeof(int) + 2.0 * m * sizeof(int) +
+						 3.0 * m * sizeof(T);
+			}
+
+			bytes += (B.last - B.first + B.hi - B.lo) * sizeof(T);
+		}
+	}
+
+	/**
+	 * @brief Applies the preconditioner: solves every subdomain
+	 * for the restriction of r and writes its own rows of z
+	 *
+	 * @param r Vector to precondition
+	 * @param z Result (distinct from r)
+	 */
+	void apply(const Vector<T> &r, Vector<T> &z)
+	{
+		if (r.size() != _n || z.size() != _n) {
+			throw VecSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("Schwarz::apply", 0);
+		SPARSE_TRACE_SCOPE("Schwarz::apply");
+
+		const T *pr = r.data();
+		T *pz = z.data();
+
+		parallel_for(0, (int)_blocks.size(), [&](int lo, int hi) {
+			for (int b = lo; b < hi; ++b) {
+				const Block &B = _blocks[b];
+				T *x = B.x->data();
+
+				std::copy(pr + B.first, pr + B.last, x);
+
+				if (B.lu) {
+					B.lu->solve(*B.x);
+				} else {
+					ilu0_solve(*B.ilu, B.diag, x);
+				}
+
+				std::copy(x + (B.lo - B.first), x + (B.hi - B.first), pz + B.lo);
+			}
+		}, 1);
+	}
+};
+
+#endif // SCHWARZ_H
@@ -0,0 +1,534 @@
+#ifndef SKYLINE_H
+#define SKYLINE_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "vector.h"
+#include "cslr.h"
+#include "cacheinfo.h"
+#include "exception.h"
+#include "parallel.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * @brief Right-hand sides substituted at once by one task of
+ * SkylineLU::solve(): the factor is read once per group
+ */
+const int SKYLINE_RHS_BLOCK = 4;
+
+/**
+ * @brief SkylineLU - direct profile (envelope) factorization of
+ * CSLR matrix.
+ * @details The profile of row i starts in its first nonempty
+ * column f[i]; all the elements between f[i] and the diagonal
+ * (and symmetrically in column i above the diagonal) are stored
+ * densely, since LU without pivoting fills exactly this envelope.
+ * The factors are stored in following vectors:
+ * - first - f[i], first column of profile of row i
+ * - sptr - i-th element holds the position of row i in lower
+ *   (and of column i in upper); row i has i - f[i] elements
+ * - lower - rows of L (unit diagonal, not stored)
+ * - upper - columns of U above the diagonal
+ * - diag - diagonal of U
+ *
+ * Matrices in symmetric mode (or with symmetric values) are
+ * factored as L D L^T: upper is not kept and diag holds D, which
+ * halves both the work and the storage.
+ *
+ * Every element of factor is a dot product of a row of L and a
+ * column of U, both contiguous. Rows are factored in blocks that
+ * fit into L2: the profiles above a block are walked once for the
+ * whole block, and the rows of block are updated concurrently.
+ * There is no pivoting, so the matrix must be e.g. diagonally
+ * dominant or positive definite; a zero pivot throws ZeroPivot.
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class SkylineLU
+{
+	int _size;
+	int _block;
+	bool _symmetric;
+	long long _envelope;
+	long long _flops;
+
+	int *_first;
+	long long *_sptr;
+
+	T *_lower;
+	T *_upper;
+	T *_diag;
+
+	SkylineLU(const SkylineLU &);
+	SkylineLU& operator= (const SkylineLU &);
+
+	/**
+	 * @brief Dot product of two contiguous arrays
+	 * @details Four partial sums hide the latency of addition
+	 * (profiles are long enough for it to dominate)
+	 */
+	static T dot(const T *a, const T *b, int n)
+	{
+		T s0 = T(), s1 = T(), s2 = T(), s3 = T();
+		int k = 0;
+
+		for (; k + 4 <= n; k += 4) {
+			s0 += a[k] * b[k];
+			s1 += a[k + 1] * b[k + 1];
+			s2 += a[k + 2] * b[k + 2];
+			s3 += a[k + 3] * b[k + 3];
+		}
+
+		for (; k < n; ++k) {
+			s0 += a[k] * b[k];
+		}
+
+		return (s0 + s1) + (s2 + s3);
+	}
+
+	/**
+	 * @brief Computes element (i, j) of L and (j, i) of U, j < i
+	 * @details Requires row j and column j to be complete and the
+	 * elements of row and column i left of j to be computed
+	 */
+	void eliminate(int i, int j)
+	{
+		int fi = _first[i];
+		int fj = _first[j];
+		int k0 = std::max(fi, fj);
+		int len = j - k0;
+
+		T *li = _lower + _sptr[i] + (k0 - fi);
+		T *lj = _lower + _sptr[j] + (k0 - fj);
+		T *lij = _lower + _sptr[i] + (j - fi);
+
+		if (_symmetric) {
+			// Row i keeps L D (not yet divided by D) until it
+			// is complete, so the update is a plain dot product
+			*lij -= dot(li, lj, len);
+			return;
+		}
+
+		T *ui = _upper + _sptr[i] + (k0 - fi);
+		T *uj = _upper + _sptr[j] + (k0 - fj);
+
+		*lij = (*lij - dot(li, uj, len)) / _diag[j];
+		_upper[_sptr[i] + (j - fi)] -= dot(lj, ui, len);
+	}
+
+	/**
+	 * @brief Computes the diagonal element of row i after all
+	 * the off-diagonal ones
+	 */
+	void pivot(int i)
+	{
+		int fi = _first[i];
+		int len = i - fi;
+		T *li = _lower + _sptr[i];
+
+		if (_symmetric) {
+			for (int k = 0; k < len; ++k) {
+				T l = li[k] / _diag[fi + k];
+				_diag[i] -= li[k] * l;
+				li[k] = l;
+			}
+		}
+		else {
+			_diag[i] -= dot(li, _upper + _sptr[i], len);
+		}
+
+		if (_diag[i] == T()) {
+			throw ZeroPivot(i);
+		}
+	}
+
+	/**
+	 * @brief Factors the values of matrix within the envelope
+	 *
+	 * @param mtrx CSLR matrix of the same portrait
+	 */
+	void factorize(const CSLR<T> &mtrx)
+	{
+		SPARSE_PROFILE_SCOPE("SkylineLU::factorize",
+			(_symmetric ? 1 : 2) * _envelope * sizeof(T));
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *altr = mtrx.altr();
+		const T *autr = mtrx.autr();
+		const T *adiag = mtrx.adiag();
+		std::atomic<bool> outside(false);
+
+		// Scatter the matrix into the envelope, zeros elsewhere
+		parallel_for(0, _size, [&](int lo, int hi) {
+			for (int i = lo; i < hi; ++i) {
+				if (iptr[i] < iptr[i + 1] && jptr[iptr[i]] < _first[i]) {
+					outside = true;
+					return;
+				}
+
+				T *li = _lower + _sptr[i];
+				std::fill(li, li + (i - _first[i]), T());
+
+				for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+					if (jptr[k] < _first[i] || jptr[k] >= i) {
+						outside = true;
+						return;
+					}
+
+					li[jptr[k] - _first[i]] += altr[k];
+				}
+
+				if (!_symmetric) {
+					T *ui = _upper + _sptr[i];
+					std::fill(ui, ui + (i - _first[i]), T());
+
+					for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+						ui[jptr[k] - _first[i]] += autr[k];
+					}
+				}
+
+				_diag[i] = adiag[i];
+			}
+		});
+
+		if (outside.load()) {
+			throw RefreshPatternMismatch();
+		}
+
+		for (int b = 0; b < _size; b += _block) {
+			int e = std::min(b + _block, _size);
+			int fmin = *std::min_element(_first + b, _first + e);
+
+			// Columns left of the block are complete: each row of
+			// block walks them independently, while the profiles of
+			// block stay in cache and those above it are shared
+			if (fmin < b) {
+				parallel_for(b, e, [&](int lo, int hi) {
+					SPARSE_TRACE_SCOPE("SkylineLU::factorize");
+
+					for (int j = fmin; j < b; ++j) {
+						for (int i = lo; i < hi; ++i) {
+							if (_first[i] <= j) {
+								eliminate(i, j);
+							}
+						}
+					}
+				}, 1);
+			}
+
+			// The triangle of block itself is sequential
+			for (int i = b; i < e; ++i) {
+				for (int j = std::max(_first[i], b); j < i; ++j) {
+					eliminate(i, j);
+				}
+
+				pivot(i);
+			}
+		}
+	}
+
+	/**
+	 * @brief Forward and backward substitution for a group of
+	 * right-hand sides in place
+	 *
+	 * @param x Pointers to right-hand sides (replaced by solutions)
+	 * @param nrhs Number of right-hand sides
+	 */
+	void substitute(T **x, int nrhs) const
+	{
+		// L y = b, row by row
+		for (int i = 0; i < _size; ++i) {
+			int fi = _first[i];
+			const T *li = _lower + _sptr[i];
+
+			for (int r = 0; r < nrhs; ++r) {
+				x[r][i] -= dot(li, x[r] + fi, i - fi);
+			}
+		}
+
+		// D z = y; L^T has unit diagonal then
+		if (_symmetric) {
+			for (int r = 0; r < nrhs; ++r) {
+				for (int i = 0; i < _size; ++i) {
+					x[r][i] /= _diag[i];
+				}
+			}
+		}
+
+		// U x = y (or L^T x = z), column by column
+		const T *factor = _symmetric ? _lower : _upper;
+
+		for (int i = _size - 1; i >= 0; --i) {
+			int fi = _first[i];
+			int len = i - fi;
+			const T *ui = factor + _sptr[i];
+
+			for (int r = 0; r < nrhs; ++r) {
+				T xi = _symmetric ? x[r][i] : x[r][i] / _diag[i];
+				T *xr = x[r] + fi;
+
+				x[r][i] = xi;
+
+				for (int k = 0; k < len; ++k) {
+					xr[k] -= ui[k] * xi;
+				}
+			}
+		}
+	}
+
+public:
+	/**
+	 * @brief Gets the number of elements in the envelope of
+	 * the lower triangle of matrix
+	 * @details Allows to estimate the memory (envelope elements
+	 * of T per stored triangle) before factoring
+	 *
+	 * @param mtrx CSLR matrix
+	 * @return Number of elements
+	 */
+	static long long envelope(const CSLR<T> &mtrx)
+	{
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		long long count = 0;
+
+		for (int i = 0; i < mtrx.size(); ++i) {
+			if (iptr[i] < iptr[i + 1]) {
+				count += i - *std::min_element(jptr + iptr[i], jptr + iptr[i + 1]);
+			}
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief Factors CSLR matrix
+	 * @details L D L^T is used when the matrix is in symmetric
+	 * mode or its values are symmetric
+	 *
+	 * @param mtrx CSLR matrix
+	 * @param block Rows in a block of factorization (0 - as many
+	 * as keep their profiles in half of L2)
+	 */
+	SkylineLU(const CSLR<T> &mtrx, int block = 0)
+	{
+		SPARSE_PROFILE_SCOPE("SkylineLU::SkylineLU", 0);
+
+		_size = mtrx.size();
+		_symmetric = mtrx.symmetric() || mtrx.is_symmetric();
+
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+
+		_first = new int[_size];
+		_sptr = new long long[_size + 1];
+		_sptr[0] = 0;
+
+		for (int i = 0; i < _size; ++i) {
+			_first[i] = i;
+
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				_first[i] = std::min(_first[i], jptr[k]);
+			}
+
+			_sptr[i + 1] = _sptr[i] + (i - _first[i]);
+		}
+
+		_envelope = _sptr[_size];
+
+		// Element (i, j) is a dot product of the overlapping parts
+		// of row i and column j; the pivot one of row i with itself
+		long long madds = 0;
+
+		for (int i = 0; i < _size; ++i) {
+			for (int j = _first[i]; j < i; ++j) {
+				madds += j - std::max(_first[i], _first[j]);
+			}
+
+			madds += i - _first[i];
+		}
+
+		_flops = 2 * madds * (_symmetric ? 1 : 2);
+
+		if (block <= 0) {
+			long long width = (_size > 0) ? _envelope / _size + 1 : 1;
+			long long bytes = (_symmetric ? 1 : 2) * width * sizeof(T);
+
+			block = (int)std::min<long long>(
+				std::max<long long>(CacheInfo::instance().l2() / 2 / bytes, 1),
+				1024);
+		}
+		_block = block;
+
+		_lower = new T[_envelope];
+		_upper = _symmetric ? 0 : new T[_envelope];
+		_diag = new T[_size];
+
+		try {
+			factorize(mtrx);
+		}
+		catch (...) {
+			delete[] _first;
+			delete[] _sptr;
+			delete[] _lower;
+			delete[] _upper;
+			delete[] _diag;
+			throw;
+		}
+	}
+
+	/**
+	 * @brief Deletes an instance of SkylineLU
+	 */
+	~SkylineLU()
+	{
+		delete[] _first;
+		delete[] _sptr;
+		delete[] _lower;
+		delete[] _upper;
+		delete[] _diag;
+	}
+
+	/**
+	 * @brief Gets size of matrix
+	 * @return Size of matrix
+	 */
+	int size() const
+	{
+		return _size;
+	}
+
+	/**
+	 * @brief Checks if the matrix was factored as L D L^T
+	 * @return True for L D L^T
+	 */
+	bool symmetric() const
+	{
+		return _symmetric;
+	}
+
+	/**
+	 * @brief Gets the number of elements in the envelope of
+	 * the lower triangle (the size of lower array)
+	 * @return Number of elements
+	 */
+	long long size_of_envelope() const
+	{
+		return _envelope;
+	}
+
+	/**
+	 * @brief Estimates the cost of factorization
+	 * @details Multiply-adds of the dot products count as two
+	 * operations; the minimal traffic is the factor written once
+	 *
+	 * @param flops Number of floating-point operations
+	 * @param bytes Minimal traffic in bytes
+	 */
+	void factor_cost(double &flops, double &bytes) const
+	{
+		flops = (double)_flops;
+		bytes = (_symmetric ? 1.0 : 2.0) * _envelope * sizeof(T) +
+				(double)_size * sizeof(T);
+	}
+
+	/**
+	 * @brief Estimates the cost of solve() for one right-hand side
+	 * @details Every element of the envelope is used once by the
+	 * forward and once by the backward substitution
+	 *
+	 * @param flops Number of floating-point operations
+	 * @param bytes Minimal traffic in bytes
+	 */
+	void solve_cost(double &flops, double &bytes) const
+	{
+		flops = 4.0 * _envelope + _size;
+		bytes = (_symmetric ? 1.0 : 2.0) * _envelope * sizeof(T) +
+				3.0 * _size * sizeof(T);
+	}
+
+	/**
+	 * @brief Factors new values of matrix of the same portrait
+	 * @details Numeric phase only: the envelope, the blocking and
+	 * all the arrays are reused and nothing is allocated. The
+	 * elements may lie anywhere inside the envelope. Throws
+	 * RefreshPatternMismatch for elements outside of it,
+	 * ValuesNotSymmetric if the factor is L D L^T and the values
+	 * are no longer symmetric, and ZeroPivot; the factor is
+	 * undefined after an exception.
+	 *
+	 * @param mtrx CSLR matrix
+	 */
+	void refactor(const CSLR<T> &mtrx)
+	{
+		if (mtrx.size() != _size) {
+			throw RefreshPatternMismatch();
+		}
+
+		if (_symmetric && !mtrx.symmetric() && !mtrx.is_symmetric()) {
+			throw ValuesNotSymmetric();
+		}
+
+		factorize(mtrx);
+	}
+
+	/**
+	 * @brief Solves the system in place
+	 *
+	 * @param vec Right-hand side, replaced by the solution
+	 */
+	void solve(Vector<T> &vec) const
+	{
+		if (vec.size() != _size) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("SkylineLU::solve",
+			(_symmetric ? 1 : 2) * _envelope * sizeof(T) + 2LL * _size * sizeof(T));
+
+		T *x = vec.data();
+		substitute(&x, 1);
+	}
+
+	/**
+	 * @brief Solves the system for a number of right-hand sides
+	 * in place
+	 * @details Groups of SKYLINE_RHS_BLOCK right-hand sides are
+	 * substituted concurrently; each group reads the factor once.
+	 *
+	 * @param vecs Right-hand sides, replaced by the solutions
+	 */
+	void solve(std::vector< Vector<T> > &vecs) const
+	{
+		int nrhs = vecs.size();
+		std::vector<T*> x(nrhs);
+
+		for (int r = 0; r < nrhs; ++r) {
+			if (vecs[r].size() != _size) {
+				throw MultSizeMismatch();
+			}
+
+			x[r] = vecs[r].data();
+		}
+
+		SPARSE_PROFILE_SCOPE("SkylineLU::solve",
+			((nrhs + SKYLINE_RHS_BLOCK - 1) / SKYLINE_RHS_BLOCK) *
+			(_symmetric ? 1 : 2) * _envelope * sizeof(T) +
+			2LL * nrhs * _size * sizeof(T));
+
+		parallel_for(0, nrhs, [&](int lo, int hi) {
+			SPARSE_TRACE_SCOPE("SkylineLU::solve");
+
+			for (int r = lo; r < hi; r += SKYLINE_RHS_BLOCK) {
+				substitute(&x[r], std::min(SKYLINE_RHS_BLOCK, hi - r));
+			}
+		}, SKYLINE_RHS_BLOCK);
+	}
+};
+
+#endif // SKYLINE_H
@@ -2,18 +2,23 @@
 #define SPARSEVECTOR_H
 
 #include "vectorbase.h"
+#include "vector.h"
 #include "exception.h"
 
 /**
  * @brief Reimplementation of sparse mathematical
  * vector.
  * @details Provides basic arithmetic operators
- * 
+ *
  * Vector is storred in following arrays:
  * - aelem - nonempty elements
  * - iptr - indices of corresponding aelem elements
- * 
- * @tparam T Type of data stored in vector 
+ *
+ * Indices in iptr are kept sorted, so the access to an element
+ * is a binary search and all the operations on two vectors are
+ * linear merges of their iptr arrays.
+ *
+ * @tparam T Type of data stored in vector
  */
 template <typename T>
 class SparseVector : public VectorBase<T>
@@ -22,22 +27,123 @@ class SparseVector : public VectorBase<T>
 	int *_iptr;
 
 	int _num_of_aelem;
+	int _capacity;
+
+	/**
+	 * @brief Finds the position of index in iptr
+	 *
+	 * @param index Position in SparseVector
+	 * @return Position of the first iptr element that
+	 * is not less than index
+	 */
+	int lower_bound(int index) const
+	{
+		int lo = 0;
+		int hi = _num_of_aelem;
+
+		while (lo < hi) {
+			int mid = lo + (hi - lo) / 2;
+
+			if (_iptr[mid] < index) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+
+		return lo;
+	}
+
+	/**
+	 * @brief Reallocates aelem and iptr
+	 *
+	 * @param capacity New number of elements that can be
+	 * stored without reallocation
+	 */
+	void reserve(int capacity)
+	{
+		T *aelem = new T[capacity];
+		int *iptr = new int[capacity];
+
+		for (int k = 0; k < _num_of_aelem; ++k) {
+			aelem[k] = _aelem[k];
+			iptr[k] = _iptr[k];
+		}
+
+		delete[] _aelem;
+		delete[] _iptr;
+
+		_aelem = aelem;
+		_iptr = iptr;
+		_capacity = capacity;
+	}
+
+	/**
+	 * @brief Merges two sparse vectors
+	 * @details Computes alpha * a + beta * b in one pass over
+	 * their nonempty elements
+	 */
+	static SparseVector merge(const SparseVector &a, const SparseVector &b,
+							  T alpha, T beta)
+	{
+		if (a._size != b._size) {
+			throw VecSizeMismatch();
+		}
+
+		SparseVector res(a._size, a._num_of_aelem + b._num_of_aelem);
+
+		int ka = 0;
+		int kb = 0;
+		int k = 0;
+
+		while (ka < a._num_of_aelem && kb < b._num_of_aelem) {
+			if (a._iptr[ka] < b._iptr[kb]) {
+				res._iptr[k] = a._iptr[ka];
+				res._aelem[k++] = alpha * a._aelem[ka++];
+			}
+			else if (a._iptr[ka] > b._iptr[kb]) {
+				res._iptr[k] = b._iptr[kb];
+				res._aelem[k++] = beta * b._aelem[kb++];
+			}
+			else {
+				res._iptr[k] = a._iptr[ka];
+				res._aelem[k++] = alpha * a._aelem[ka++] +
+								  beta * b._aelem[kb++];
+			}
+		}
+
+		for (; ka < a._num_of_aelem; ++ka) {
+			res._iptr[k] = a._iptr[ka];
+			res._aelem[k++] = alpha * a._aelem[ka];
+		}
+
+		for (; kb < b._num_of_aelem; ++kb) {
+			res._iptr[k] = b._iptr[kb];
+			res._aelem[k++] = beta * b._aelem[kb];
+		}
+
+		res._num_of_aelem = k;
+		return res;
+	}
 
 public:
 	/**
 	 * @brief Creates an instance of empty SparseVector
 	 * @details Allocates memory for given number
-	 * of elements. They must be inserted later.
-	 * 
+	 * of elements. They must be inserted later
+	 * (preferably in increasing order of indices).
+	 *
 	 * @param size Size of SparseVector
 	 * @param num_of_nonempty Number of nonempty elements
 	 */
-	SparseVector(int size, int num_of_nonempty)
+	SparseVector(int size, int num_of_nonempty = 0)
 		: VectorBase<T>(size)
 	{
-		_num_of_aelem = num_of_nonempty;
-		_aelem = new T[_num_of_aelem];
-		_iptr = new int[_num_of_aelem];
+		_num_of_aelem = 0;
+		_capacity = num_of_nonempty;
+		_aelem = new T[_capacity];
+		_iptr = new int[_capacity];
 	}
 
 	/**
@@ -46,47 +152,71 @@ public:
 	 * plain array.
 	 * This constructor is time-expensive and therefore
 	 * useful only for testing on small vectors
-	 * 
+	 *
 	 * @param arr Plain array
 	 * @param size Size of SparseVector
 	 */
 	SparseVector(T *arr, int size)
 		: VectorBase<T>(size)
 	{
-		int *iptr_buff = new int[size];
 		_num_of_aelem = 0;
 
 		for (int i = 0; i < size; ++i) {
 			if (arr[i] != 0) {
-				iptr_buff[i] = i;
 				++_num_of_aelem;
 			}
 		}
 
-		_aelem = new T[_num_of_aelem];
-		_iptr = new int[_num_of_aelem];
+		_capacity = _num_of_aelem;
+		_aelem = new T[_capacity];
+		_iptr = new int[_capacity];
 
-		for (int i = 0; i < _num_of_aelem; ++i) {
-			_iptr[i] = iptr_buff[i];
-			_aelem[i] = arr[_iptr[i]];
+		for (int i = 0, k = 0; i < size; ++i) {
+			if (arr[i] != 0) {
+				_iptr[k] = i;
+				_aelem[k++] = arr[i];
+			}
 		}
+	}
 
-		delete[] iptr_buff;
+	/**
+	 * @brief Creates an instance of SparseVector
+	 * @details All the SparseVector members are passed
+	 * dirrectly as arguments
+	 *
+	 * @param aelem Array of nonempty elements
+	 * @param iptr Array of sorted indices of nonempty elements
+	 * @param num_of_aelem Number of nonempty elements
+	 * @param size Size of SparseVector
+	 */
+	SparseVector(T *aelem, int *iptr, int num_of_aelem, int size)
+		: VectorBase<T>(size)
+	{
+		_num_of_aelem = num_of_aelem;
+		_capacity = num_of_aelem;
+		_aelem = new T[_capacity];
+		_iptr = new int[_capacity];
+
+		for (int k = 0; k < _num_of_aelem; ++k) {
+			_aelem[k] = aelem[k];
+			_iptr[k] = iptr[k];
+		}
 	}
 
 	/**
 	 * @brief Copies the data of SparseVector from
 	 * other SparseVector
-	 * 
+	 *
 	 * @param other Reference to other SparseVector
 	 */
 	SparseVector(const SparseVector &other)
 	{
 		this->_size = other._size;
 		_num_of_aelem = other._num_of_aelem;
+		_capacity = other._num_of_aelem;
 
-		_aelem = new T[_num_of_aelem];
-		_iptr = new int[_num_of_aelem];
+		_aelem = new T[_capacity];
+		_iptr = new int[_capacity];
 
 		for (int i = 0; i < _num_of_aelem; ++i) {
 			_aelem[i] = other._aelem[i];
@@ -107,16 +237,24 @@ public:
 	 * @brief Assignes an instance of SparseVector with
 	 * another SparseVector.
 	 * @details Copies all the data from other SparseVector
-	 * 
+	 *
 	 * @param other Reference to other SparseVector
 	 */
 	SparseVector& operator= (const SparseVector &other)
 	{
+		if (this == &other) {
+			return *this;
+		}
+
+		delete[] _aelem;
+		delete[] _iptr;
+
 		this->_size = other._size;
 		_num_of_aelem = other._num_of_aelem;
+		_capacity = other._num_of_aelem;
 
-		_aelem = new T[_num_of_aelem];
-		_iptr = new int[_num_of_aelem];
+		_aelem = new T[_capacity];
+		_iptr = new int[_capacity];
 
 		for (int i = 0; i < _num_of_aelem; ++i) {
 			_aelem[i] = other._aelem[i];
@@ -155,40 +293,33 @@ public:
 	}
 
 	/**
-	 * @brief Gets and sets the element by it's position
-	 * in SparseVector
-	 * @details This operator does not check if the index
-	 * is out of range. Therefore it's less time-expensive
-	 * but unsafe.
-	 * 
+	 * @brief Gets and sets the nonempty element by it's
+	 * position in SparseVector
+	 * @details Binary search in iptr. This operator does not
+	 * check if the index is out of range, but throws
+	 * VecNoSuchElement if the element is empty (there is
+	 * nothing to refer to). Use get() to read empty elements.
+	 *
 	 * @param index Position in SparseVector
 	 */
 	T& operator[] (int index)
 	{
-		for (int i = 0; i < _num_of_aelem; ++i) {
-			if (_iptr[i] == index) {
-				return _aelem[i];
-			}
-			else if (_iptr[i] > index) {
-				// TODO: Find a way to return 0 in this case
-				//       but throw an error if out of range
-				//       without explicitly checking
-				throw "No such element";
-			}
+		int k = lower_bound(index);
+
+		if (k == _num_of_aelem || _iptr[k] != index) {
+			throw VecNoSuchElement(index);
 		}
-		throw "No such element";
-	}
 
-	//TODO: Improve documentation
+		return _aelem[k];
+	}
 
 	/**
-	 * @brief Gets and sets the element by it's position
-	 * in Vector
-	 * @details This method checks if the index
-	 * is out of range. Therefore it's more time-expensive
-	 * but safe.
-	 * 
-	 * @param index Position in Vector
+	 * @brief Gets and sets the nonempty element by it's
+	 * position in SparseVector
+	 * @details Same as operator[] but also checks if the
+	 * index is out of range.
+	 *
+	 * @param index Position in SparseVector
 	 */
 	T& at(int index)
 	{
@@ -196,148 +327,225 @@ public:
 			throw VecOutOfRange();
 		}
 
-		return _arr[index];
+		return (*this)[index];
 	}
 
-	//TODO: Improve documentation
-
 	/**
-	 * @brief Gets the element by it's position in Vector
-	 * @details This method does not check if the index
-	 * is out of range. Therefore it's less time-expensive
-	 * but unsafe. Being a const-method it is guaranteed
-	 * not to modify the data inside the vector.
-	 * 
-	 * @param index Position in Vector
+	 * @brief Gets the element by it's position in SparseVector
+	 * @details Binary search in iptr. Empty elements are
+	 * returned as 0. This method does not check if the index
+	 * is out of range.
+	 *
+	 * @param index Position in SparseVector
 	 */
 	T get(int index) const
 	{
-		return _arr[index];
+		int k = lower_bound(index);
+
+		if (k == _num_of_aelem || _iptr[k] != index) {
+			return 0;
+		}
+
+		return _aelem[k];
 	}
 
 	/**
-	 * @brief Inserts an element to Vector
-	 * @details The space for this element should
-	 * already be allocated by Vector(int)
-	 * constructor.
-	 * 
+	 * @brief Inserts an element to SparseVector
+	 * @details Overwrites the nonempty element if there is one.
+	 * Otherwise the element is placed so that iptr stays sorted.
+	 * Inserting in increasing order of indices into the space
+	 * allocated by SparseVector(int, int) costs O(1) per element.
+	 *
 	 * @param val Value to be inserted
-	 * @param i Position in Vector
+	 * @param index Position in SparseVector
 	 */
 	void insert(const T &val, int index)
 	{
-		_arr[index] = val;
+		int k = (_num_of_aelem > 0 && _iptr[_num_of_aelem - 1] < index)
+				? _num_of_aelem : lower_bound(index);
+
+		if (k < _num_of_aelem && _iptr[k] == index) {
+			_aelem[k] = val;
+			return;
+		}
+
+		if (_num_of_aelem == _capacity) {
+			reserve(_capacity == 0 ? 4 : 2 * _capacity);
+		}
+
+		for (int l = _num_of_aelem; l > k; --l) {
+			_aelem[l] = _aelem[l - 1];
+			_iptr[l] = _iptr[l - 1];
+		}
+
+		_aelem[k] = val;
+		_iptr[k] = index;
+		++_num_of_aelem;
 	}
 
 	/**
 	 * @brief Implements the elementwise sume of
-	 * two Vector-s.
-	 * 
+	 * two SparseVector-s.
+	 * @details Linear merge of nonempty elements
+	 *
 	 * @param other Second vector (it will be added
 	 * to this one)
 	 * @return Sume of two vectors
 	 */
-	Vector operator+ (const Vector &other)
+	SparseVector operator+ (const SparseVector &other) const
 	{
-		if (this->_size != other._size) {
-			throw VecSizeMismatch();
-		}
-
-		Vector res(this->_size);
-
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] + other._arr[i];
-		}
-
-		return res;
+		return merge(*this, other, 1, 1);
 	}
 
 	/**
 	 * @brief Implements the elementwise difference of
-	 * two Vector-s.
-	 * 
+	 * two SparseVector-s.
+	 * @details Linear merge of nonempty elements
+	 *
 	 * @param other Second vector (it will be substracted
 	 * from this one)
 	 * @return Difference of two vectors
 	 */
-	Vector operator- (const Vector &other)
+	SparseVector operator- (const SparseVector &other) const
 	{
-		if (this->_size != other._size) {
-			throw VecSizeMismatch();
-		}
-
-		Vector res(this->_size);
-
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] - other._arr[i];
-		}
-
-		return res;
+		return merge(*this, other, 1, -1);
 	}
 
 	/**
 	 * @brief Implements multiplication of vector
 	 * on given scalar value.
-	 * @details Each element of vector is multiplied
-	 * by scalar value.
-	 * 
+	 * @details Each nonempty element of vector is
+	 * multiplied by scalar value.
+	 *
 	 * @param val Scalar value
 	 * @return Vector-product
 	 */
 	template <typename S>
-	Vector operator* (const S &val) const
+	SparseVector operator* (const S &val) const
 	{
-		Vector res(this->_size);
+		SparseVector res(*this);
 
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] * val;
+		for (int k = 0; k < _num_of_aelem; ++k) {
+			res._aelem[k] = _aelem[k] * val;
 		}
 
 		return res;
 	}
-	
+
 	/**
 	 * @brief Implements division of vector by given
 	 * scalar value.
-	 * @details Each element of vector is divided
-	 * by scalar value.
-	 * 
+	 * @details Each nonempty element of vector is
+	 * divided by scalar value.
+	 *
 	 * @param val Scalar value
 	 * @return Vector-division
 	 */
 	template <typename S>
-	Vector operator/ (const S &val) const
+	SparseVector operator/ (const S &val) const
 	{
 		if (val == 0) {
 			throw DivideByZero();
 		}
 
-		Vector<T> res(this->_size);
+		SparseVector res(*this);
 
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] / val;
+		for (int k = 0; k < _num_of_aelem; ++k) {
+			res._aelem[k] = _aelem[k] / val;
 		}
 
 		return res;
 	}
+
+	/**
+	 * @brief Computes the dot product with dense Vector
+	 * @details Only nonempty elements are visited
+	 *
+	 * @param vec Dense vector of the same size
+	 * @return Dot product
+	 */
+	T dot(const Vector<T> &vec) const
+	{
+		if (this->_size != vec.size()) {
+			throw VecSizeMismatch();
+		}
+
+		T sum = 0;
+
+		for (int k = 0; k < _num_of_aelem; ++k) {
+			sum += _aelem[k] * vec.get(_iptr[k]);
+		}
+
+		return sum;
+	}
+
+	/**
+	 * @brief Computes the dot product with other SparseVector
+	 * @details Linear merge of nonempty elements
+	 *
+	 * @param other Sparse vector of the same size
+	 * @return Dot product
+	 */
+	T dot(const SparseVector &other) const
+	{
+		if (this->_size != other._size) {
+			throw VecSizeMismatch();
+		}
+
+		T sum = 0;
+		int ka = 0;
+		int kb = 0;
+
+		while (ka < _num_of_aelem && kb < other._num_of_aelem) {
+			if (_iptr[ka] < other._iptr[kb]) {
+				++ka;
+			}
+			else if (_iptr[ka] > other._iptr[kb]) {
+				++kb;
+			}
+			else {
+				sum += _aelem[ka++] * other._aelem[kb++];
+			}
+		}
+
+		return sum;
+	}
+
+	/**
+	 * @brief Adds alpha * this to dense Vector
+	 * @details Only nonempty elements are visited
+	 *
+	 * @param alpha Scalar value
+	 * @param vec Dense vector of the same size (updated)
+	 */
+	void axpy(const T &alpha, Vector<T> &vec) const
+	{
+		if (this->_size != vec.size()) {
+			throw VecSizeMismatch();
+		}
+
+		for (int k = 0; k < _num_of_aelem; ++k) {
+			vec[_iptr[k]] += alpha * _aelem[k];
+		}
+	}
 };
 
 /**
  * @brief Implements multiplication of scalar value
- * on Vector.
- * @details Makes cector-scalar multiplication
+ * on SparseVector.
+ * @details Makes vector-scalar multiplication
  * commutative.
- * 
+ *
  * @param val Scalar value
- * @param vec Vector
- * @tparam T Type of data stored in Vector
+ * @param vec SparseVector
+ * @tparam T Type of data stored in SparseVector
  * @tparam S Type of scalar value
  * @return Vector-product
  */
 template <typename T, typename S>
-Vector<T> operator* (const S &val, const Vector<T> &vec)
+SparseVector<T> operator* (const S &val, const SparseVector<T> &vec)
 {
 	return vec * val;
 }
 
-#endif // SPARSEVECTOR_H
\ No newline at end of file
+#endif // SPARSEVECTOR_H
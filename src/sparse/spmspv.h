@@ -0,0 +1,237 @@
+#ifndef SPMSPV_H
+#define SPMSPV_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "csr.h"
+#include "sparsevector.h"
+#include "exception.h"
+#include "parallel.h"
+
+/**
+ * @brief Sparse matrix - sparse vector multiplication.
+ * @details Keeps a column-wise (CSC) copy of CSR matrix, so that
+ * the product A * x only walks the columns of A that correspond
+ * to nonempty elements of x. This is much cheaper than CSR
+ * multiplication by a dense vector when x has few nonempty
+ * elements (e.g. frontiers in graph traversals).
+ *
+ * The product is computed in parallel in two steps:
+ * - every thread walks the columns of its part of x and puts the
+ *   contributions into buckets by row ranges (one range per thread)
+ * - every thread sums up the contributions of its bucket in a
+ *   sparse accumulator and writes its rows of the result
+ *
+ * Both steps run in a single region of the shared thread pool.
+ * Bucket buffers and accumulator are kept between calls, so an
+ * instance must not be used by several threads at once.
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class SpMSpV
+{
+	CSR<T> _csc;
+
+	int _nthreads;
+	std::vector< std::vector<int> > _brows;
+	std::vector< std::vector<T> > _bvals;
+	std::vector< std::vector<int> > _touched;
+
+	T *_spa;
+	int *_mark;
+	int _stamp;
+
+	SpMSpV(const SpMSpV &);
+	SpMSpV& operator= (const SpMSpV &);
+
+	/**
+	 * @brief Allocates the buckets for the current number of
+	 * threads in pool
+	 */
+	void resize_buckets()
+	{
+		if (_nthreads == num_threads()) {
+			return;
+		}
+
+		_nthreads = num_threads();
+		_brows.assign(_nthreads * _nthreads, std::vector<int>());
+		_bvals.assign(_nthreads * _nthreads, std::vector<T>());
+		_touched.assign(_nthreads, std::vector<int>());
+	}
+
+public:
+	/**
+	 * @brief Creates an instance of SpMSpV
+	 * @details Builds the CSC copy of matrix (see CSR::transpose())
+	 *
+	 * @param mtrx CSR matrix
+	 */
+	SpMSpV(const CSR<T> &mtrx)
+		: _csc(mtrx.transpose()), _nthreads(0)
+	{
+		_spa = new T[rows()];
+		_mark = new int[rows()];
+		_stamp = 0;
+
+		for (int i = 0; i < rows(); ++i) {
+			_mark[i] = -1;
+		}
+	}
+
+	/**
+	 * @brief Deletes an instance of SpMSpV
+	 */
+	~SpMSpV()
+	{
+		delete[] _spa;
+		delete[] _mark;
+	}
+
+	/**
+	 * @brief Gets the number of rows in matrix
+	 * @return Number of rows
+	 */
+	int rows() const
+	{
+		return _csc.cols();
+	}
+
+	/**
+	 * @brief Gets the number of columns in matrix
+	 * @return Number of columns
+	 */
+	int cols() const
+	{
+		return _csc.rows();
+	}
+
+	/**
+	 * @brief Multiplies matrix by sparse vector
+	 * @details The work is proportional to the number of
+	 * nonempty elements in the columns selected by vec.
+	 *
+	 * @param vec Given sparse vector
+	 * @return Result of multiplication
+	 */
+	SparseVector<T> operator* (const SparseVector<T> &vec)
+	{
+		if (vec.size() != cols()) {
+			throw MultSizeMismatch();
+		}
+
+		const int *cptr = _csc.iptr();
+		const int *rptr = _csc.jptr();
+		const T *celem = _csc.aelem();
+
+		const int *xptr = vec.iptr();
+		const T *xelem = vec.aelem();
+		int xnum = vec.num_of_aelem();
+
+		resize_buckets();
+
+		int nb = _nthreads;
+		int width = (rows() + nb - 1) / nb;
+		if (width == 0) {
+			width = 1;
+		}
+
+		++_stamp;
+
+		std::vector<int> offset(nb + 1, 0);
+		std::atomic<int> next(0);
+		Barrier barrier;
+
+		int *iptr = 0;
+		T *aelem = 0;
+
+		// Region may run on fewer threads than there are buckets:
+		// thread t scatters into the row t of buckets and reduces
+		// every used-th bucket column starting from t
+		parallel([&](int t, int used) {
+			for (int b = 0; b < nb; ++b) {
+				_brows[t * nb + b].clear();
+				_bvals[t * nb + b].clear();
+			}
+
+			const int chunk = 16;
+
+			for (int lo = next.fetch_add(chunk); lo < xnum;
+				 lo = next.fetch_add(chunk)) {
+				int hi = (lo + chunk < xnum) ? lo + chunk : xnum;
+
+				for (int k = lo; k < hi; ++k) {
+					int j = xptr[k];
+
+					for (int l = cptr[j]; l < cptr[j + 1]; ++l) {
+						int b = rptr[l] / width;
+						_brows[t * nb + b].push_back(rptr[l]);
+						_bvals[t * nb + b].push_back(celem[l] * xelem[k]);
+					}
+				}
+			}
+
+			barrier.wait(used);
+
+			for (int b = t; b < nb; b += used) {
+				std::vector<int> &touched = _touched[b];
+				touched.clear();
+
+				for (int s = 0; s < used; ++s) {
+					const std::vector<int> &brows = _brows[s * nb + b];
+					const std::vector<T> &bvals = _bvals[s * nb + b];
+
+					for (size_t l = 0; l < brows.size(); ++l) {
+						int i = brows[l];
+
+						if (_mark[i] != _stamp) {
+							_mark[i] = _stamp;
+							_spa[i] = bvals[l];
+							touched.push_back(i);
+						}
+						else {
+							_spa[i] += bvals[l];
+						}
+					}
+				}
+
+				std::sort(touched.begin(), touched.end());
+				offset[b + 1] = (int)touched.size();
+			}
+
+			barrier.wait(used);
+
+			if (t == 0) {
+				for (int b = 0; b < nb; ++b) {
+					offset[b + 1] += offset[b];
+				}
+
+				iptr = new int[offset[nb]];
+				aelem = new T[offset[nb]];
+			}
+
+			barrier.wait(used);
+
+			for (int b = t; b < nb; b += used) {
+				const std::vector<int> &touched = _touched[b];
+
+				for (size_t l = 0; l < touched.size(); ++l) {
+					iptr[offset[b] + l] = touched[l];
+					aelem[offset[b] + l] = _spa[touched[l]];
+				}
+			}
+		});
+
+		SparseVector<T> res(aelem, iptr, offset[nb], rows());
+
+		delete[] iptr;
+		delete[] aelem;
+
+		return res;
+	}
+};
+
+#endif // SPMSPV_H
@@ -0,0 +1,851 @@
+#ifndef SPMVPLAN_H
+#define SPMVPLAN_H
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <chrono>
+#include <math.h>
+
+#include "vector.h"
+#include "csr.h"
+#include "cslr.h"
+#include "blockedcsr.h"
+#include "dia.h"
+#include "ell.h"
+#include "exception.h"
+#include "parallel.h"
+#include "numa.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * Inspector-executor SpMV.
+ *
+ * SpMVPlan inspects a matrix once (row lengths, bandwidth,
+ * symmetry), builds the storage variants that make
+ * sense for it (CSLR for matrices with symmetric portraits, CSR
+ * for CSLR matrices, column panels for x larger than the last
+ * level cache, DIA for matrices on few diagonals, HYB for rows
+ * of similar length), times every candidate kernel on them and
+ * keeps the fastest one together with its partition of rows
+ * between threads. Later execute() calls only run the chosen
+ * kernel.
+ *
+ * The choice can be written with save() and given back to the
+ * loading constructors, which skip the timing.
+ */
+
+/**
+ * @brief Kernels SpMVPlan chooses from
+ */
+enum SpMVKernel
+{
+	SPMV_CSR_STATIC_NNZ,	// static partition, equal nonzeros per thread
+	SPMV_CSR_STATIC_ROWS,	// static partition, equal rows per thread
+	SPMV_CSR_DYNAMIC,		// chunks of rows with work stealing
+	SPMV_CSR_MERGE,			// merge-path split of rows and nonzeros
+	SPMV_CSR_BLOCKED,		// column panels sized to cache (BlockedCSR)
+	SPMV_DIA,				// dense diagonals (DIA)
+	SPMV_HYB,				// ELL part plus COO remainder (HYB)
+	SPMV_CSLR,				// CSLR kernel (serial, less index traffic)
+	SPMV_NUM_KERNELS
+};
+
+/**
+ * @brief Gets the name of kernel used in saved plans
+ *
+ * @param kernel Kernel
+ * @return Name of kernel
+ */
+inline const char* spmv_kernel_name(SpMVKernel kernel)
+{
+	static const char *names[SPMV_NUM_KERNELS] = {
+		"csr_static_nnz",
+		"csr_static_rows",
+		"csr_dynamic",
+		"csr_merge_path",
+		"csr_blocked",
+		"dia",
+		"hyb",
+		"cslr"
+	};
+
+	return names[kernel];
+}
+
+/**
+ * @brief Finds the kernel by its name
+ *
+ * @param name Name of kernel
+ * @return Kernel (SPMV_NUM_KERNELS if name is unknown)
+ */
+inline SpMVKernel spmv_kernel_by_name(const std::string &name)
+{
+	for (int k = 0; k < SPMV_NUM_KERNELS; ++k) {
+		if (name == spmv_kernel_name((SpMVKernel)k)) {
+			return (SpMVKernel)k;
+		}
+	}
+
+	return SPMV_NUM_KERNELS;
+}
+
+/**
+ * @brief Structural properties of matrix found by SpMVPlan
+ */
+struct SpMVFeatures
+{
+	int rows;
+	long long nnz;
+	int min_row;			// length of the shortest row
+	int max_row;			// length of the longest row
+	double mean_row;		// average length of row
+	double row_cv;			// coefficient of variation of row lengths
+	int bandwidth;			// max |i - j| over nonempty elements
+	bool pattern_symmetric;
+	bool value_symmetric;
+};
+
+/**
+ * @brief Timing of a single candidate
+ */
+struct SpMVCandidate
+{
+	SpMVKernel kernel;
+	int grain;				// rows per chunk of SPMV_CSR_DYNAMIC,
+							// columns per panel of SPMV_CSR_BLOCKED
+	double time;			// best time of single SpMV in seconds
+};
+
+/**
+ * @brief Computes the structural properties of CSR matrix
+ * @details Symmetry is not checked here (see SpMVPlan).
+ *
+ * @param mtrx CSR matrix
+ * @return Properties of matrix
+ */
+template <typename T>
+SpMVFeatures spmv_features(const CSR<T> &mtrx)
+{
+	const int *iptr = mtrx.iptr();
+	const int *jptr = mtrx.jptr();
+	int rows = mtrx.rows();
+
+	SpMVFeatures f;
+	f.rows = rows;
+	f.nnz = mtrx.size_of_aelem();
+	f.min_row = (rows > 0) ? iptr[1] - iptr[0] : 0;
+	f.max_row = 0;
+	f.bandwidth = 0;
+	f.pattern_symmetric = false;
+	f.value_symmetric = false;
+
+	double sum2 = 0;
+
+	for (int i = 0; i < rows; ++i) {
+		int len = iptr[i + 1] - iptr[i];
+
+		f.min_row = (len < f.min_row) ? len : f.min_row;
+		f.max_row = (len > f.max_row) ? len : f.max_row;
+		sum2 += (double)len * len;
+
+		for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+			int dist = (jptr[k] > i) ? jptr[k] - i : i - jptr[k];
+			f.bandwidth = (dist > f.bandwidth) ? dist : f.bandwidth;
+		}
+	}
+
+	f.mean_row = (rows > 0) ? (double)f.nnz / rows : 0;
+
+	double var = (rows > 0) ? sum2 / rows - f.mean_row * f.mean_row : 0;
+	f.row_cv = (f.mean_row > 0) ? sqrt(var > 0 ? var : 0) / f.mean_row : 0;
+
+	return f;
+}
+
+/**
+ * @brief Inspector-executor plan of sparse matrix-vector product
+ * @details The plan keeps pointers to the given matrix, so the
+ * matrix must outlive the plan. Values of the matrix may change
+ * between calls as long as its portrait does not; storage
+ * variants built by the plan are copies, so call refresh() after
+ * changing them.
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class SpMVPlan
+{
+	const CSR<T> *_csr;
+	const CSLR<T> *_cslr;
+	CSR<T> *_own_csr;
+	CSLR<T> *_own_cslr;
+	BlockedCSR<T> *_blocked;
+	DIA<T> *_dia;
+	HYB<T> *_hyb;
+
+	int _rows;
+	int _cols;
+	bool _from_cslr;
+
+	SpMVFeatures _features;
+	SpMVKernel _kernel;
+	int _grain;
+	std::vector<int> _bounds;
+	std::vector<SpMVCandidate> _candidates;
+
+	SpMVPlan(const SpMVPlan &);
+	SpMVPlan& operator= (const SpMVPlan &);
+
+	/**
+	 * @brief Inspects CSR matrix
+	 */
+	void inspect(const CSR<T> &mtrx)
+	{
+		SPARSE_TRACE_SCOPE("SpMVPlan::inspect");
+
+		_features = spmv_features(mtrx);
+
+		if (mtrx.rows() != mtrx.cols()) {
+			return;
+		}
+
+		CSR<T> trans = mtrx.transpose();
+		_features.pattern_symmetric = mtrx.same_pattern(trans);
+
+		if (_features.pattern_symmetric) {
+			_features.value_symmetric = true;
+
+			for (int k = 0; k < mtrx.size_of_aelem(); ++k) {
+				if (mtrx.aelem()[k] != trans.aelem()[k]) {
+					_features.value_symmetric = false;
+					break;
+				}
+			}
+
+			_own_cslr = new CSLR<T>(mtrx);
+			_cslr = _own_cslr;
+
+			if (_features.value_symmetric) {
+				_own_cslr->make_symmetric();
+			}
+		}
+	}
+
+	/**
+	 * @brief Inspects CSLR matrix
+	 */
+	void inspect(const CSLR<T> &mtrx)
+	{
+		SPARSE_TRACE_SCOPE("SpMVPlan::inspect");
+
+		_own_csr = new CSR<T>(mtrx.to_csr());
+		_csr = _own_csr;
+
+		_features = spmv_features(*_csr);
+		_features.pattern_symmetric = true;
+		_features.value_symmetric = true;
+
+		for (int k = 0; k < mtrx.size_of_altr(); ++k) {
+			if (mtrx.altr()[k] != mtrx.autr()[k]) {
+				_features.value_symmetric = false;
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief Fixes the static partition of rows with equal numbers
+	 * of nonzeros for the current number of threads
+	 */
+	void partition()
+	{
+		int nthreads = num_threads();
+		_bounds.assign(nthreads + 1, _rows);
+
+		if (_csr == 0) {
+			return;
+		}
+
+		for (int t = 0; t < nthreads; ++t) {
+			int hi;
+			nnz_range(_csr->iptr(), _rows, t, nthreads, _bounds[t], hi);
+		}
+	}
+
+	/**
+	 * @brief Times all the candidates and keeps the fastest one
+	 *
+	 * @param reps Number of timed runs of every candidate
+	 */
+	void tune(int reps)
+	{
+		SPARSE_TRACE_SCOPE("SpMVPlan::tune");
+
+		partition();
+
+		std::vector<SpMVCandidate> list;
+		SpMVCandidate c;
+		c.grain = 0;
+		c.time = 0;
+
+		c.kernel = SPMV_CSR_STATIC_NNZ;
+		list.push_back(c);
+
+		// With (almost) equal rows both static partitions coincide
+		if (_features.row_cv > 0.1) {
+			c.kernel = SPMV_CSR_STATIC_ROWS;
+			list.push_back(c);
+		}
+
+		if (num_threads() > 1) {
+			static const int grains[] = {64, 512, 4096};
+			c.kernel = SPMV_CSR_DYNAMIC;
+
+			for (int g = 0; g < 3; ++g) {
+				if (grains[g] < _rows) {
+					c.grain = grains[g];
+					list.push_back(c);
+				}
+			}
+
+			c.grain = 0;
+
+			// Exact split of nonzeros only pays off for skewed rows
+			if (_features.row_cv > 1 ||
+				_features.max_row > _features.nnz / (2 * num_threads())) {
+				c.kernel = SPMV_CSR_MERGE;
+				list.push_back(c);
+			}
+		}
+
+		// Column panels only help when x does not fit in cache
+		int panel = BlockedCSR<T>::auto_panel_cols(_cols);
+
+		if (panel < _cols) {
+			_blocked = new BlockedCSR<T>(*_csr, panel);
+			c.kernel = SPMV_CSR_BLOCKED;
+			c.grain = panel;
+			list.push_back(c);
+			c.grain = 0;
+		}
+
+		// Padded formats only for structured and near-regular rows
+		if (DIA<T>::fill(*_csr) <= 2) {
+			_dia = new DIA<T>(*_csr, 0);
+			c.kernel = SPMV_DIA;
+			list.push_back(c);
+		}
+
+		if (_features.row_cv < 1) {
+			_hyb = new HYB<T>(*_csr);
+			c.kernel = SPMV_HYB;
+			list.push_back(c);
+		}
+
+		if (_cslr != 0) {
+			c.kernel = SPMV_CSLR;
+			list.push_back(c);
+		}
+
+		Vector<T> x(_cols);
+		Vector<T> y(_rows);
+
+		for (int i = 0; i < _cols; ++i) {
+			x[i] = 1;
+		}
+
+		for (size_t k = 0; k < list.size(); ++k) {
+			// Warm-up run brings the matrix into cache and wakes
+			// up the threads
+			run(list[k].kernel, list[k].grain, x, y);
+
+			double best = 1e30;
+
+			for (int r = 0; r < reps; ++r) {
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+
+				run(list[k].kernel, list[k].grain, x, y);
+
+				double time = std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - start).count();
+				best = (time < best) ? time : best;
+			}
+
+			list[k].time = best;
+		}
+
+		size_t best = 0;
+
+		for (size_t k = 1; k < list.size(); ++k) {
+			if (list[k].time < list[best].time) {
+				best = k;
+			}
+		}
+
+		_candidates = list;
+		_kernel = list[best].kernel;
+		_grain = list[best].grain;
+
+		release();
+	}
+
+	/**
+	 * @brief Deletes the storage variant the chosen kernel
+	 * does not use
+	 */
+	void release()
+	{
+		if (_kernel == SPMV_CSLR && _own_csr != 0) {
+			delete _own_csr;
+			_own_csr = 0;
+			_csr = 0;
+		}
+
+		if (_kernel != SPMV_CSR_BLOCKED && _blocked != 0) {
+			delete _blocked;
+			_blocked = 0;
+		}
+
+		if (_kernel != SPMV_DIA && _dia != 0) {
+			delete _dia;
+			_dia = 0;
+		}
+
+		if (_kernel != SPMV_HYB && _hyb != 0) {
+			delete _hyb;
+			_hyb = 0;
+		}
+
+		if (_kernel != SPMV_CSLR && _own_cslr != 0) {
+			delete _own_cslr;
+			_own_cslr = 0;
+			_cslr = 0;
+		}
+	}
+
+	/**
+	 * @brief Multiplies rows [lo, hi) of CSR variant
+	 */
+	void csr_rows(int lo, int hi, const T *x, T *y) const
+	{
+		const T *aelem = _csr->aelem();
+		const int *iptr = _csr->iptr();
+		const int *jptr = _csr->jptr();
+		T eval = _csr->eval();
+
+		for (int i = lo; i < hi; ++i) {
+			T sum = eval;
+
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				sum += aelem[k] * x[jptr[k]];
+			}
+
+			y[i] = sum;
+		}
+	}
+
+	/**
+	 * @brief Runs given kernel
+	 */
+	void run(SpMVKernel kernel, int grain, const Vector<T> &vec,
+			 Vector<T> &res) const
+	{
+		const T *x = vec.data();
+		T *y = res.data();
+
+		switch (kernel) {
+		case SPMV_CSR_STATIC_NNZ:
+			parallel([&](int tid, int nthreads) {
+				int lo, hi;
+
+				if (nthreads + 1 == (int)_bounds.size()) {
+					lo = _bounds[tid];
+					hi = _bounds[tid + 1];
+				}
+				else {
+					nnz_range(_csr->iptr(), _rows, tid, nthreads, lo, hi);
+				}
+
+				csr_rows(lo, hi, x, y);
+			});
+			break;
+
+		case SPMV_CSR_STATIC_ROWS:
+			parallel([&](int tid, int nthreads) {
+				int lo, hi;
+				ThreadPool::range(_rows, tid, nthreads, lo, hi);
+				csr_rows(lo, hi, x, y);
+			});
+			break;
+
+		case SPMV_CSR_DYNAMIC:
+			parallel_for(0, _rows, [&](int lo, int hi) {
+				csr_rows(lo, hi, x, y);
+			}, grain);
+			break;
+
+		case SPMV_CSR_MERGE:
+			_csr->multiply_merge_path(vec, res);
+			break;
+
+		case SPMV_CSR_BLOCKED:
+			_blocked->multiply(vec, res);
+			break;
+
+		case SPMV_DIA:
+			_dia->multiply(vec, res);
+			break;
+
+		case SPMV_HYB:
+			_hyb->multiply(vec, res);
+			break;
+
+		case SPMV_CSLR:
+		default:
+			_cslr->multiply(vec, res);
+			break;
+		}
+	}
+
+	/**
+	 * @brief Gets the number of nonzeros of CSR view of matrix
+	 * (used to check that saved plan matches the matrix)
+	 */
+	long long csr_nnz() const
+	{
+		if (_from_cslr) {
+			return _rows + 2LL * _cslr->size_of_altr();
+		}
+
+		return _csr->size_of_aelem();
+	}
+
+	/**
+	 * @brief Reads saved plan
+	 * @details Builds the storage variant the saved kernel needs
+	 */
+	void load(std::istream &in)
+	{
+		std::string key;
+		std::string format;
+		std::string kernel;
+		int version = 0;
+		int rows = -1;
+		long long nnz = -1;
+		int nbounds = 0;
+
+		in >> key >> version;
+		if (!in || key != "SpMVPlan" || version != 2) {
+			throw InvalidSpMVPlan("unknown header");
+		}
+
+		in >> key >> format;
+		if (!in || key != "format" ||
+			format != (_from_cslr ? "cslr" : "csr")) {
+			throw InvalidSpMVPlan("plan was made for other format");
+		}
+
+		in >> key >> rows >> nnz;
+		if (!in || key != "size" || rows != _rows || nnz != csr_nnz()) {
+			throw InvalidSpMVPlan("plan was made for other matrix");
+		}
+
+		in >> key >> kernel >> _grain;
+		_kernel = spmv_kernel_by_name(kernel);
+		if (!in || key != "kernel" || _kernel == SPMV_NUM_KERNELS) {
+			throw InvalidSpMVPlan("unknown kernel");
+		}
+
+		in >> key >> nbounds;
+		if (!in || key != "bounds" || nbounds < 0) {
+			throw InvalidSpMVPlan("invalid partition");
+		}
+
+		_bounds.resize(nbounds);
+		for (int t = 0; t < nbounds; ++t) {
+			in >> _bounds[t];
+		}
+
+		SpMVFeatures &f = _features;
+		in >> key >> f.min_row >> f.max_row >> f.mean_row >> f.row_cv
+		   >> f.bandwidth
+		   >> f.pattern_symmetric >> f.value_symmetric;
+		if (!in || key != "features") {
+			throw InvalidSpMVPlan("invalid features");
+		}
+
+		f.rows = rows;
+		f.nnz = nnz;
+
+		if (_kernel == SPMV_CSLR && _cslr == 0) {
+			_own_cslr = new CSLR<T>(*_csr);
+			_cslr = _own_cslr;
+
+			if (_own_cslr->is_symmetric()) {
+				_own_cslr->make_symmetric();
+			}
+		}
+
+		if (_kernel != SPMV_CSLR && _csr == 0) {
+			_own_csr = new CSR<T>(_cslr->to_csr());
+			_csr = _own_csr;
+		}
+
+		if (_kernel == SPMV_CSR_BLOCKED) {
+			if (_grain <= 0) {
+				throw InvalidSpMVPlan("invalid width of panels");
+			}
+
+			_blocked = new BlockedCSR<T>(*_csr, _grain);
+		}
+
+		if (_kernel == SPMV_DIA) {
+			_dia = new DIA<T>(*_csr, 0);
+		}
+
+		if (_kernel == SPMV_HYB) {
+			_hyb = new HYB<T>(*_csr);
+		}
+
+		bool valid = (nbounds > 0 && _bounds[0] == 0 &&
+					  _bounds[nbounds - 1] == _rows);
+
+		for (int t = 1; t < nbounds && valid; ++t) {
+			valid = (_bounds[t - 1] <= _bounds[t]);
+		}
+
+		if (!valid) {
+			throw InvalidSpMVPlan("invalid partition");
+		}
+
+		// Partition saved for other number of threads is recomputed
+		if (nbounds != num_threads() + 1) {
+			partition();
+		}
+	}
+
+public:
+	/**
+	 * @brief Creates a plan for CSR matrix
+	 * @details Inspects the matrix and times the candidates
+	 *
+	 * @param mtrx CSR matrix
+	 * @param reps Number of timed runs of every candidate
+	 */
+	SpMVPlan(const CSR<T> &mtrx, int reps = 5)
+		: _csr(&mtrx), _cslr(0), _own_csr(0), _own_cslr(0), _blocked(0),
+		  _dia(0), _hyb(0),
+		  _rows(mtrx.rows()), _cols(mtrx.cols()), _from_cslr(false),
+		  _kernel(SPMV_CSR_STATIC_NNZ), _grain(0)
+	{
+		inspect(mtrx);
+		tune(reps);
+	}
+
+	/**
+	 * @brief Creates a plan for CSLR matrix
+	 * @details Inspects the matrix and times the candidates
+	 *
+	 * @param mtrx CSLR matrix
+	 * @param reps Number of timed runs of every candidate
+	 */
+	SpMVPlan(const CSLR<T> &mtrx, int reps = 5)
+		: _csr(0), _cslr(&mtrx), _own_csr(0), _own_cslr(0), _blocked(0),
+		  _dia(0), _hyb(0),
+		  _rows(mtrx.size()), _cols(mtrx.size()), _from_cslr(true),
+		  _kernel(SPMV_CSLR), _grain(0)
+	{
+		inspect(mtrx);
+		tune(reps);
+	}
+
+	/**
+	 * @brief Creates a plan for CSR matrix from saved one
+	 * @details Throws InvalidSpMVPlan if the saved plan does
+	 * not match the matrix
+	 *
+	 * @param mtrx CSR matrix
+	 * @param in Stream with plan written by save()
+	 */
+	SpMVPlan(const CSR<T> &mtrx, std::istream &in)
+		: _csr(&mtrx), _cslr(0), _own_csr(0), _own_cslr(0), _blocked(0),
+		  _dia(0), _hyb(0),
+		  _rows(mtrx.rows()), _cols(mtrx.cols()), _from_cslr(false),
+		  _kernel(SPMV_CSR_STATIC_NNZ), _grain(0)
+	{
+		load(in);
+	}
+
+	/**
+	 * @brief Creates a plan for CSLR matrix from saved one
+	 * @details Throws InvalidSpMVPlan if the saved plan does
+	 * not match the matrix
+	 *
+	 * @param mtrx CSLR matrix
+	 * @param in Stream with plan written by save()
+	 */
+	SpMVPlan(const CSLR<T> &mtrx, std::istream &in)
+		: _csr(0), _cslr(&mtrx), _own_csr(0), _own_cslr(0), _blocked(0),
+		  _dia(0), _hyb(0),
+		  _rows(mtrx.size()), _cols(mtrx.size()), _from_cslr(true),
+		  _kernel(SPMV_CSLR), _grain(0)
+	{
+		load(in);
+	}
+
+	/**
+	 * @brief Deletes an instance of SpMVPlan
+	 */
+	~SpMVPlan()
+	{
+		delete _own_csr;
+		delete _own_cslr;
+		delete _blocked;
+		delete _dia;
+		delete _hyb;
+	}
+
+	/**
+	 * @brief Gets the number of rows in matrix
+	 * @return Number of rows
+	 */
+	int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @brief Gets the number of columns in matrix
+	 * @return Number of columns
+	 */
+	int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @brief Gets the properties of matrix
+	 * @return Properties found by inspection
+	 */
+	const SpMVFeatures& features() const
+	{
+		return _features;
+	}
+
+	/**
+	 * @brief Gets the chosen kernel
+	 * @return Kernel
+	 */
+	SpMVKernel kernel() const
+	{
+		return _kernel;
+	}
+
+	/**
+	 * @brief Gets the timings of all the candidates
+	 * @return Candidates (empty for loaded plans)
+	 */
+	const std::vector<SpMVCandidate>& candidates() const
+	{
+		return _candidates;
+	}
+
+	/**
+	 * @brief Copies the current values of matrix into the storage
+	 * variant of the chosen kernel
+	 * @details The kernel, the partition and the features found
+	 * by inspection are kept and nothing is allocated, so the cost
+	 * is that of one pass over the matrix. A symmetric copy of a
+	 * CSR matrix throws ValuesNotSymmetric if the values are not
+	 * symmetric anymore (make a new plan then).
+	 */
+	void refresh()
+	{
+		SPARSE_TRACE_SCOPE("SpMVPlan::refresh");
+
+		if (_from_cslr && _own_csr != 0) {
+			_cslr->to_csr(*_own_csr);
+		}
+
+		if (!_from_cslr && _own_cslr != 0) {
+			_own_cslr->set_values(*_csr);
+		}
+
+		if (_blocked != 0) {
+			_blocked->set_values(*_csr);
+		}
+
+		if (_dia != 0) {
+			_dia->set_values(*_csr);
+		}
+
+		if (_hyb != 0) {
+			_hyb->set_values(*_csr);
+		}
+	}
+
+	/**
+	 * @brief Computes y = A * x with the chosen kernel
+	 *
+	 * @param x Given vector (of size cols)
+	 * @param y Result (of size rows)
+	 */
+	void execute(const Vector<T> &x, Vector<T> &y) const
+	{
+		if (x.size() != _cols || y.size() != _rows) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("SpMVPlan::execute",
+			_features.nnz * (long long)(sizeof(T) + sizeof(int)) +
+			(_rows + 1LL) * sizeof(int) + (long long)(_rows + _cols) * sizeof(T));
+		SPARSE_TRACE_SCOPE("SpMVPlan::execute");
+
+		run(_kernel, _grain, x, y);
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector with the chosen kernel
+	 *
+	 * @param x Given vector
+	 * @return Result of multiplication
+	 */
+	Vector<T> operator* (const Vector<T> &x) const
+	{
+		Vector<T> y(_rows);
+		execute(x, y);
+		return y;
+	}
+
+	/**
+	 * @brief Writes the plan in text form
+	 * @details The output can be passed to the loading
+	 * constructors to skip inspection and timing
+	 *
+	 * @param out Output stream
+	 */
+	void save(std::ostream &out) const
+	{
+		const SpMVFeatures &f = _features;
+
+		out << "SpMVPlan 2\n"
+			<< "format " << (_from_cslr ? "cslr" : "csr") << "\n"
+			<< "size " << _rows << " " << csr_nnz() << "\n"
+			<< "kernel " << spmv_kernel_name(_kernel) << " " << _grain << "\n"
+			<< "bounds " << _bounds.size();
+
+		for (size_t t = 0; t < _bounds.size(); ++t) {
+			out << " " << _bounds[t];
+		}
+
+		out << "\nfeatures " << f.min_row << " " << f.max_row << " "
+			<< f.mean_row << " " << f.row_cv << " " << f.bandwidth << " "
+			<< f.pattern_symmetric << " " << f.value_symmetric << "\n";
+	}
+};
+
+#endif // SPMVPLAN_H
@@ -0,0 +1,569 @@
+#ifndef STREAMCSR_H
+#define STREAMCSR_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string.h>
+
+#include "vector.h"
+#include "csr.h"
+#include "exception.h"
+#include "parallel.h"
+#include "numa.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * Out-of-core CSR matrices.
+ *
+ * The matrix is kept on disk in row panels, so that only the
+ * vectors and a few panels are resident. File layout (native
+ * byte order):
+ * - header: magic "STRMCSR1", sizeof(T), eval, rows, cols, nnz,
+ *   number of panels, largest panel (rows and elements) and the
+ *   offset of the panel table
+ * - panels, each one as iptr (local, rows + 1 elements), jptr
+ *   and aelem
+ * - panel table: first row, rows, nnz and offset of every panel
+ *
+ * Files are written with StreamCSRWriter (row by row, so the
+ * matrix never has to be assembled in memory) and multiplied
+ * with StreamCSR.
+ */
+
+/**
+ * @brief Header of StreamCSR file
+ */
+struct StreamCSRHeader
+{
+	char magic[8];
+	long long value_size;
+	long long rows;
+	long long cols;
+	long long nnz;
+	long long panels;
+	long long max_panel_rows;
+	long long max_panel_nnz;
+	long long table_offset;
+};
+
+/**
+ * @brief Entry of panel table of StreamCSR file
+ */
+struct StreamCSRPanel
+{
+	long long first_row;
+	long long rows;
+	long long nnz;
+	long long offset;
+};
+
+/**
+ * @brief Writes a matrix into StreamCSR file row by row
+ * @details Rows are collected into the current panel, which is
+ * flushed to disk as soon as its elements take panel_bytes.
+ * The header and the panel table are written by close().
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class StreamCSRWriter
+{
+	std::string _path;
+	std::ofstream _file;
+	StreamCSRHeader _header;
+	T _eval;
+	long long _panel_nnz;
+	bool _closed;
+
+	std::vector<int> _iptr;
+	std::vector<int> _jptr;
+	std::vector<T> _aelem;
+	std::vector<StreamCSRPanel> _table;
+
+	StreamCSRWriter(const StreamCSRWriter &);
+	StreamCSRWriter& operator= (const StreamCSRWriter &);
+
+	/**
+	 * @brief Writes the header with the current sizes
+	 */
+	void write_header()
+	{
+		_file.seekp(0);
+		_file.write((const char*)&_header, sizeof(_header));
+		_file.write((const char*)&_eval, sizeof(T));
+	}
+
+	/**
+	 * @brief Writes the current panel to disk and starts a new one
+	 */
+	void flush_panel()
+	{
+		long long rows = _iptr.size() - 1;
+
+		if (rows == 0) {
+			return;
+		}
+
+		StreamCSRPanel panel;
+		panel.first_row = _header.rows;
+		panel.rows = rows;
+		panel.nnz = _jptr.size();
+		panel.offset = _file.tellp();
+
+		_file.write((const char*)&_iptr[0], _iptr.size() * sizeof(int));
+		if (!_jptr.empty()) {
+			_file.write((const char*)&_jptr[0], _jptr.size() * sizeof(int));
+			_file.write((const char*)&_aelem[0], _aelem.size() * sizeof(T));
+		}
+
+		if (!_file) {
+			throw StreamIOError(_path, "write failed");
+		}
+
+		_table.push_back(panel);
+
+		_header.rows += rows;
+		_header.nnz += panel.nnz;
+		_header.max_panel_rows = std::max(_header.max_panel_rows, rows);
+		_header.max_panel_nnz = std::max(_header.max_panel_nnz, panel.nnz);
+
+		_iptr.assign(1, 0);
+		_jptr.clear();
+		_aelem.clear();
+	}
+
+public:
+	/**
+	 * @brief Creates the file
+	 *
+	 * @param path Path of file
+	 * @param cols Number of columns in matrix
+	 * @param panel_bytes Size of elements and column-indices
+	 * of a panel (the reader keeps two panels in memory)
+	 * @param eval Empty value
+	 */
+	StreamCSRWriter(const std::string &path, int cols,
+					long long panel_bytes = 64LL << 20, T eval = 0)
+		: _path(path), _file(path.c_str(), std::ios::binary | std::ios::trunc),
+		  _eval(eval), _closed(false)
+	{
+		if (!_file) {
+			throw StreamIOError(_path, "cannot create file");
+		}
+
+		memset(&_header, 0, sizeof(_header));
+		memcpy(_header.magic, "STRMCSR1", 8);
+		_header.value_size = sizeof(T);
+		_header.cols = cols;
+
+		// Local row pointers of panel are int
+		_panel_nnz = panel_bytes / (long long)(sizeof(T) + sizeof(int));
+		_panel_nnz = std::max(1LL, std::min(_panel_nnz, 1LL << 30));
+
+		_iptr.push_back(0);
+		write_header();
+	}
+
+	/**
+	 * @brief Closes the file (errors are ignored, call close()
+	 * to get them)
+	 */
+	~StreamCSRWriter()
+	{
+		try {
+			close();
+		}
+		catch (...) {
+		}
+	}
+
+	/**
+	 * @brief Appends an element to current row
+	 *
+	 * @param j Column-index
+	 * @param val Value
+	 */
+	void append(int j, T val)
+	{
+		_jptr.push_back(j);
+		_aelem.push_back(val);
+	}
+
+	/**
+	 * @brief Finishes current row and starts the next one
+	 */
+	void end_row()
+	{
+		_iptr.push_back(_jptr.size());
+
+		if ((long long)_jptr.size() >= _panel_nnz) {
+			flush_panel();
+		}
+	}
+
+	/**
+	 * @brief Appends all the rows of CSR matrix
+	 *
+	 * @param mtrx CSR matrix
+	 */
+	void append_rows(const CSR<T> &mtrx)
+	{
+		const int *iptr = mtrx.iptr();
+		const int *jptr = mtrx.jptr();
+		const T *aelem = mtrx.aelem();
+
+		for (int i = 0; i < mtrx.rows(); ++i) {
+			for (int k = iptr[i]; k < iptr[i + 1]; ++k) {
+				append(jptr[k], aelem[k]);
+			}
+			end_row();
+		}
+	}
+
+	/**
+	 * @brief Flushes the last panel, writes the panel table and
+	 * the header
+	 */
+	void close()
+	{
+		if (_closed) {
+			return;
+		}
+
+		_closed = true;
+		flush_panel();
+
+		_header.panels = _table.size();
+		_header.table_offset = _file.tellp();
+
+		if (!_table.empty()) {
+			_file.write((const char*)&_table[0],
+						_table.size() * sizeof(StreamCSRPanel));
+		}
+
+		write_header();
+		_file.close();
+
+		if (!_file) {
+			throw StreamIOError(_path, "write failed");
+		}
+	}
+};
+
+/**
+ * @brief CSR matrix multiplied directly from disk.
+ * @details Only the panel table and a ring of buffers (two by
+ * default) stay in memory. A reader thread fills the buffers
+ * with the next panels while the pool multiplies the current
+ * one, so for large matrices the product runs at disk bandwidth.
+ * The reader goes on cyclically: after the last panel of a
+ * product it prefetches the first panels of the next one, which
+ * is what a Krylov solver asks for. A matrix of at most as many
+ * panels as buffers is read only once: then every panel has a
+ * buffer of its own (and the spare buffers are not allocated).
+ *
+ * An instance must not be used by several threads at once.
+ *
+ * @tparam T Type of data stored in matrix
+ */
+template <typename T>
+class StreamCSR
+{
+	/**
+	 * @brief Panel loaded into memory
+	 */
+	struct Buffer
+	{
+		int panel;
+		int *iptr;
+		int *jptr;
+		T *aelem;
+	};
+
+	std::string _path;
+	StreamCSRHeader _header;
+	T _eval;
+	std::vector<StreamCSRPanel> _table;
+
+	std::vector<Buffer> _buffers;
+	mutable std::mutex _mutex;
+	mutable std::condition_variable _filled;
+	mutable std::condition_variable _released;
+	long long _produced;
+	mutable long long _consumed;
+	bool _stop;
+	std::string _error;
+	std::thread _reader;
+
+	StreamCSR(const StreamCSR &);
+	StreamCSR& operator= (const StreamCSR &);
+
+	/**
+	 * @brief Body of reader thread
+	 */
+	void read_panels()
+	{
+		std::ifstream file(_path.c_str(), std::ios::binary);
+		int nbuf = _buffers.size();
+
+		while (true) {
+			long long k;
+
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_released.wait(lock, [&]() {
+					return _stop || _produced - _consumed < nbuf;
+				});
+
+				if (_stop) {
+					return;
+				}
+
+				k = _produced;
+			}
+
+			// Slot k % nbuf has already been released by consumer
+			Buffer &buf = _buffers[k % nbuf];
+			int p = k % _table.size();
+			std::string error;
+
+			if (buf.panel != p) {
+				SPARSE_TRACE_SCOPE("StreamCSR::read_panel");
+
+				const StreamCSRPanel &panel = _table[p];
+
+				file.seekg(panel.offset);
+				file.read((char*)buf.iptr, (panel.rows + 1) * sizeof(int));
+				file.read((char*)buf.jptr, panel.nnz * sizeof(int));
+				file.read((char*)buf.aelem, panel.nnz * sizeof(T));
+
+				if (!file || buf.iptr[0] != 0 || buf.iptr[panel.rows] != panel.nnz) {
+					error = "cannot read panel";
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (!error.empty()) {
+				_error = error;
+				buf.panel = -1;
+				_filled.notify_all();
+				return;
+			}
+
+			buf.panel = p;
+			++_produced;
+			_filled.notify_all();
+		}
+	}
+
+	/**
+	 * @brief Waits until the next panel is loaded
+	 * @return Buffer with panel
+	 */
+	const Buffer& acquire() const
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_filled.wait(lock, [&]() {
+			return _produced > _consumed || !_error.empty();
+		});
+
+		if (_produced == _consumed) {
+			throw StreamIOError(_path, _error);
+		}
+
+		return _buffers[_consumed % _buffers.size()];
+	}
+
+	/**
+	 * @brief Gives the buffer of current panel back to reader
+	 */
+	void release() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_consumed;
+		_released.notify_all();
+	}
+
+public:
+	/**
+	 * @brief Opens StreamCSR file and starts the reader thread
+	 *
+	 * @param path Path of file written by StreamCSRWriter
+	 * @param buffers Number of panels kept in memory (at least 2,
+	 * so that reading overlaps multiplication, at most the number
+	 * of panels)
+	 */
+	StreamCSR(const std::string &path, int buffers = 2)
+		: _path(path), _produced(0), _consumed(0), _stop(false)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+
+		if (!file) {
+			throw StreamIOError(_path, "cannot open file");
+		}
+
+		file.read((char*)&_header, sizeof(_header));
+		file.read((char*)&_eval, sizeof(T));
+
+		if (!file || memcmp(_header.magic, "STRMCSR1", 8) != 0) {
+			throw StreamIOError(_path, "not a StreamCSR file");
+		}
+		if (_header.value_size != (long long)sizeof(T)) {
+			throw StreamIOError(_path, "type of values does not match");
+		}
+
+		_table.resize(_header.panels);
+		file.seekg(_header.table_offset);
+
+		if (!_table.empty()) {
+			file.read((char*)&_table[0], _table.size() * sizeof(StreamCSRPanel));
+		}
+
+		if (!file) {
+			throw StreamIOError(_path, "cannot read panel table");
+		}
+
+		// Slot k % nbuf then always holds panel k % panels
+		_buffers.resize(std::min(std::max(buffers, 2), (int)_table.size()));
+
+		for (size_t b = 0; b < _buffers.size(); ++b) {
+			_buffers[b].panel = -1;
+			_buffers[b].iptr = numa_alloc<int>(_header.max_panel_rows + 1);
+			_buffers[b].jptr = numa_alloc<int>(_header.max_panel_nnz);
+			_buffers[b].aelem = numa_alloc<T>(_header.max_panel_nnz);
+		}
+
+		if (!_table.empty()) {
+			_reader = std::thread(&StreamCSR::read_panels, this);
+		}
+	}
+
+	/**
+	 * @brief Stops the reader thread and deletes the buffers
+	 */
+	~StreamCSR()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+			_released.notify_all();
+		}
+
+		if (_reader.joinable()) {
+			_reader.join();
+		}
+
+		for (size_t b = 0; b < _buffers.size(); ++b) {
+			delete[] _buffers[b].iptr;
+			delete[] _buffers[b].jptr;
+			delete[] _buffers[b].aelem;
+		}
+	}
+
+	/**
+	 * @brief Gets the number of rows in matrix
+	 * @return Number of rows
+	 */
+	int rows() const
+	{
+		return _header.rows;
+	}
+
+	/**
+	 * @brief Gets the number of columns in matrix
+	 * @return Number of columns
+	 */
+	int cols() const
+	{
+		return _header.cols;
+	}
+
+	/**
+	 * @brief Gets the number of nonempty elements
+	 * @return Number of nonempty elements
+	 */
+	long long size_of_aelem() const
+	{
+		return _header.nnz;
+	}
+
+	/**
+	 * @brief Gets the number of row panels in file
+	 * @return Number of panels
+	 */
+	int panels() const
+	{
+		return _table.size();
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector into existing Vector
+	 * @details Panels are multiplied one after another as the
+	 * reader delivers them; rows of a panel are split between
+	 * the threads of pool by nnz_range().
+	 *
+	 * @param vec Given vector (of size cols)
+	 * @param res Result of multiplication (of size rows)
+	 */
+	void multiply(const Vector<T> &vec, Vector<T> &res) const
+	{
+		if (vec.size() != cols() || res.size() != rows()) {
+			throw MultSizeMismatch();
+		}
+
+		SPARSE_PROFILE_SCOPE("StreamCSR::multiply",
+			_header.nnz * (long long)(sizeof(T) + sizeof(int)) +
+			(_header.rows + _header.panels) * (long long)sizeof(int) +
+			(long long)(_header.rows + _header.cols) * sizeof(T));
+
+		const T *x = vec.data();
+		T *y = res.data();
+
+		for (size_t p = 0; p < _table.size(); ++p) {
+			const Buffer &buf = acquire();
+			const StreamCSRPanel &panel = _table[buf.panel];
+			T *ypanel = y + panel.first_row;
+
+			parallel([&](int tid, int nthreads) {
+				SPARSE_TRACE_SCOPE("StreamCSR::multiply");
+
+				int lo, hi;
+				nnz_range(buf.iptr, panel.rows, tid, nthreads, lo, hi);
+
+				for (int i = lo; i < hi; ++i) {
+					T sum = 0;
+
+					for (int k = buf.iptr[i]; k < buf.iptr[i + 1]; ++k) {
+						sum += buf.aelem[k] * x[buf.jptr[k]];
+					}
+
+					ypanel[i] = sum + _eval;
+				}
+			});
+
+			release();
+		}
+	}
+
+	/**
+	 * @brief Multiplies matrix by Vector
+	 * @details See multiply(const Vector<T>&, Vector<T>&)
+	 *
+	 * @param vec Given vector
+	 * @return Result of multiplication
+	 */
+	Vector<T> operator* (const Vector<T> &vec) const
+	{
+		Vector<T> res(rows());
+		multiply(vec, res);
+		return res;
+	}
+};
+
+#endif // STREAMCSR_H
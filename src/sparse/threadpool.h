@@ -0,0 +1,623 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * @brief Hints the processor that the thread is spinning
+ */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+
+/**
+ * @brief One step of busy waiting
+ * @details Spins for the first calls and yields afterwards, so
+ * waiting threads do not starve preempted ones when there are
+ * more threads than cores
+ *
+ * @param spins Number of steps done so far
+ */
+inline void spin_wait(int &spins)
+{
+	if (spins < 1024) {
+		++spins;
+		cpu_relax();
+	}
+	else {
+		std::this_thread::yield();
+	}
+}
+
+/**
+ * @brief Spinning barrier for the threads of a parallel region
+ * @details The number of threads is passed to wait() rather than
+ * to the constructor, so the barrier works the same way whether
+ * the region runs on the whole pool or serially.
+ */
+class Barrier
+{
+	std::atomic<int> _count;
+	std::atomic<int> _generation;
+
+public:
+	Barrier()
+		: _count(0), _generation(0)
+	{
+	}
+
+	/**
+	 * @brief Waits until all the threads of region arrive
+	 *
+	 * @param nthreads Number of threads in region
+	 */
+	void wait(int nthreads)
+	{
+		if (nthreads == 1) {
+			return;
+		}
+
+		int gen = _generation.load(std::memory_order_acquire);
+
+		if (_count.fetch_add(1, std::memory_order_acq_rel) + 1 == nthreads) {
+			_count.store(0, std::memory_order_relaxed);
+			_generation.fetch_add(1, std::memory_order_release);
+			return;
+		}
+
+		int spins = 0;
+		while (_generation.load(std::memory_order_acquire) == gen) {
+			spin_wait(spins);
+		}
+	}
+};
+
+/**
+ * @brief Persistent pool of threads shared by all parallel kernels.
+ * @details The pool is created on first use with the number of
+ * threads given by SPARSE_NUM_THREADS environment variable (or the
+ * number of hardware threads). The calling thread takes part in
+ * every parallel region as thread 0, so a pool of n threads owns
+ * n - 1 workers.
+ *
+ * Between regions workers spin for a while and then park on a
+ * condition variable, so back-to-back kernels (e.g. SpMV followed
+ * by vector operations) do not pay for waking threads up.
+ *
+ * Two kinds of regions are provided:
+ * - parallel(f) calls f(tid, nthreads) on every thread, which is
+ *   meant for static partitions (see range())
+ * - parallel_for(begin, end, f) splits the iterations into chunks,
+ *   gives every thread a contiguous block of chunks and lets idle
+ *   threads steal half of the remaining chunks of others
+ *
+ * Regions started from inside another region (or while another
+ * thread occupies the pool) are executed serially by the caller.
+ */
+class ThreadPool
+{
+	/**
+	 * @brief Range of chunks owned by a thread
+	 * @details Both bounds are packed into a single word, so the
+	 * owner (taking chunks from the front) and thieves (taking
+	 * the back half) synchronize with one CAS. Padded to avoid
+	 * false sharing.
+	 */
+	struct Range
+	{
+		std::atomic<unsigned long long> bounds;
+		char pad[64 - sizeof(std::atomic<unsigned long long>)];
+	};
+
+	typedef void (*Trampoline)(void *ctx, int tid, int nthreads);
+
+	int _nthreads;
+	std::vector<std::thread> _workers;
+	std::vector<int> _cpus;
+
+	Trampoline _fn;
+	void *_ctx;
+
+	std::atomic<unsigned> _generation;
+	std::atomic<unsigned> _epoch;
+	std::atomic<int> _pending;
+	std::atomic<int> _sleeping;
+	std::atomic<bool> _stop;
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::mutex _dispatch;
+
+	Range *_ranges;
+
+	ThreadPool(const ThreadPool &);
+	ThreadPool& operator= (const ThreadPool &);
+
+	static int& tls_id()
+	{
+		static thread_local int id = 0;
+		return id;
+	}
+
+	static bool& tls_inside()
+	{
+		static thread_local bool inside = false;
+		return inside;
+	}
+
+	static unsigned long long pack(unsigned lo, unsigned hi)
+	{
+		return ((unsigned long long)lo << 32) | hi;
+	}
+
+	ThreadPool()
+		: _nthreads(1), _fn(0), _ctx(0), _generation(0), _epoch(0),
+		  _pending(0), _sleeping(0), _stop(false), _ranges(0)
+	{
+		int n = (int)std::thread::hardware_concurrency();
+		const char *env = getenv("SPARSE_NUM_THREADS");
+
+		if (env != 0 && atoi(env) > 0) {
+			n = atoi(env);
+		}
+
+		start(n > 0 ? n : 1);
+	}
+
+	/**
+	 * @brief Number of pause instructions a worker spins
+	 * before parking
+	 */
+	static const int SPIN = 1 << 14;
+
+	/**
+	 * @brief Creates the workers
+	 *
+	 * @param nthreads Number of threads (including the caller)
+	 */
+	void start(int nthreads)
+	{
+		_nthreads = nthreads;
+		_stop.store(false);
+		_ranges = new Range[_nthreads];
+		_epoch.fetch_add(1);
+
+		// Workers may start after the first region is dispatched,
+		// so the generation they wait for is fixed here
+		unsigned seen = _generation.load();
+
+		for (int t = 1; t < _nthreads; ++t) {
+			_workers.push_back(std::thread(&ThreadPool::work, this, t, seen));
+		}
+	}
+
+	/**
+	 * @brief Stops and joins the workers
+	 */
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop.store(true);
+		}
+		_cv.notify_all();
+
+		for (size_t k = 0; k < _workers.size(); ++k) {
+			_workers[k].join();
+		}
+
+		_workers.clear();
+		delete[] _ranges;
+		_ranges = 0;
+	}
+
+	/**
+	 * @brief Main loop of worker thread
+	 *
+	 * @param tid Index of worker
+	 * @param seen Generation of the last region before start
+	 */
+	void work(int tid, unsigned seen)
+	{
+		tls_id() = tid;
+		tls_inside() = true;
+
+		while (true) {
+			int spins = 0;
+
+			while (_generation.load(std::memory_order_acquire) == seen &&
+				   !_stop.load(std::memory_order_relaxed)) {
+				if (++spins < SPIN) {
+					cpu_relax();
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(_mutex);
+				_sleeping.fetch_add(1);
+				_cv.wait(lock, [this, seen] {
+					return _generation.load() != seen || _stop.load();
+				});
+				_sleeping.fetch_sub(1);
+			}
+
+			if (_stop.load()) {
+				return;
+			}
+
+			seen = _generation.load(std::memory_order_acquire);
+			_fn(_ctx, tid, _nthreads);
+			_pending.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	/**
+	 * @brief Runs trampoline on all the threads of the pool
+	 * @details Falls back to serial execution when called from
+	 * inside of a region or when the pool is busy
+	 */
+	void dispatch(Trampoline fn, void *ctx)
+	{
+		if (_nthreads == 1 || tls_inside() || !_dispatch.try_lock()) {
+			fn(ctx, 0, 1);
+			return;
+		}
+
+		_fn = fn;
+		_ctx = ctx;
+		_pending.store(_nthreads - 1);
+		_generation.fetch_add(1);
+
+		if (_sleeping.load() > 0) {
+			std::lock_guard<std::mutex> lock(_mutex);
+		}
+		_cv.notify_all();
+
+		tls_inside() = true;
+		fn(ctx, 0, _nthreads);
+		tls_inside() = false;
+
+		int spins = 0;
+		while (_pending.load(std::memory_order_acquire) > 0) {
+			if (++spins < SPIN) {
+				cpu_relax();
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+
+		_dispatch.unlock();
+	}
+
+	/**
+	 * @brief Pins every thread to its core
+	 */
+	void apply_affinity()
+	{
+		parallel([this](int tid, int) {
+			pin_self(_cpus[tid % _cpus.size()]);
+		});
+	}
+
+	/**
+	 * @brief Pins the calling thread to given core
+	 *
+	 * @param cpu Index of core
+	 * @return True on success
+	 */
+	static bool pin_self(int cpu)
+	{
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		(void)cpu;
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Calls function object of type F stored at ctx
+	 */
+	template <typename F>
+	static void call(void *ctx, int tid, int nthreads)
+	{
+		(*(F*)ctx)(tid, nthreads);
+	}
+
+	/**
+	 * @brief Region of parallel_for: distribution of chunks
+	 * and work stealing
+	 */
+	template <typename F>
+	struct ForContext
+	{
+		ThreadPool *pool;
+		F *fn;
+		int begin;
+		int end;
+		int grain;
+		unsigned chunks;
+		std::atomic<int> arrived;
+
+		void operator() (int tid, int nthreads)
+		{
+			Range *ranges = pool->_ranges;
+
+			if (nthreads == 1) {
+				(*fn)(begin, end);
+				return;
+			}
+
+			unsigned lo = (unsigned)((unsigned long long)chunks * tid / nthreads);
+			unsigned hi = (unsigned)((unsigned long long)chunks * (tid + 1) / nthreads);
+			ranges[tid].bounds.store(pack(lo, hi), std::memory_order_release);
+
+			// Every thread must publish its range before anyone steals
+			// (otherwise the old range of previous region could be taken)
+			arrived.fetch_add(1, std::memory_order_acq_rel);
+			int spins = 0;
+			while (arrived.load(std::memory_order_acquire) < nthreads) {
+				spin_wait(spins);
+			}
+
+			while (true) {
+				unsigned chunk;
+
+				if (take(ranges[tid], chunk)) {
+					run(chunk);
+					continue;
+				}
+
+				bool stolen = false;
+
+				for (int k = 1; k < nthreads && !stolen; ++k) {
+					Range &victim = ranges[(tid + k) % nthreads];
+					unsigned long long old = victim.bounds.load(std::memory_order_acquire);
+
+					while (true) {
+						unsigned vlo = (unsigned)(old >> 32);
+						unsigned vhi = (unsigned)old;
+
+						if (vlo >= vhi) {
+							break;
+						}
+
+						unsigned mid = vlo + (vhi - vlo) / 2;
+
+						if (victim.bounds.compare_exchange_weak(old, pack(vlo, mid))) {
+							ranges[tid].bounds.store(pack(mid, vhi), std::memory_order_release);
+							stolen = true;
+							break;
+						}
+					}
+				}
+
+				if (!stolen) {
+					break;
+				}
+			}
+		}
+
+		static bool take(Range &range, unsigned &chunk)
+		{
+			unsigned long long old = range.bounds.load(std::memory_order_acquire);
+
+			while (true) {
+				unsigned lo = (unsigned)(old >> 32);
+				unsigned hi = (unsigned)old;
+
+				if (lo >= hi) {
+					return false;
+				}
+
+				if (range.bounds.compare_exchange_weak(old, pack(lo + 1, hi))) {
+					chunk = lo;
+					return true;
+				}
+			}
+		}
+
+		void run(unsigned chunk)
+		{
+			int lo = begin + (int)chunk * grain;
+			int hi = (lo + grain < end) ? lo + grain : end;
+			(*fn)(lo, hi);
+		}
+	};
+
+public:
+	/**
+	 * @brief Gets the instance of ThreadPool
+	 * @return Reference to ThreadPool
+	 */
+	static ThreadPool& instance()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	/**
+	 * @brief Stops and joins all the workers
+	 */
+	~ThreadPool()
+	{
+		stop();
+	}
+
+	/**
+	 * @brief Gets the number of threads (including the caller)
+	 * @return Number of threads
+	 */
+	int num_threads() const
+	{
+		return _nthreads;
+	}
+
+	/**
+	 * @brief Gets the number of times the workers were created
+	 * @details Changes whenever set_num_threads() replaces the
+	 * workers, so state kept per worker (e.g. hardware counters of
+	 * Profiler) can detect that it is stale
+	 *
+	 * @return Epoch of workers
+	 */
+	unsigned epoch() const
+	{
+		return _epoch.load();
+	}
+
+	/**
+	 * @brief Changes the number of threads
+	 * @details Must not be called while kernels are running
+	 *
+	 * @param nthreads Number of threads (including the caller)
+	 */
+	void set_num_threads(int nthreads)
+	{
+		if (nthreads < 1) {
+			nthreads = 1;
+		}
+
+		if (nthreads == _nthreads) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_dispatch);
+			stop();
+			start(nthreads);
+		}
+
+		if (!_cpus.empty()) {
+			apply_affinity();
+		}
+	}
+
+	/**
+	 * @brief Pins threads to cores
+	 * @details Thread t is pinned to cpus[t % cpus.size()]; with
+	 * empty cpus thread t is pinned to core t. The calling thread
+	 * is thread 0. The pinning is kept when the number of threads
+	 * is changed. Works on Linux only.
+	 *
+	 * @param cpus Indices of cores
+	 * @return True on success
+	 */
+	bool pin_threads(const std::vector<int> &cpus = std::vector<int>())
+	{
+#ifdef __linux__
+		_cpus = cpus;
+
+		if (_cpus.empty()) {
+			for (int t = 0; t < _nthreads; ++t) {
+				_cpus.push_back(t);
+			}
+		}
+
+		apply_affinity();
+		return true;
+#else
+		(void)cpus;
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Gets the cores threads are pinned to
+	 * @return Indices of cores (empty if not pinned)
+	 */
+	const std::vector<int>& cpus() const
+	{
+		return _cpus;
+	}
+
+	/**
+	 * @brief Gets the index of the calling thread in the pool
+	 * @return Thread index (0 outside of parallel regions)
+	 */
+	static int thread_id()
+	{
+		return tls_id();
+	}
+
+	/**
+	 * @brief Runs f(tid, nthreads) on every thread of the pool
+	 * @details nthreads may be less than num_threads() when the
+	 * region is executed serially
+	 *
+	 * @param f Function object
+	 */
+	template <typename F>
+	void parallel(F f)
+	{
+		dispatch(&ThreadPool::call<F>, &f);
+	}
+
+	/**
+	 * @brief Runs f(lo, hi) over the chunks of [begin, end)
+	 * with work stealing
+	 *
+	 * @param begin First iteration
+	 * @param end Past the last iteration
+	 * @param f Function object
+	 * @param grain Number of iterations in chunk (0 - chosen
+	 * automatically)
+	 */
+	template <typename F>
+	void parallel_for(int begin, int end, F f, int grain = 0)
+	{
+		if (end <= begin) {
+			return;
+		}
+
+		int n = end - begin;
+
+		if (grain <= 0) {
+			grain = n / (8 * _nthreads);
+			if (grain < 1) {
+				grain = 1;
+			}
+		}
+
+		ForContext<F> ctx;
+		ctx.pool = this;
+		ctx.fn = &f;
+		ctx.begin = begin;
+		ctx.end = end;
+		ctx.grain = grain;
+		ctx.chunks = (unsigned)((n + grain - 1) / grain);
+		ctx.arrived.store(0);
+
+		dispatch(&ThreadPool::call< ForContext<F> >, &ctx);
+	}
+
+	/**
+	 * @brief Gets the static partition of n iterations
+	 * @details Thread tid of nthreads gets [lo, hi)
+	 */
+	static void range(int n, int tid, int nthreads, int &lo, int &hi)
+	{
+		lo = (int)((long long)n * tid / nthreads);
+		hi = (int)((long long)n * (tid + 1) / nthreads);
+	}
+};
+
+#endif // THREADPOOL_H
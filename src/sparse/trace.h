@@ -0,0 +1,324 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/**
+ * Timeline tracing.
+ *
+ * Code marks the phases of interest with SPARSE_TRACE_SCOPE(name).
+ * Unless compiled with -DSPARSE_TRACE the macro expands to nothing.
+ * With tracing compiled in, the scopes record begin/end events into
+ * the ring buffer of the calling thread while Tracer is enabled.
+ * Tracer::dump() writes all the buffers in Chrome trace format
+ * (JSON), which can be opened in Perfetto or chrome://tracing.
+ *
+ * Every thread writes only to its own buffer, so recording takes
+ * two clock reads and two stores per scope without any locking.
+ * When a buffer is full the oldest events are overwritten.
+ */
+
+/**
+ * @brief Single begin or end event
+ */
+struct TraceEvent
+{
+	const char *name;
+	long long ns;
+	char phase;
+};
+
+/**
+ * @brief Ring buffer of events of a single thread
+ * @details Written only by the owner thread. Read by Tracer::dump()
+ * which should be called when traced code is quiescent.
+ */
+class TraceBuffer
+{
+	TraceEvent *_events;
+	unsigned long long _mask;
+	std::atomic<unsigned long long> _count;
+	int _tid;
+
+	TraceBuffer(const TraceBuffer &);
+	TraceBuffer& operator= (const TraceBuffer &);
+
+public:
+	/**
+	 * @brief Creates an instance of TraceBuffer
+	 *
+	 * @param capacity Number of events (rounded up to power of 2)
+	 * @param tid Id of owner thread in trace
+	 */
+	TraceBuffer(unsigned long long capacity, int tid)
+		: _count(0), _tid(tid)
+	{
+		unsigned long long size = 1;
+		while (size < capacity) {
+			size *= 2;
+		}
+
+		_events = new TraceEvent[size];
+		_mask = size - 1;
+	}
+
+	/**
+	 * @brief Deletes an instance of TraceBuffer
+	 */
+	~TraceBuffer()
+	{
+		delete[] _events;
+	}
+
+	/**
+	 * @brief Records an event
+	 *
+	 * @param name Name of scope (must be a string literal)
+	 * @param ns Time since the start of Tracer in nanoseconds
+	 * @param phase 'B' for begin, 'E' for end
+	 */
+	void push(const char *name, long long ns, char phase)
+	{
+		unsigned long long k = _count.load(std::memory_order_relaxed);
+		TraceEvent &event = _events[k & _mask];
+
+		event.name = name;
+		event.ns = ns;
+		event.phase = phase;
+
+		_count.store(k + 1, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Forgets all the recorded events
+	 */
+	void clear()
+	{
+		_count.store(0, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Writes recorded events in Chrome trace format
+	 * @details Events lost by overwriting may leave unmatched
+	 * end events at the beginning, they are skipped
+	 *
+	 * @param out Output stream
+	 * @param first True if no event was written before
+	 * @return False if something was written
+	 */
+	bool dump(std::ostream &out, bool first) const
+	{
+		unsigned long long count = _count.load(std::memory_order_acquire);
+		unsigned long long from = (count > _mask + 1) ? count - _mask - 1 : 0;
+		int depth = 0;
+
+		for (unsigned long long k = from; k < count; ++k) {
+			const TraceEvent &event = _events[k & _mask];
+
+			if (event.phase == 'B') {
+				++depth;
+			}
+			else if (depth == 0) {
+				continue;
+			}
+			else {
+				--depth;
+			}
+
+			out << (first ? "\n" : ",\n")
+				<< "{\"name\": \"" << event.name
+				<< "\", \"ph\": \"" << event.phase
+				<< "\", \"ts\": " << event.ns / 1000.0
+				<< ", \"pid\": 1, \"tid\": " << _tid << "}";
+			first = false;
+		}
+
+		return first;
+	}
+};
+
+/**
+ * @brief Registry of per-thread trace buffers
+ * @details A single instance is shared by the whole program.
+ */
+class Tracer
+{
+	std::atomic<bool> _enabled;
+	unsigned long long _capacity;
+	std::chrono::steady_clock::time_point _start;
+
+	std::mutex _mutex;
+	std::vector<TraceBuffer*> _buffers;
+
+	Tracer()
+		: _enabled(false), _capacity(1 << 16),
+		  _start(std::chrono::steady_clock::now())
+	{
+	}
+
+	Tracer(const Tracer &);
+	Tracer& operator= (const Tracer &);
+
+	/**
+	 * @brief Creates the buffer of the calling thread
+	 * @return Pointer to new buffer
+	 */
+	TraceBuffer* create_buffer()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		TraceBuffer *buffer = new TraceBuffer(_capacity, _buffers.size());
+		_buffers.push_back(buffer);
+		return buffer;
+	}
+
+public:
+	/**
+	 * @brief Gets the instance of Tracer
+	 * @return Reference to Tracer
+	 */
+	static Tracer& instance()
+	{
+		static Tracer tracer;
+		return tracer;
+	}
+
+	/**
+	 * @brief Deletes an instance of Tracer
+	 */
+	~Tracer()
+	{
+		for (size_t k = 0; k < _buffers.size(); ++k) {
+			delete _buffers[k];
+		}
+	}
+
+	/**
+	 * @brief Starts recording
+	 *
+	 * @param capacity Number of events kept per thread (applies
+	 * to the threads that did not record anything yet)
+	 */
+	void enable(unsigned long long capacity = 1 << 16)
+	{
+		_capacity = capacity;
+		_enabled.store(true, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Stops recording
+	 */
+	void disable()
+	{
+		_enabled.store(false, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Checks if events are recorded
+	 * @return True if Tracer is enabled
+	 */
+	bool enabled() const
+	{
+		return _enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Gets the time since the start of program
+	 * @return Time in nanoseconds
+	 */
+	long long now() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - _start).count();
+	}
+
+	/**
+	 * @brief Gets the buffer of the calling thread
+	 * @details Creates it on first call from the thread
+	 * @return Reference to buffer
+	 */
+	TraceBuffer& buffer()
+	{
+		static thread_local TraceBuffer *own = 0;
+
+		if (own == 0) {
+			own = create_buffer();
+		}
+
+		return *own;
+	}
+
+	/**
+	 * @brief Forgets the events of all the threads
+	 */
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for (size_t k = 0; k < _buffers.size(); ++k) {
+			_buffers[k]->clear();
+		}
+	}
+
+	/**
+	 * @brief Writes the events of all the threads as Chrome trace JSON
+	 *
+	 * @param out Output stream
+	 */
+	void dump(std::ostream &out)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		bool first = true;
+
+		out << "{\"traceEvents\": [";
+
+		for (size_t k = 0; k < _buffers.size(); ++k) {
+			first = _buffers[k]->dump(out, first);
+		}
+
+		out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	}
+};
+
+/**
+ * @brief Records the begin and the end of scope
+ * @details Created by SPARSE_TRACE_SCOPE
+ */
+class TraceScope
+{
+	const char *_name;
+	TraceBuffer *_buffer;
+
+public:
+	TraceScope(const char *name)
+		: _name(name), _buffer(0)
+	{
+		Tracer &tracer = Tracer::instance();
+
+		if (tracer.enabled()) {
+			_buffer = &tracer.buffer();
+			_buffer->push(_name, tracer.now(), 'B');
+		}
+	}
+
+	~TraceScope()
+	{
+		if (_buffer != 0) {
+			_buffer->push(_name, Tracer::instance().now(), 'E');
+		}
+	}
+};
+
+#ifdef SPARSE_TRACE
+#define SPARSE_TRACE_CONCAT_(a, b) a##b
+#define SPARSE_TRACE_CONCAT(a, b) SPARSE_TRACE_CONCAT_(a, b)
+#define SPARSE_TRACE_SCOPE(name) \
+	TraceScope SPARSE_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define SPARSE_TRACE_SCOPE(name)
+#endif
+
+#endif // TRACE_H
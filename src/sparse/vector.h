@@ -3,6 +3,8 @@
 
 #include "vectorbase.h"
 #include "exception.h"
+#include "profile.h"
+#include "numa.h"
 
 /**
  * @brief Reimplementation of mathematical vector
@@ -20,13 +22,15 @@ public:
 	 * @brief Creates an instance of empty Vector
 	 * @details Allocates memory for given number
 	 * of elements. They must be inserted later.
+	 * Large vectors are placed on the NUMA nodes of
+	 * the threads that process them (see numa_alloc()).
 	 * 
 	 * @param size Number of elements
 	 */
 	Vector(int size)
 		: VectorBase<T>(size)
 	{
-		_arr = new T[size];
+		_arr = numa_alloc<T>(size);
 	}
 
 	/**
@@ -40,11 +44,8 @@ public:
 	Vector(T *arr, int size)
 		: VectorBase<T>(size)
 	{
-		_arr = new T[size];
-
-		for (int i = 0; i < size; ++i) {
-			_arr[i] = arr[i];
-		}
+		_arr = numa_alloc<T>(size);
+		numa_copy(_arr, arr, size);
 	}
 
 	/**
@@ -56,11 +57,8 @@ public:
 	Vector(const Vector &other)
 	{
 		this->_size = other._size;
-		_arr = new T[this->_size];
-
-		for (int i = 0; i < this->_size; ++i) {
-			_arr[i] = other._arr[i];
-		}
+		_arr = numa_alloc<T>(this->_size);
+		numa_copy(_arr, other._arr, this->_size);
 	}
 
 	/**
@@ -80,13 +78,16 @@ public:
 	 */
 	Vector& operator= (const Vector &other)
 	{
-		this->_size = other._size;
-		_arr = new T[this->_size];
-
-		for (int i = 0; i < this->_size; ++i) {
-			_arr[i] = other._arr[i];
+		if (this == &other) {
+			return *this;
 		}
 
+		delete[] _arr;
+
+		this->_size = other._size;
+		_arr = numa_alloc<T>(this->_size);
+		numa_copy(_arr, other._arr, this->_size);
+
 		return *this;
 	}
 
@@ -140,6 +141,16 @@ public:
 		return _arr[index];
 	}
 
+	/**
+	 * @brief Gets the plain array of elements
+	 * @details Meant for kernels that work with raw arrays
+	 * @return Pointer to the first element
+	 */
+	T* data() const
+	{
+		return _arr;
+	}
+
 	/**
 	 * @brief Inserts an element to Vector
 	 * @details The space for this element should
@@ -168,11 +179,15 @@ public:
 			throw VecSizeMismatch();
 		}
 
+		SPARSE_PROFILE_SCOPE("Vector::operator+", 3LL * this->_size * sizeof(T));
+
 		Vector res(this->_size);
 
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] + other._arr[i];
-		}
+		numa_for<T>(this->_size, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				res._arr[i] = _arr[i] + other._arr[i];
+			}
+		});
 
 		return res;
 	}
@@ -191,11 +206,15 @@ public:
 			throw VecSizeMismatch();
 		}
 
+		SPARSE_PROFILE_SCOPE("Vector::operator-", 3LL * this->_size * sizeof(T));
+
 		Vector res(this->_size);
 
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] - other._arr[i];
-		}
+		numa_for<T>(this->_size, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				res._arr[i] = _arr[i] - other._arr[i];
+			}
+		});
 
 		return res;
 	}
@@ -212,11 +231,15 @@ public:
 	template <typename S>
 	Vector operator* (const S &val) const
 	{
+		SPARSE_PROFILE_SCOPE("Vector::operator*", 2LL * this->_size * sizeof(T));
+
 		Vector res(this->_size);
 
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] * val;
-		}
+		numa_for<T>(this->_size, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				res._arr[i] = _arr[i] * val;
+			}
+		});
 
 		return res;
 	}
@@ -237,11 +260,15 @@ public:
 			throw DivideByZero();
 		}
 
+		SPARSE_PROFILE_SCOPE("Vector::operator/", 2LL * this->_size * sizeof(T));
+
 		Vector<T> res(this->_size);
 
-		for (int i = 0; i < this->_size; ++i) {
-			res._arr[i] = _arr[i] / val;
-		}
+		numa_for<T>(this->_size, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				res._arr[i] = _arr[i] / val;
+			}
+		});
 
 		return res;
 	}